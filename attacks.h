@@ -0,0 +1,89 @@
+#ifndef ATTACKS_H
+#define ATTACKS_H
+
+#include <cstdint>
+
+/*
+ * Square sets as 64 bit masks, bit row * 8 + col with row 0 being black's home row like the board array. The
+ * attacks of the pieces that move a fixed distance and the squares between and through any two squares are
+ * computed at compile time into one constant table, so a blocked path is a single AND with the occupied squares
+ * and nothing is built at startup.
+ */
+
+struct AttackTables
+{
+    uint64_t knight[64];
+    uint64_t king[64];
+
+    // Squares a pawn attacks, [0] for white pawns and [1] for black pawns
+    uint64_t pawn[2][64];
+
+    // Squares strictly between two squares on a common rank, file or diagonal, 0 when they aren't on one
+    uint64_t between[64][64];
+
+    // Every square of the rank, file or diagonal through two squares, 0 when they aren't on one
+    uint64_t line[64][64];
+};
+
+constexpr uint64_t squareBit(int row, int col)
+{
+    return 1ULL << (row * 8 + col);
+}
+
+// Returns the squares reached from a square by single steps, skipping steps that leave the board
+constexpr uint64_t stepAttacks(int square, const int (*steps)[2], int count)
+{
+    uint64_t mask = 0;
+    for (int i = 0; i < count; ++i) {
+        int row = square / 8 + steps[i][0];
+        int col = square % 8 + steps[i][1];
+        if (row >= 0 && row < 8 && col >= 0 && col < 8) mask |= squareBit(row, col);
+    }
+    return mask;
+}
+
+constexpr AttackTables makeAttackTables()
+{
+    constexpr int knightSteps[8][2] = { { 2, 1 }, { 2, -1 }, { -2, 1 }, { -2, -1 }, { 1, 2 }, { 1, -2 }, { -1, 2 }, { -1, -2 } };
+    constexpr int kingSteps[8][2] = { { 1, 1 }, { 1, 0 }, { 1, -1 }, { 0, 1 }, { 0, -1 }, { -1, 1 }, { -1, 0 }, { -1, -1 } };
+    constexpr int whitePawnSteps[2][2] = { { -1, -1 }, { -1, 1 } };
+    constexpr int blackPawnSteps[2][2] = { { 1, -1 }, { 1, 1 } };
+
+    AttackTables tables = {};
+    for (int square = 0; square < 64; ++square) {
+        tables.knight[square] = stepAttacks(square, knightSteps, 8);
+        tables.king[square] = stepAttacks(square, kingSteps, 8);
+        tables.pawn[0][square] = stepAttacks(square, whitePawnSteps, 2);
+        tables.pawn[1][square] = stepAttacks(square, blackPawnSteps, 2);
+    }
+
+    // Walk each of the eight directions from every square. Every square met is on the line through both, and the
+    // squares passed on the way are between them
+    for (int from = 0; from < 64; ++from) {
+        for (int d = 0; d < 8; ++d) {
+            int stepRow = kingSteps[d][0];
+            int stepCol = kingSteps[d][1];
+
+            // The whole line in both directions through the starting square
+            uint64_t line = squareBit(from / 8, from % 8);
+            for (int sign = -1; sign <= 1; sign += 2) {
+                for (int row = from / 8 + sign * stepRow, col = from % 8 + sign * stepCol; row >= 0 && row < 8 && col >= 0 && col < 8;
+                     row += sign * stepRow, col += sign * stepCol) {
+                    line |= squareBit(row, col);
+                }
+            }
+
+            uint64_t passed = 0;
+            for (int row = from / 8 + stepRow, col = from % 8 + stepCol; row >= 0 && row < 8 && col >= 0 && col < 8; row += stepRow, col += stepCol) {
+                int to = row * 8 + col;
+                tables.between[from][to] = passed;
+                tables.line[from][to] = line;
+                passed |= squareBit(row, col);
+            }
+        }
+    }
+    return tables;
+}
+
+static constexpr AttackTables ATTACKS = makeAttackTables();
+#endif
@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "chess.h"
+#include "packed_position.h"
+#include "position_batch.h"
+
+// Positions every benchmark runs over: openings, middlegames, endgames, checks and mates
+static const char* const BENCHMARK_POSITIONS[]={
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP1QBPPP/R3KB1R w KQ - 0 8",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+    "4k3/8/8/8/8/8/4P3/4K3 w - - 0 1",
+    "rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3",
+    "r1bqkb1r/pppp1Qpp/2n2n2/4p3/2B1P3/8/PPPP1PPP/RNB1K1NR b KQkq - 0 4",
+    "4k3/4q3/8/8/8/8/8/4K3 w - - 0 1"
+};
+
+// A piece of the library to time. One pass does `ops` operations and returns a value that depends on all of them
+struct BenchmarkCase{
+    std::string name;
+    long long ops;
+    std::function<long long()> pass;
+};
+
+// Timings of one benchmark, per operation
+struct BenchmarkResult{
+    std::string name;
+    long long opsPerSample;
+    int samples;
+    double median;
+    double p99;
+    double mean;
+    double minimum;
+};
+
+// Keeps results alive so the compiler can't drop the work that produced them
+static volatile long long benchmarkSink;
+
+/*
+ * Runtime-dispatched versions of check detection and move generation, as they were before they were specialized by
+ * color and piece type, kept so the benchmark shows what the specialization gains
+ */
+
+// Asks every piece of the other side whether isValidMove takes it to the king
+bool runtimeIsKingInCheck(Chessboard& board,bool black,int kingRow,int kingCol){
+    Color attacker=black?Color::White:Color::Black;
+    for (int i=0;i<8;++i){
+        for (int j=0;j<8;++j){
+            if (board.getPiece(i,j).getColor()!=attacker) continue;
+            if (board.isValidMove(i,j,kingRow,kingCol)) return true;
+        }
+    }
+    return false;
+}
+
+// Finds candidate squares with runtime color and type branches and checks each with isLegalMove
+int runtimeGenerateMoves(const Chessboard& board,Move* moves){
+    static const int knightSteps[8][2]={{2,1},{2,-1},{-2,1},{-2,-1},{1,2},{1,-2},{-1,2},{-1,-2}};
+    static const int kingSteps[8][2]={{1,1},{1,0},{1,-1},{0,1},{0,-1},{-1,1},{-1,0},{-1,-1}};
+    static const Type promotions[4]={Type::Queen,Type::Rook,Type::Bishop,Type::Knight};
+    Color us=board.isBlackToMove()?Color::Black:Color::White;
+    int count=0;
+
+    auto tryMove=[&](int row,int col,int destRow,int destCol){
+        if (destRow<0 || destRow>=8 || destCol<0 || destCol>=8) return;
+        if (board.getPiece(destRow,destCol).getColor()==us) return;
+        if (board.getPiece(row,col).getType()==Type::Pawn && (destRow==0 || destRow==7)){
+            for (Type promotion:promotions){
+                Move move(row,col,destRow,destCol,promotion);
+                if (board.isLegalMove(move)) moves[count++]=move;
+            }
+            return;
+        }
+        Move move(row,col,destRow,destCol);
+        if (board.isLegalMove(move)) moves[count++]=move;
+    };
+
+    for (int row=0;row<8;++row){
+        for (int col=0;col<8;++col){
+            Piece piece=board.getPiece(row,col);
+            if (piece.getColor()!=us) continue;
+            Type type=piece.getType();
+            switch (type){
+            case Type::Pawn:{
+                int direction=us==Color::White?-1:1;
+                tryMove(row,col,row+direction,col);
+                tryMove(row,col,row+2*direction,col);
+                tryMove(row,col,row+direction,col-1);
+                tryMove(row,col,row+direction,col+1);
+                break;
+            }
+            case Type::Knight:
+                for (const auto& step:knightSteps) tryMove(row,col,row+step[0],col+step[1]);
+                break;
+            case Type::King:
+                for (const auto& step:kingSteps) tryMove(row,col,row+step[0],col+step[1]);
+                if (col==4){
+                    tryMove(row,col,row,2);
+                    tryMove(row,col,row,6);
+                }
+                break;
+            default:
+                for (const auto& step:kingSteps){
+                    bool straight=step[0]==0 || step[1]==0;
+                    if ((straight && type==Type::Bishop) || (!straight && type==Type::Rook)) continue;
+                    for (int r=row+step[0],c=col+step[1];r>=0 && r<8 && c>=0 && c<8;r+=step[0],c+=step[1]){
+                        tryMove(row,col,r,c);
+                        if (board.getPiece(r,c).getType()!=Type::None) break;
+                    }
+                }
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Times a case: passes are grouped into samples of about a millisecond, a few samples warm up the caches
+ *        and branch predictors, then every sample is timed on its own
+ *
+ * @param benchmark The case to time
+ * @param samples How many samples to keep
+ * @param warmup How many samples to throw away first
+ * @return Nanoseconds per operation over the kept samples
+ */
+BenchmarkResult runBenchmark(const BenchmarkCase& benchmark,int samples,int warmup){
+    using Clock=std::chrono::steady_clock;
+
+    // Find how many passes fill a sample
+    int passes=1;
+    for (;;){
+        auto start=Clock::now();
+        for (int i=0;i<passes;++i) benchmarkSink=benchmarkSink+benchmark.pass();
+        double nanos=std::chrono::duration<double,std::nano>(Clock::now()-start).count();
+        if (nanos>=1e6 || passes>=(1<<20)) break;
+        passes=nanos<1e5?passes*10:passes*2;
+    }
+
+    std::vector<double> times;
+    for (int sample=0;sample<warmup+samples;++sample){
+        auto start=Clock::now();
+        for (int i=0;i<passes;++i) benchmarkSink=benchmarkSink+benchmark.pass();
+        double nanos=std::chrono::duration<double,std::nano>(Clock::now()-start).count();
+        if (sample>=warmup) times.push_back(nanos/(static_cast<double>(passes)*benchmark.ops));
+    }
+
+    std::sort(times.begin(),times.end());
+    BenchmarkResult result;
+    result.name=benchmark.name;
+    result.opsPerSample=passes*benchmark.ops;
+    result.samples=samples;
+    result.median=times[times.size()/2];
+    result.p99=times[std::min(times.size()-1,times.size()*99/100)];
+    result.minimum=times.front();
+    result.mean=0;
+    for (double time:times) result.mean+=time/times.size();
+    return result;
+}
+
+/**
+ * @brief Builds the list of benchmarks over the fixed positions
+ *
+ * @param boards The positions, kept alive for as long as the cases are used
+ * @return The cases
+ */
+std::vector<BenchmarkCase> createBenchmarks(std::vector<Chessboard>& boards){
+    std::vector<BenchmarkCase> cases;
+
+    // isValidMove from every piece of a type to every square
+    static const char* const pieceNames[7]={"","pawn","knight","bishop","rook","queen","king"};
+    for (int type=1;type<=6;++type){
+        std::vector<std::pair<int,int>> sources;
+        for (int i=0;i<(int)boards.size();++i){
+            for (int square=0;square<64;++square){
+                if (static_cast<int>(boards[i].getPiece(square/8,square%8).getType())==type) sources.push_back({i,square});
+            }
+        }
+        cases.push_back({std::string("isValidMove/")+pieceNames[type],(long long)sources.size()*64,[&boards,sources](){
+            long long valid=0;
+            for (const auto& source:sources){
+                const Chessboard& board=boards[source.first];
+                for (int dest=0;dest<64;++dest) valid+=board.isValidMove(source.second/8,source.second%8,dest/8,dest%8);
+            }
+            return valid;
+        }});
+    }
+
+    // Check detection for both sides of every position and mate detection for the side to move
+    cases.push_back({"isKingInCheck",(long long)boards.size()*2,[&boards](){
+        long long checks=0;
+        for (const Chessboard& board:boards) checks+=board.isKingInCheck(false)+board.isKingInCheck(true);
+        return checks;
+    }});
+    std::vector<std::pair<int,int>> kings;
+    for (const Chessboard& board:boards){
+        int squares[2]={0,0};
+        for (int square=0;square<64;++square){
+            Piece piece=board.getPiece(square/8,square%8);
+            if (piece.getType()==Type::King) squares[piece.getColor()==Color::Black?1:0]=square;
+        }
+        kings.push_back({squares[0],squares[1]});
+    }
+    cases.push_back({"isKingInCheck/runtime",(long long)boards.size()*2,[&boards,kings](){
+        long long checks=0;
+        for (size_t i=0;i<boards.size();++i){
+            checks+=runtimeIsKingInCheck(boards[i],false,kings[i].first/8,kings[i].first%8);
+            checks+=runtimeIsKingInCheck(boards[i],true,kings[i].second/8,kings[i].second%8);
+        }
+        return checks;
+    }});
+    cases.push_back({"isKingInCheckmate",(long long)boards.size(),[&boards](){
+        long long mates=0;
+        for (const Chessboard& board:boards) mates+=board.isKingInCheckmate(board.isBlackToMove());
+        return mates;
+    }});
+
+    // Playing every legal move on a copy of the position. movePiece only gets the moves it plays without asking
+    // anything, which leaves out promotions
+    std::vector<std::pair<int,Move>> moves;
+    std::vector<std::pair<int,Move>> inputs;
+    std::streambuf* console=std::cout.rdbuf(nullptr);
+    for (int i=0;i<(int)boards.size();++i){
+        Move legal[Chessboard::MAX_MOVES];
+        int count=boards[i].generateMoves(legal);
+        for (int j=0;j<count;++j){
+            moves.push_back({i,legal[j]});
+            Chessboard board=boards[i];
+            if (legal[j].getPromotion()==Type::None && board.movePiece(legal[j],board.isBlackToMove())) inputs.push_back({i,legal[j]});
+        }
+    }
+    std::cout.rdbuf(console);
+    cases.push_back({"copyBoard",(long long)moves.size(),[&boards,moves](){
+        long long sum=0;
+        for (const auto& move:moves){
+            Chessboard board=boards[move.first];
+            sum+=board.getPiece(move.second.getDestRow(),move.second.getDestCol()).getType()!=Type::None;
+        }
+        return sum;
+    }});
+    cases.push_back({"movePiece",(long long)inputs.size(),[&boards,inputs](){
+        long long played=0;
+        for (const auto& input:inputs){
+            Chessboard board=boards[input.first];
+            played+=board.movePiece(input.second,board.isBlackToMove());
+        }
+        return played;
+    }});
+    cases.push_back({"makeMove",(long long)moves.size(),[&boards,moves](){
+        long long played=0;
+        for (const auto& move:moves){
+            Chessboard board=boards[move.first];
+            played+=board.makeMove(move.second);
+        }
+        return played;
+    }});
+    cases.push_back({"makeLegalMove",(long long)moves.size(),[&boards,moves](){
+        long long played=0;
+        for (const auto& move:moves){
+            Chessboard board=boards[move.first];
+            board.makeLegalMove(move.second);
+            played+=board.isBlackToMove();
+        }
+        return played;
+    }});
+    cases.push_back({"givesCheck",(long long)moves.size(),[&boards,moves](){
+        long long checks=0;
+        for (const auto& move:moves) checks+=boards[move.first].givesCheck(move.second);
+        return checks;
+    }});
+
+    // Move generation and hashing
+    cases.push_back({"generateMoves",(long long)boards.size(),[&boards](){
+        long long total=0;
+        Move legal[Chessboard::MAX_MOVES];
+        for (const Chessboard& board:boards) total+=board.generateMoves(legal);
+        return total;
+    }});
+    cases.push_back({"generateMoves/runtime",(long long)boards.size(),[&boards](){
+        long long total=0;
+        Move legal[Chessboard::MAX_MOVES];
+        for (const Chessboard& board:boards) total+=runtimeGenerateMoves(board,legal);
+        return total;
+    }});
+    cases.push_back({"getKey",(long long)boards.size(),[&boards](){
+        long long keys=0;
+        for (const Chessboard& board:boards) keys^=board.getKey();
+        return keys;
+    }});
+
+    // The packed encoding, both ways
+    std::vector<PackedPosition> packed(boards.size());
+    packPositions(boards.data(),boards.size(),packed.data());
+    cases.push_back({"packPosition",(long long)boards.size(),[&boards](){
+        long long total=0;
+        PackedPosition position;
+        for (const Chessboard& board:boards){
+            packPosition(board,position);
+            total+=hashPackedPosition(position);
+        }
+        return total;
+    }});
+    cases.push_back({"unpackPosition",(long long)packed.size(),[packed](){
+        long long total=0;
+        Chessboard board;
+        for (const PackedPosition& position:packed) total+=unpackPosition(position,board);
+        return total;
+    }});
+
+    // The batched kernels next to the one position at a time path, over enough copies of the positions to fill
+    // the vectors. The /scalar cases run the kernels one lane at a time
+    PositionBatch batch;
+    for (int copy=0;copy<64;++copy){
+        for (const Chessboard& board:boards) batch.add(board);
+    }
+    long long batchSize=(long long)batch.size();
+    cases.push_back({"evaluatePosition",(long long)boards.size(),[&boards](){
+        long long total=0;
+        for (const Chessboard& board:boards) total+=evaluatePosition(board);
+        return total;
+    }});
+    cases.push_back({"batch/evaluate",batchSize,[batch](){
+        std::vector<int> scores(batch.size());
+        batch.evaluate(scores.data());
+        return (long long)scores[0]+scores.back();
+    }});
+    cases.push_back({"batch/countLegalMoves",batchSize,[batch](){
+        std::vector<int> counts(batch.size());
+        batch.countLegalMoves(counts.data());
+        return (long long)counts[0]+counts.back();
+    }});
+    cases.push_back({"batch/countLegalMoves/scalar",batchSize,[batch](){
+        std::vector<int> counts(batch.size());
+        batch.countLegalMoves<ScalarLanes>(counts.data());
+        return (long long)counts[0]+counts.back();
+    }});
+    cases.push_back({"batch/attackMaps",batchSize,[batch](){
+        std::vector<uint64_t> white(batch.size()),black(batch.size());
+        batch.attackMaps(white.data(),black.data());
+        return (long long)(white[0]^black.back());
+    }});
+    return cases;
+}
+
+/**
+ * @brief Writes the results as JSON
+ *
+ * @param out Where to write
+ * @param results The results
+ */
+void writeJson(FILE* out,const std::vector<BenchmarkResult>& results){
+    fprintf(out,"{\n  \"unit\": \"ns/op\",\n  \"benchmarks\": [\n");
+    for (size_t i=0;i<results.size();++i){
+        const BenchmarkResult& result=results[i];
+        fprintf(out,"    {\"name\": \"%s\", \"ops_per_sample\": %lld, \"samples\": %d, \"median\": %.3f, \"p99\": %.3f, \"mean\": %.3f, \"min\": %.3f}%s\n",
+                result.name.c_str(),result.opsPerSample,result.samples,result.median,result.p99,result.mean,result.minimum,
+                i+1<results.size()?",":"");
+    }
+    fprintf(out,"  ]\n}\n");
+}
+
+// Reads a whole argument as a count, without the exceptions of std::stoi. Returns false if it isn't one
+bool parseCount(const char* text,int& value){
+    char* end;
+    errno=0;
+    long parsed=strtol(text,&end,10);
+    if (end==text || *end || errno || parsed<0 || parsed>INT32_MAX) return false;
+    value=static_cast<int>(parsed);
+    return true;
+}
+
+int main(int argc,char* argv[])
+{
+    int samples=200;
+    int warmup=20;
+    std::string filter;
+    std::string jsonPath;
+    for (int i=1;i<argc;++i){
+        std::string option=argv[i];
+        bool valid=true;
+        if (option=="--samples" && i+1<argc) valid=parseCount(argv[++i],samples);
+        else if (option=="--warmup" && i+1<argc) valid=parseCount(argv[++i],warmup);
+        else if (option=="--filter" && i+1<argc) filter=argv[++i];
+        else if (option=="--json" && i+1<argc) jsonPath=argv[++i];
+        else valid=false;
+        if (!valid){
+            std::cout<<"Usage: "<<argv[0]<<" [--samples N] [--warmup N] [--filter text] [--json file|-]"<<std::endl;
+            return 1;
+        }
+    }
+    samples=std::max(1,samples);
+
+    std::vector<Chessboard> boards;
+    for (const char* fen:BENCHMARK_POSITIONS){
+        boards.emplace_back();
+        if (!boards.back().loadFEN(fen)){
+            std::cout<<"Invalid benchmark position: "<<fen<<std::endl;
+            return 1;
+        }
+    }
+
+    // With the JSON on standard output the table goes to standard error
+    bool jsonToStdout=jsonPath=="-";
+    FILE* table=jsonToStdout?stderr:stdout;
+    std::vector<BenchmarkResult> results;
+    fprintf(table,"%-30s %12s %12s %12s\n","benchmark","ops/sample","median ns","p99 ns");
+    for (const BenchmarkCase& benchmark:createBenchmarks(boards)){
+        if (!filter.empty() && benchmark.name.find(filter)==std::string::npos) continue;
+        results.push_back(runBenchmark(benchmark,samples,warmup));
+        const BenchmarkResult& result=results.back();
+        fprintf(table,"%-30s %12lld %12.1f %12.1f\n",result.name.c_str(),result.opsPerSample,result.median,result.p99);
+        fflush(table);
+    }
+
+    if (!jsonPath.empty()){
+        FILE* out=jsonToStdout?stdout:fopen(jsonPath.c_str(),"w");
+        if (!out){
+            std::cout<<"Could not write "<<jsonPath<<std::endl;
+            return 1;
+        }
+        writeJson(out,results);
+        if (!jsonToStdout) fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,321 @@
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include "chess.h"
+#include "game_record.h"
+#include "mapped_file.h"
+#include "pgn.h"
+
+/*
+ * Polyglot opening book: a file of 16 byte big endian entries sorted by key
+ *
+ *   key     64 bits  Zobrist key of the position (Chessboard::getKey)
+ *   move    16 bits  to file (bits 0-2), to rank (3-5), from file (6-8), from rank (9-11), promotion (12-14)
+ *   weight  16 bits  how good the move is relative to the other moves of the position
+ *   learn   32 bits  unused, written as 0
+ *
+ * Ranks count from white's side and castling is written as the king taking its own rook (e1h1, e1a1, e8h8, e8a8).
+ */
+
+struct BookEntry
+{
+    uint64_t key;
+    uint16_t move;
+    uint16_t weight;
+    uint32_t learn;
+};
+
+// Returns the Polyglot encoding of a move played on a board
+inline uint16_t toPolyglotMove(const Chessboard& board, Move move)
+{
+    int fromRank = 7 - move.getSourceRow();
+    int fromFile = move.getSourceCol();
+    int toRank = 7 - move.getDestRow();
+    int toFile = move.getDestCol();
+
+    // Castling is written as the king moving onto the rook
+    if (board.getPiece(move.getSourceRow(), fromFile).getType() == Type::King && fromFile == 4 && (toFile == 2 || toFile == 6)) {
+        toFile = toFile == 6 ? 7 : 0;
+    }
+
+    int promotion = 0;
+    switch (move.getPromotion()) {
+    case Type::Knight:
+        promotion = 1;
+        break;
+    case Type::Bishop:
+        promotion = 2;
+        break;
+    case Type::Rook:
+        promotion = 3;
+        break;
+    case Type::Queen:
+        promotion = 4;
+        break;
+    default:
+        break;
+    }
+    return static_cast<uint16_t>(toFile | (toRank << 3) | (fromFile << 6) | (fromRank << 9) | (promotion << 12));
+}
+
+// Returns the move a Polyglot encoded move stands for on a board
+inline Move fromPolyglotMove(const Chessboard& board, uint16_t polyglotMove)
+{
+    int toFile = polyglotMove & 7;
+    int toRow = 7 - ((polyglotMove >> 3) & 7);
+    int fromFile = (polyglotMove >> 6) & 7;
+    int fromRow = 7 - ((polyglotMove >> 9) & 7);
+    static const Type promotions[8] = { Type::None, Type::Knight, Type::Bishop, Type::Rook, Type::Queen, Type::None, Type::None, Type::None };
+
+    // The king landing on its own rook is castling
+    const Piece king = board.getPiece(fromRow, fromFile);
+    const Piece target = board.getPiece(toRow, toFile);
+    if (king.getType() == Type::King && target.getType() == Type::Rook && target.getColor() == king.getColor()) {
+        toFile = toFile == 7 ? 6 : 2;
+    }
+    return Move(fromRow, fromFile, toRow, toFile, promotions[(polyglotMove >> 12) & 7]);
+}
+
+// Read only opening book, probed by binary search straight on the memory mapping
+class PolyglotBook
+{
+private:
+    MappedFile file;
+
+    static uint64_t readKey(const unsigned char* entry)
+    {
+        uint64_t key;
+        memcpy(&key, entry, sizeof(key));
+        return __builtin_bswap64(key);
+    }
+
+    static BookEntry readEntry(const unsigned char* entry)
+    {
+        BookEntry result;
+        result.key = readKey(entry);
+        result.move = static_cast<uint16_t>((entry[8] << 8) | entry[9]);
+        result.weight = static_cast<uint16_t>((entry[10] << 8) | entry[11]);
+        result.learn = (static_cast<uint32_t>(entry[12]) << 24) | (entry[13] << 16) | (entry[14] << 8) | entry[15];
+        return result;
+    }
+
+public:
+    /**
+     * @brief Maps a book file
+     *
+     * @param path Path of the book
+     * @return true if the book was opened
+     * @return false if the file could not be mapped or isn't a whole number of entries
+     */
+    bool open(const char* path)
+    {
+        if (!file.open(path, false)) return false;
+        if (file.length() % 16 != 0) {
+            file.close();
+            return false;
+        }
+        return true;
+    }
+
+    // Returns whether a book is loaded
+    bool isOpen() const
+    {
+        return file.isOpen();
+    }
+
+    // Returns the number of entries in the book
+    size_t size() const
+    {
+        return file.length() / 16;
+    }
+
+    /**
+     * @brief Finds the book entries of a position
+     *
+     * @param key Zobrist key of the position
+     * @param entries Receives up to maxEntries entries
+     * @param maxEntries Size of the entries array
+     * @return Number of entries found
+     */
+    int probe(uint64_t key, BookEntry* entries, int maxEntries) const
+    {
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(file.begin());
+        size_t low = 0;
+        size_t high = size();
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (readKey(data + mid * 16) < key) low = mid + 1;
+            else high = mid;
+        }
+
+        int count = 0;
+        for (size_t i = low; i < size() && count < maxEntries; ++i) {
+            BookEntry entry = readEntry(data + i * 16);
+            if (entry.key != key) break;
+            entries[count++] = entry;
+        }
+        return count;
+    }
+
+    /**
+     * @brief Picks the book move with the highest weight that is legal on the board
+     *
+     * @param board Position to look up
+     * @return The book move, or a null move if the position isn't in the book
+     */
+    Move bestMove(const Chessboard& board) const
+    {
+        if (!isOpen()) return Move();
+
+        BookEntry entries[64];
+        int count = probe(board.getKey(), entries, 64);
+        std::sort(entries, entries + count, [](const BookEntry& a, const BookEntry& b) { return a.weight > b.weight; });
+        for (int i = 0; i < count; ++i) {
+            Move move = fromPolyglotMove(board, entries[i].move);
+            if (board.isLegalMove(move)) return move;
+        }
+        return Move();
+    }
+};
+
+// Totals of a book build
+struct BookBuildStats
+{
+    long long games;
+    long long skipped;
+    long long positions;
+    long long entries;
+};
+
+/**
+ * @brief Builds a Polyglot book from a PGN file or a game record file. Every move played within the first plies
+ *        of a game counts 2 for a win, 1 for a draw and 0 for a loss of the side that played it
+ *
+ * @param inputPath PGN or game record file, told apart by the record file magic
+ * @param bookPath Path of the book to write
+ * @param maxPly Only the first maxPly moves of each game go into the book
+ * @param minCount Moves played fewer times than this are left out
+ * @param stats Receives the totals of the build
+ * @return true if the book was written
+ * @return false if a file could not be opened or written, in which case no book is left behind
+ */
+inline bool buildBook(const char* inputPath, const char* bookPath, int maxPly, int minCount, BookBuildStats& stats)
+{
+    struct MoveStats
+    {
+        uint64_t key;
+        uint16_t move;
+        uint32_t count;
+        uint64_t score;
+    };
+    std::unordered_map<uint64_t, std::vector<MoveStats>> positions;
+    stats = BookBuildStats();
+
+    // Called for every move of a game with the position it was played in
+    auto addMove = [&](const Chessboard& board, Move move, int ply, GameResult result) {
+        if (ply >= maxPly) return;
+        uint64_t key = board.getKey();
+        uint16_t polyglotMove = toPolyglotMove(board, move);
+        int score = 1;
+        if (result == GameResult::WhiteWins) score = board.isBlackToMove() ? 0 : 2;
+        else if (result == GameResult::BlackWins) score = board.isBlackToMove() ? 2 : 0;
+
+        std::vector<MoveStats>& moves = positions[key];
+        for (MoveStats& stat : moves) {
+            if (stat.move == polyglotMove) {
+                stat.count++;
+                stat.score += score;
+                return;
+            }
+        }
+        moves.push_back({ key, polyglotMove, 1, static_cast<uint64_t>(score) });
+    };
+
+    GameRecordReader records;
+    if (records.open(inputPath)) {
+        for (uint64_t i = 0; i < records.size(); ++i) {
+            GameRecordView game;
+            Chessboard board;
+            if (!records.game(i, game) || (!game.fen.empty() && !board.loadFEN(game.fen))) {
+                stats.skipped++;
+                continue;
+            }
+            for (int ply = 0; ply < game.plyCount && ply < maxPly; ++ply) {
+                Move move = game.move(ply);
+                addMove(board, move, ply, game.result);
+                if (!board.makeMove(move)) break;
+            }
+            stats.games++;
+        }
+    }
+    else {
+        PgnReader reader;
+        if (!reader.open(inputPath)) return false;
+        std::string_view text = reader.text();
+        Chessboard board;
+        PgnGame game;
+        PgnError error;
+        GameResult result;
+        std::vector<std::pair<Chessboard, Move>> plies;
+
+        // The result is only known at the end of the game, so hold on to its opening moves until then
+        size_t pos = reader.nextGameStart(0);
+        while (reader.nextGame(pos, text.size(), game)) {
+            plies.clear();
+            if (!replayPgnGame(game, text.data(), board, result, error, [&](const Chessboard& before, Move move) {
+                    if (static_cast<int>(plies.size()) < maxPly) plies.emplace_back(before, move);
+                })) {
+                stats.skipped++;
+                continue;
+            }
+            for (size_t ply = 0; ply < plies.size(); ++ply) addMove(plies[ply].first, plies[ply].second, static_cast<int>(ply), result);
+            stats.games++;
+        }
+    }
+
+    // Sort by key, best move first within a position
+    std::vector<MoveStats> entries;
+    uint64_t maxScore = 0;
+    for (auto& position : positions) {
+        for (const MoveStats& stat : position.second) {
+            if (stat.count < static_cast<uint32_t>(minCount)) continue;
+            entries.push_back(stat);
+            maxScore = std::max(maxScore, stat.score);
+        }
+    }
+    std::sort(entries.begin(), entries.end(), [](const MoveStats& a, const MoveStats& b) {
+        return a.key != b.key ? a.key < b.key : a.score > b.score;
+    });
+    stats.positions = static_cast<long long>(positions.size());
+    stats.entries = static_cast<long long>(entries.size());
+
+    // Encode the whole book first, so that it is written, and checked, with a single write
+    std::vector<unsigned char> data(entries.size() * 16);
+    for (size_t n = 0; n < entries.size(); ++n) {
+        const MoveStats& stat = entries[n];
+        // Weights are 16 bits, so scale them down when the corpus is big. Moves that were played keep a weight of at least 1
+        uint64_t weight = maxScore > UINT16_MAX ? stat.score * UINT16_MAX / maxScore : stat.score;
+        if (weight == 0) weight = 1;
+
+        unsigned char* entry = data.data() + n * 16;
+        for (int i = 0; i < 8; ++i) entry[i] = static_cast<unsigned char>(stat.key >> (56 - 8 * i));
+        entry[8] = static_cast<unsigned char>(stat.move >> 8);
+        entry[9] = static_cast<unsigned char>(stat.move);
+        entry[10] = static_cast<unsigned char>(weight >> 8);
+        entry[11] = static_cast<unsigned char>(weight);
+    }
+
+    FILE* out = fopen(bookPath, "wb");
+    if (!out) return false;
+    bool ok = fwrite(data.data(), 1, data.size(), out) == data.size();
+    ok = fclose(out) == 0 && ok;
+    if (!ok) remove(bookPath);
+    return ok;
+}
+#endif
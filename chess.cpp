@@ -1,826 +1,842 @@
+#include <chrono>
+#include <future>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
+#include "chess.h"
+#include "epd.h"
+#include "pgn.h"
+#include "game_record.h"
+#include "book.h"
+#include "engine.h"
+#include "mate_solver.h"
+#include "packed_position.h"
+#include "position_batch.h"
+#include "position_index.h"
+#include "selfplay.h"
+#include "tablebase.h"
+#include "tournament.h"
+#include "tuner.h"
+#include "uci.h"
+#include <thread>
 
-// Enum to classify the type of pieces
-enum class Type
-{
-    None,
-    Pawn,
-    Knight,
-    Bishop,
-    Rook,
-    Queen,
-    King
-};
+/**
+ * @brief Prints out the logs
+ * 
+ * @param moveLog Array containing the logs
+ */
+void printLogs(const std::vector<Move>& moveLog){
+    std::cout<< "Move Log:" << std::endl;
+    for (Move move:moveLog){
+        std::cout<<move.toString()<<std::endl;
+    }
+}
 
-// Enum to classify the color of pieces
-enum class Color
-{
-    None,
-    Black,
-    White
-};
+/**
+ * @brief Packs every position of an EPD file into 32 byte records, checking that each one unpacks to the same
+ *        position, and reports the sizes and the throughput
+ *
+ * @param path Path of the EPD file
+ * @param outPath Path of the file of packed positions to write
+ * @return Exit code of the program
+ */
+int packEpdFile(const char* path,const char* outPath){
+    EpdReader reader;
+    if (!reader.open(path)){
+        std::cout<<"Could not open "<<path<<std::endl;
+        return 1;
+    }
+    FILE* out=fopen(outPath,"wb");
+    if (!out){
+        std::cout<<"Could not create "<<outPath<<std::endl;
+        return 1;
+    }
 
-// Class to identify each piece
-class Piece
-{
-private:
-    Type type;
-    Color color;
-    bool hasMoved;
+    // Positions are packed a block at a time with the bulk calls
+    const size_t BLOCK=4096;
+    std::vector<Chessboard> boards(BLOCK);
+    std::vector<Chessboard> unpacked(BLOCK);
+    std::vector<PackedPosition> packed(BLOCK);
+    EpdRecord record;
+    long long positions=0;
+    long long failed=0;
+    double seconds=0;
+    bool more=true;
+    while (more){
+        size_t count=0;
+        while (count<BLOCK && (more=reader.next(boards[count],record))){
+            if (record.opcodeCount>=0) count++;
+        }
+        auto start=std::chrono::steady_clock::now();
+        packPositions(boards.data(),count,packed.data());
+        unpackPositions(packed.data(),count,unpacked.data());
+        seconds+=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+        // The FEN may lose an en passant square nobody can use, so compare the keys
+        for (size_t i=0;i<count;++i){
+            if (unpacked[i].getKey()!=boards[i].getKey()) failed++;
+        }
+        positions+=count;
+        fwrite(packed.data(),sizeof(PackedPosition),count,out);
+    }
+    fclose(out);
+    std::cout<<"Positions: "<<positions<<" Failed: "<<failed<<" Bytes: "<<positions*sizeof(PackedPosition)
+             <<" (Chessboard: "<<positions*sizeof(Chessboard)<<") Positions/sec: "<<(seconds>0?positions/seconds:0)<<std::endl;
+    return failed==0?0:1;
+}
+
+/**
+ * @brief Counts the legal moves, attack maps and static evaluation of every position of an EPD file, one position at
+ *        a time and then with the batched kernels, checks that both agree and reports the throughput of each
+ *
+ * @param path Path of the EPD file
+ * @return Exit code of the program
+ */
+int batchEpdFile(const char* path){
+    EpdReader reader;
+    if (!reader.open(path)){
+        std::cout<<"Could not open "<<path<<std::endl;
+        return 1;
+    }
+    std::vector<Chessboard> boards;
+    Chessboard board;
+    EpdRecord record;
+    while (reader.next(board,record)){
+        if (record.opcodeCount>=0) boards.push_back(board);
+    }
+    size_t count=boards.size();
+    PositionBatch batch;
+    batch.reserve(count);
+    for (const Chessboard& position:boards) batch.add(position);
+
+    std::vector<int> moves(count),scores(count);
+    std::vector<uint64_t> white(count),black(count);
+    auto start=std::chrono::steady_clock::now();
+    Move legal[Chessboard::MAX_MOVES];
+    for (size_t i=0;i<count;++i){
+        moves[i]=boards[i].generateMoves(legal);
+        scores[i]=evaluatePosition(boards[i]);
+        white[i]=black[i]=0;
+        for (int square=0;square<64;++square){
+            if (boards[i].isAttackedBy<Color::White>(square/8,square%8)) white[i]|=1ULL<<square;
+            if (boards[i].isAttackedBy<Color::Black>(square/8,square%8)) black[i]|=1ULL<<square;
+        }
+    }
+    double single=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+    std::vector<int> batchMoves(count),batchScores(count);
+    std::vector<uint64_t> batchWhite(count),batchBlack(count);
+    start=std::chrono::steady_clock::now();
+    batch.countLegalMoves(batchMoves.data());
+    batch.evaluate(batchScores.data());
+    batch.attackMaps(batchWhite.data(),batchBlack.data());
+    double batched=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+
+    long long mismatches=0;
+    for (size_t i=0;i<count;++i){
+        if (moves[i]!=batchMoves[i] || scores[i]!=batchScores[i] || white[i]!=batchWhite[i] || black[i]!=batchBlack[i]) mismatches++;
+    }
+    std::cout<<"Positions: "<<count<<" Mismatches: "<<mismatches<<" Lanes: "<<BatchLanes::WIDTH<<std::endl;
+    std::cout<<"Single positions/sec: "<<(single>0?count/single:0)<<" Batched positions/sec: "<<(batched>0?count/batched:0)<<std::endl;
+    return mismatches==0?0:1;
+}
 
-public:
-    Piece(Type t = Type::None, Color c = Color::None) : type(t), color(c), hasMoved(false) {}
+/**
+ * @brief Streams every position of an EPD file through the FEN loader and reports the throughput
+ * 
+ * @param path Path of the EPD file
+ * @return Exit code of the program
+ */
+int loadEpdFile(const char* path){
+    EpdReader reader;
+    if (!reader.open(path)){
+        std::cout<<"Could not open "<<path<<std::endl;
+        return 1;
+    }
 
-    // Returns the type of piece
-    Type getType() const
-    {
-        return type;
+    Chessboard board;
+    EpdRecord record;
+    long long positions=0;
+    long long invalid=0;
+    auto start=std::chrono::steady_clock::now();
+    while (reader.next(board,record)){
+        if (record.opcodeCount<0){
+            std::cout<<"Invalid position at byte "<<record.offset<<": "<<record.line<<std::endl;
+            invalid++;
+            continue;
+        }
+        positions++;
     }
+    double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    std::cout<<"Positions: "<<positions<<" Invalid: "<<invalid<<" Positions/sec: "<<(seconds>0?positions/seconds:0)<<std::endl;
+    return invalid==0?0:1;
+}
 
-    // Returns the color of piece
-    Color getColor() const
-    {
-        return color;
+/**
+ * @brief Replays every game of a PGN file and reports the moves that could not be played
+ * 
+ * @param path Path of the PGN file
+ * @param threads Number of threads to replay on
+ * @return Exit code of the program
+ */
+int replayPgn(const char* path,int threads){
+    PgnReader reader;
+    if (!reader.open(path)){
+        std::cout<<"Could not open "<<path<<std::endl;
+        return 1;
     }
 
-    // Returns whether the piece has been moved before
-    bool hasPieceMoved(){
-        return hasMoved;
+    std::vector<PgnError> errors;
+    PgnReplayStats stats=replayPgnFile(reader,threads,errors);
+    for (const PgnError& error:errors){
+        std::cout<<"Byte "<<error.offset<<": "<<sanResultName(error.reason)<<" move "<<error.move<<std::endl;
     }
+    std::cout<<"Games: "<<stats.games<<" Plies: "<<stats.plies<<" Errors: "<<stats.errors
+             <<" Games/sec: "<<(stats.seconds>0?stats.games/stats.seconds:0)<<std::endl;
+    return stats.errors==0?0:1;
+}
 
-    // Sets bool hasMoved to true
-    void setMoved(){
-        hasMoved=true;
+/**
+ * @brief Replays every game of a record file, checking that each stored move is legal
+ * 
+ * @param path Path of the record file
+ * @return Exit code of the program
+ */
+int scanRecords(const char* path){
+    GameRecordReader reader;
+    if (!reader.open(path)){
+        std::cout<<"Could not open "<<path<<" as a game record file"<<std::endl;
+        return 1;
     }
-};
 
-// Class to hold the main chessboard and run all operations
-class Chessboard
-{
-private:
-    static const int SIZE = 8;
-    Piece board[SIZE][SIZE];
-
-    // Variables to keep track of the king's postions
-    int blackKingRow;
-    int blackKingCol;
-    int whiteKingRow;
-    int whiteKingCol;
-
-    // Stores previous move (useful for enpassant)
-    std::string prevMove;
-
-public:
-    //Initializes the chess board
-    Chessboard()
-    {   
-        blackKingRow = 0;
-        blackKingCol = 4;
-        whiteKingRow = 7;
-        whiteKingCol = 4;
-
-        for (int i = 0; i < SIZE; ++i)
-        {
-            board[1][i] = Piece(Type::Pawn, Color::Black);
-            board[6][i] = Piece(Type::Pawn, Color::White);
-            for (int j = 2; j < 6; ++j)
-            {
-                board[j][i] = Piece();
-            }
+    long long plies=0;
+    long long invalid=0;
+    long long results[4]={0,0,0,0};
+    auto start=std::chrono::steady_clock::now();
+    for (uint64_t i=0;i<reader.size();++i){
+        GameRecordView game;
+        Chessboard board;
+        if (!reader.game(i,game)){
+            std::cout<<"Game "<<i<<": corrupt record"<<std::endl;
+            invalid++;
+            continue;
         }
-        board[0][0] = Piece(Type::Rook, Color::Black);
-        board[0][7] = Piece(Type::Rook, Color::Black);
-        board[7][0] = Piece(Type::Rook, Color::White);
-        board[7][7] = Piece(Type::Rook, Color::White);
-
-        board[0][1] = Piece(Type::Knight, Color::Black);
-        board[0][6] = Piece(Type::Knight, Color::Black);
-        board[7][1] = Piece(Type::Knight, Color::White);
-        board[7][6] = Piece(Type::Knight, Color::White);
-
-        board[0][2] = Piece(Type::Bishop, Color::Black);
-        board[0][5] = Piece(Type::Bishop, Color::Black);
-        board[7][2] = Piece(Type::Bishop, Color::White);
-        board[7][5] = Piece(Type::Bishop, Color::White);
-
-        board[0][3] = Piece(Type::Queen, Color::Black);
-        board[7][3] = Piece(Type::Queen, Color::White);
-
-        board[0][4] = Piece(Type::King, Color::Black);
-        board[7][4] = Piece(Type::King, Color::White);
-    }
-
-    // Prints out the current state of the board using unicode characters to represent pieces
-    void printBoard()
-    {
-        for (int i = 0; i < SIZE; ++i)
-        {
-            std::cout << 8-i << " ";
-            for (int j = 0; j < SIZE; ++j)
-            {
-                Piece piece = board[i][j];
-                switch (piece.getType())
-                {
-                case Type::None:
-                    std::cout << ".";
-                    break;
-                case Type::Pawn:
-                    std::cout << (piece.getColor() == Color::White ? "♙" : "♟");
-                    break;
-                case Type::Knight:
-                    std::cout << (piece.getColor() == Color::White ? "♘" : "♞");
-                    break;
-                case Type::Bishop:
-                    std::cout << (piece.getColor() == Color::White ? "♗" : "♝");
-                    break;
-                case Type::Rook:
-                    std::cout << (piece.getColor() == Color::White ? "♖" : "♜");
-                    break;
-                case Type::Queen:
-                    std::cout << (piece.getColor() == Color::White ? "♕" : "♛");
-                    break;
-                case Type::King:
-                    std::cout << (piece.getColor() == Color::White ? "♔" : "♚"); 
-                    break;
-                }
-                std::cout << " ";
-            }
-            std::cout << std::endl;
-        }
-        std::cout << "# a b c d e f g h"<<std::endl;
-    }
-    /**
-     * @brief Designed to count the number of possibilites and stuff to compare with perft 
-     *        but unforunately also counts duplicates so it doesnt work.
-     * @param depth How many more moves to compute
-     * @param black Indicates if it is black's turn
-     * @param count No. of possibilites
-     * @param checks No. of checks
-     * @param captures No. of captures
-     * @param checkmates No. of checkmates
-     */
-    void countPossibilites(int depth,bool black,int& count,int& checks,int& captures,int& checkmates){
-        if (depth==0){
-            return;
-        }
-        for (int i=0;i<SIZE;++i){
-            for (int j=0;j<SIZE;++j){
-                // Ignore pieces that we can't move in the current turn
-                if (black && board[i][j].getColor()!=Color::Black) continue;
-                if (!black && board[i][j].getColor()!=Color::White) continue;
-
-                // Iterate through all the squares to find a destination
-                for (int k=0;k<SIZE;++k){
-                    for (int l=0;l<SIZE;++l){
-                        
-                        // Check if the piece can move to the destination
-                        if (isValidMove(i,j,k,l)){
-                            
-                            // Update the board
-                            Piece temp = board[k][l];
-                            board[k][l] = board[i][j];
-                            board[i][j] = Piece();
-                            // If the king is moved, update king position
-                            if (board[k][l].getType()==Type::King) updateKingPosn(k,l);
-
-                            // Check if the move puts the king in check
-                            if (isKingInCheck(black)){
-                                board[i][j] = board[k][l]; 
-                                board[k][l] = temp;
-                                if (board[i][j].getType()==Type::King) updateKingPosn(i,j);
-                                continue;
-                            }
-                            if (temp.getType()!=Type::None) captures++;
-                            if (isKingInCheck(!black)){
-                                if (isKingInCheckmate(!black)){
-                                    checkmates++;
-                                    board[i][j] = board[k][l]; 
-                                    board[k][l] = temp;
-                                    if (board[i][j].getType()==Type::King) updateKingPosn(i,j);
-                                    continue;
-                                }
-                                checks++;
-                            }
-                            count++;
-                            countPossibilites(depth-1,!black,count,checks,captures,checkmates);
-                            // If king is not safe, revert and try next iteration.
-                            board[i][j] = board[k][l]; 
-                            board[k][l] = temp;
-                            if (board[i][j].getType()==Type::King) updateKingPosn(i,j);
-                        }
-                    }
-                }
+        if (!game.fen.empty() && !board.loadFEN(game.fen)){
+            invalid++;
+            continue;
+        }
+        for (int ply=0;ply<game.plyCount;++ply){
+            if (!board.makeMove(game.move(ply))){
+                std::cout<<"Game "<<i<<": illegal move at ply "<<ply<<std::endl;
+                invalid++;
+                break;
             }
+            plies++;
         }
+        results[static_cast<int>(game.result)]++;
     }
+    double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    std::cout<<"Games: "<<reader.size()<<" Plies: "<<plies<<" Invalid: "<<invalid<<" Games/sec: "<<(seconds>0?reader.size()/seconds:0)<<std::endl;
+    std::cout<<"White wins: "<<results[1]<<" Black wins: "<<results[2]<<" Draws: "<<results[3]<<" Unknown: "<<results[0]<<std::endl;
+    return invalid==0?0:1;
+}
 
-    std::string predictBestMove(bool black,int depth){
-        return "";
+/**
+ * @brief Prints every game of an index that reached a position
+ * 
+ * @param path Path of the position index
+ * @param fen The position to look for
+ * @return Exit code of the program
+ */
+int queryIndex(const char* path,const char* fen){
+    PositionIndex index;
+    if (!index.open(path)){
+        std::cout<<"Could not open "<<path<<" as a position index"<<std::endl;
+        return 1;
+    }
+    Chessboard board;
+    if (!board.loadFEN(fen)){
+        std::cout<<"Invalid FEN: "<<fen<<std::endl;
+        return 1;
     }
 
-    /**
-     * @brief Checks whether the user input is a valid move
-     * 
-     * @param move contains the user's input
-     * @param black indicates if it is black's turn
-     * @return true when the input is valid
-     * @return false when the input is invalid
-     */
-    bool movePiece(const std::string &move,bool black)
-    {
-        // Validate input length
-        if (move.length() != 4)
-        {
-            std::cout << "Invalid move format. Please use chess notation (e.g., 'e2e4')." << std::endl;
-            return false;
-        }
+    const PositionIndexEntry* first;
+    const PositionIndexEntry* last;
+    auto start=std::chrono::steady_clock::now();
+    uint64_t count=index.find(board.getKey(),first,last);
+    double micros=std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now()-start).count();
+    for (const PositionIndexEntry* entry=first;entry!=last;++entry){
+        std::cout<<"Game "<<entry->game<<" ply "<<entry->ply<<std::endl;
+    }
+    std::cout<<"Matches: "<<count<<" Lookup: "<<micros<<" us"<<std::endl;
+    return 0;
+}
 
-        // Extract source and destination squares
-        int sourceRow = 8 - (move[1] - '0');
-        int sourceCol = move[0] - 'a';
-        int destRow = 8 - (move[3] - '0');
-        int destCol = move[2] - 'a';
+// Positions and keys published with the Polyglot book format, covering castling rights lost by king and rook
+// moves and en passant squares with and without a pawn able to capture
+static const struct { const char* fen; uint64_t key; } POLYGLOT_KEYS[]={
+    {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",0x463B96181691FC9CULL},
+    {"rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1",0x823C9B50FD114196ULL},
+    {"rnbqkbnr/ppp1pppp/8/3p4/4P3/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 2",0x0756B94461C50FB0ULL},
+    {"rnbqkbnr/ppp1pppp/8/3pP3/8/8/PPPP1PPP/RNBQKBNR b KQkq - 0 2",0x662FAFB965DB29D4ULL},
+    {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",0x22A48B5A8E47FF78ULL},
+    {"rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR b kq - 0 3",0x652A607CA3F242C1ULL},
+    {"rnbq1bnr/ppp1pkpp/8/3pPp2/8/8/PPPPKPPP/RNBQ1BNR w - - 0 4",0x00FDD303C946BDD9ULL},
+    {"rnbqkbnr/p1pppppp/8/8/PpP4P/8/1P1PPPP1/RNBQKBNR b KQkq c3 0 3",0x3C8123EA7B067637ULL},
+    {"rnbqkbnr/p1pppppp/8/8/P6P/R1p5/1P1PPPP1/1NBQKBNR b Kkq - 0 4",0x5C3F9B829B279560ULL},
+};
 
-        // Check if source and destination squares are within the board
-        if (sourceRow < 0 || sourceRow >= SIZE || sourceCol < 0 || sourceCol >= SIZE ||
-            destRow < 0 || destRow >= SIZE || destCol < 0 || destCol >= SIZE)
-        {
-            std::cout << "Invalid move. Source or destination square is out of bounds." << std::endl;
-            return false;
-        }
+/**
+ * @brief Checks the position keys against the published Polyglot keys, so that books stay interchangeable
+ *        with other Polyglot tools
+ *
+ * @return Exit code of the program, 1 if any key differs
+ */
+int checkKeys(){
+    int failures=0;
+    for (const auto& expected:POLYGLOT_KEYS){
+        Chessboard board;
+        uint64_t key=board.loadFEN(expected.fen)?board.getKey():0;
+        bool pass=key==expected.key;
+        failures+=!pass;
+        std::cout<<(pass?"PASS ":"FAIL ")<<std::hex<<std::setw(16)<<std::setfill('0')<<key<<std::dec<<std::setfill(' ')<<" "<<expected.fen<<std::endl;
+    }
+    std::cout<<(failures?"Keys differ from Polyglot":"All keys match Polyglot")<<std::endl;
+    return failures?1:0;
+}
 
-        // Check if there is a piece at the source square
-        if (board[sourceRow][sourceCol].getType() == Type::None)
-        {
-            std::cout << "Invalid move. There is no piece at the source square." << std::endl;
-            return false;
-        }
+/**
+ * @brief Checks that a UCI "stop" sent right after "go infinite" ends the search, by sending both back to back
+ *        over and over and counting the moves sent back. A lost stop leaves the search running forever
+ *
+ * @param rounds Number of searches to start and stop
+ * @return Exit code of the program, 1 if a search didn't answer with a move within ten seconds
+ */
+int checkUciStop(int rounds){
+    std::string commands;
+    for (int i=0;i<rounds;++i) commands+="position startpos\ngo infinite\nstop\n";
+    std::istringstream input(commands);
+    std::ostringstream output;
+    std::streambuf* console=std::cout.rdbuf(output.rdbuf());
+
+    // The session runs on its own thread so that a hang can be reported instead of waiting on it
+    std::packaged_task<void()> task([&input](){
+        Engine engine;
+        UciSession session(engine);
+        session.run(input);
+    });
+    std::future<void> done=task.get_future();
+    std::thread(std::move(task)).detach();
+    bool finished=done.wait_for(std::chrono::seconds(10))==std::future_status::ready;
+    std::cout.rdbuf(console);
+    if (!finished){
+        std::cout<<"FAIL the session hung, a stop was lost"<<std::endl;
+        std::_Exit(1);
+    }
 
-        // Check if the piece at the source square is the correct colour based on turn
-        if ((black && (board[sourceRow][sourceCol].getColor()== Color::White)) || (!black && (board[sourceRow][sourceCol].getColor()== Color::Black))){
-            std::cout << "Invalid move. This piece is not yours." << std::endl;
-            return false;
-        }
-        
-        if (isValidMove(sourceRow,sourceCol,destRow,destCol)){
+    int moves=0;
+    for (size_t pos=output.str().find("bestmove");pos!=std::string::npos;pos=output.str().find("bestmove",pos+1)) moves++;
+    std::cout<<(moves==rounds?"PASS ":"FAIL ")<<moves<<" of "<<rounds<<" searches answered with a move"<<std::endl;
+    return moves==rounds?0:1;
+}
 
-            // If the move is valid, update the board
-            Piece temp = board[destRow][destCol];
-            board[destRow][destCol]=board[sourceRow][sourceCol];
-            board[sourceRow][sourceCol] = Piece();
+// Positions searched by the bench command. Changing them changes the node count signature
+static const char* const BENCH_POSITIONS[]={
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP1QBPPP/R3KB1R w KQ - 0 8",
+    "2r3k1/pp3ppp/2n1b3/3p4/3P4/2PB1N2/P4PPP/R5K1 b - - 0 20",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1",
+    "8/8/4k3/8/2p5/8/1P2K3/8 w - - 0 1",
+    "4k3/8/8/8/8/8/4P3/4K3 w - - 0 1",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p2Q/2B1P3/8/PPPP1PPP/RNB1K1NR w KQkq - 4 4"
+};
 
-            // If the king moved, update king position
-            if (board[destRow][destCol].getType()==Type::King){
-                updateKingPosn(destRow,destCol);  
-            }
+/**
+ * @brief Searches the bench positions to a fixed depth and prints the total node count and speed. With one thread
+ *        the node count only changes when the search does, so it tells speed changes from behavior changes
+ * 
+ * @param depth Depth of every search
+ * @param threads Threads searching each position
+ * @param hashMegabytes Size of the hash table, cleared before every position
+ * @return Exit code of the program
+ */
+int runBench(int depth,int threads,int hashMegabytes){
+    Engine engine;
+    engine.setThreads(threads);
+    engine.setHashSize(hashMegabytes);
+
+    long long totalNodes=0;
+    double totalSeconds=0;
+    int count=sizeof(BENCH_POSITIONS)/sizeof(BENCH_POSITIONS[0]);
+    for (int i=0;i<count;++i){
+        Chessboard board;
+        if (!board.loadFEN(BENCH_POSITIONS[i])){
+            std::cout<<"Invalid bench position: "<<BENCH_POSITIONS[i]<<std::endl;
+            return 1;
+        }
+        engine.clearHash();
+        auto start=std::chrono::steady_clock::now();
+        Move move=engine.predictBestMove(board,depth);
+        totalSeconds+=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        totalNodes+=engine.getNodes();
+        std::cout<<"Position "<<i+1<<"/"<<count<<": "<<(move.isNull()?"none":move.toString())<<" Nodes: "<<engine.getNodes()<<std::endl;
+        SEARCH_STAT(std::cout<<"Stats: "<<engine.getSearchStats().toJson()<<std::endl);
+    }
+    std::cout<<"Nodes: "<<totalNodes<<" Nodes/sec: "<<(long long)(totalSeconds>0?totalNodes/totalSeconds:0)<<" Seconds: "<<totalSeconds<<std::endl;
+    return 0;
+}
 
-            // If the king is in check after the move, it is invalid and we should revert back
-            if (isKingInCheck(black)){
-                board[sourceRow][sourceCol] = board[destRow][destCol];
-                board[destRow][destCol]= temp;
-                if (board[sourceRow][sourceCol].getType()==Type::King){
-                    updateKingPosn(sourceRow,sourceCol);  
-                }
-                std::cout << "That move puts your king in check" << std::endl;
+/**
+ * @brief Reads a whole command line argument as a number. Unlike std::stoi and its relatives it doesn't throw, so a
+ *        typo is reported with the usage instead of ending the program
+ *
+ * @param text The argument
+ * @param value Receives the number, left alone if the argument isn't one
+ * @return false if the argument isn't a number of the value's type, e.g. "x", "12x" or a number too large
+ */
+template<typename T>
+bool parseArgument(const char* text,T& value){
+    std::istringstream input(text);
+    T parsed;
+    if (!(input>>parsed) || !(input>>std::ws).eof()) return false;
+    value=parsed;
+    return true;
+}
 
-                return false;
-            }
+static const char* const MATCH_USAGE="Usage: chess match <engine> <engine> [--games N] [--concurrency N] [--depth D] [--nodes N] [--movetime ms] "
+                                      "[--tc base+inc] [--openings <epd>] [--pgn <out>] [--tb <dir>] [--hash MB] [--threads N] "
+                                      "[--sprt elo0 elo1 [alpha beta]]";
 
-            // If pawn reaches either end of ranks, it can promote to another piece
-            if (board[destRow][destCol].getType()==Type::Pawn && (destRow==0||destRow==7)){
-                std::cout<<"What would you like to promote to ? (Q,R,N,B)"<<std::endl;
-                Color pawnColor = board[destRow][destCol].getColor();
-                bool done = false;
-                while (!done){
-                    char input;
-                    std::cin>>input;
-
-                    // The user selects the piece they want to promote to;
-                    switch(input){
-                        case 'Q':
-                            board[destRow][destCol]=Piece(Type::Queen,pawnColor);
-                            done=true;
-                            break;
-                        case 'R':
-                            board[destRow][destCol]=Piece(Type::Rook,pawnColor);
-                            done=true;
-                            break;
-                        case 'N':
-                            board[destRow][destCol]=Piece(Type::Knight,pawnColor);
-                            done=true;
-                            break;
-                        case 'B':
-                            board[destRow][destCol]=Piece(Type::Bishop,pawnColor);
-                            done=true;
-                            break;
-                        default:
-                            std::cout<<"Invalid Promotion"<<std::endl;
-                    }
-                }
+/**
+ * @brief Plays a match between two engines from the command line options and prints the result
+ * 
+ * @param argc Number of arguments, the first three being the program, "match" and the engines
+ * @param argv The arguments
+ * @return Exit code of the program
+ */
+int playMatch(int argc,char* argv[]){
+    MatchConfig config;
+    config.engines[0]=argv[2];
+    config.engines[1]=argv[3];
+    config.limits.depth=4;
+    for (int i=4;i<argc;++i){
+        std::string option=argv[i];
+        bool hasValue=i+1<argc;
+        bool valid=true;
+        if (option=="--games" && hasValue) valid=parseArgument(argv[++i],config.games);
+        else if (option=="--concurrency" && hasValue) valid=parseArgument(argv[++i],config.concurrency);
+        else if (option=="--depth" && hasValue) valid=parseArgument(argv[++i],config.limits.depth);
+        else if (option=="--nodes" && hasValue){
+            config.limits.depth=0;
+            valid=parseArgument(argv[++i],config.limits.nodes);
+        }
+        else if (option=="--movetime" && hasValue){
+            config.limits.depth=0;
+            valid=parseArgument(argv[++i],config.limits.moveTime);
+        }
+        else if (option=="--tc" && hasValue){
+            // Base time and increment in seconds, as in 10+0.1
+            std::string tc=argv[++i];
+            size_t plus=tc.find('+');
+            double base=0;
+            double increment=0;
+            valid=parseArgument(tc.substr(0,plus).c_str(),base) && (plus==std::string::npos || parseArgument(tc.substr(plus+1).c_str(),increment));
+            config.limits.depth=0;
+            config.limits.time[0]=config.limits.time[1]=static_cast<long long>(base*1000);
+            config.limits.increment[0]=config.limits.increment[1]=static_cast<long long>(increment*1000);
+        }
+        else if (option=="--openings" && hasValue) config.openingsPath=argv[++i];
+        else if (option=="--pgn" && hasValue) config.pgnPath=argv[++i];
+        else if (option=="--tb" && hasValue) config.tablebasePath=argv[++i];
+        else if (option=="--hash" && hasValue) valid=parseArgument(argv[++i],config.hash);
+        else if (option=="--threads" && hasValue) valid=parseArgument(argv[++i],config.threads);
+        else if (option=="--sprt" && i+2<argc){
+            config.sprt=true;
+            valid=parseArgument(argv[i+1],config.elo0) && parseArgument(argv[i+2],config.elo1);
+            i+=2;
+            if (valid && i+2<argc && argv[i+1][0]!='-'){
+                valid=parseArgument(argv[i+1],config.alpha) && parseArgument(argv[i+2],config.beta);
+                i+=2;
             }
+        }
+        else{
+            std::cout<<"Unknown match option: "<<option<<std::endl<<MATCH_USAGE<<std::endl;
+            return 1;
+        }
+        if (!valid){
+            std::cout<<"Invalid value for "<<option<<std::endl<<MATCH_USAGE<<std::endl;
+            return 1;
+        }
+    }
 
-            // We just moved a piece to destRow, destCol so we set is as moved
-            board[destRow][destCol].setMoved();
+    Tournament tournament(config);
+    MatchScore score;
+    auto start=std::chrono::steady_clock::now();
+    if (!tournament.run(score)){
+        std::cout<<"Could not open the openings or the PGN file"<<std::endl;
+        return 1;
+    }
+    double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    std::cout<<"Games: "<<score.games()<<" Wins: "<<score.wins<<" Losses: "<<score.losses<<" Draws: "<<score.draws<<" Elo: "<<score.elo()
+             <<" +/- "<<score.eloError()<<" Seconds: "<<seconds<<std::endl;
+    return 0;
+}
 
-            // Store the move into prevMove
-            prevMove=move;
+static const char* const SELFPLAY_USAGE="Usage: chess selfplay <out> [--games N] [--threads N] [--depth D] [--nodes N] [--random-plies N] "
+                                         "[--openings <epd>] [--seed S] [--hash MB]";
 
-            // The move is valid and didn't run into any obstructions
-            return true;
+/**
+ * @brief Generates training data by self-play from the command line options, printing the progress
+ * 
+ * @param argc Number of arguments, the first three being the program, "selfplay" and the output file
+ * @param argv The arguments
+ * @return Exit code of the program
+ */
+int runSelfPlay(int argc,char* argv[]){
+    SelfPlayConfig config;
+    config.threads=std::max(1u,std::thread::hardware_concurrency());
+    for (int i=3;i<argc;++i){
+        std::string option=argv[i];
+        bool hasValue=i+1<argc;
+        bool valid=true;
+        if (option=="--games" && hasValue) valid=parseArgument(argv[++i],config.games);
+        else if (option=="--threads" && hasValue) valid=parseArgument(argv[++i],config.threads);
+        else if (option=="--depth" && hasValue) valid=parseArgument(argv[++i],config.limits.depth);
+        else if (option=="--nodes" && hasValue){
+            config.limits.depth=0;
+            valid=parseArgument(argv[++i],config.limits.nodes);
         }
+        else if (option=="--random-plies" && hasValue) valid=parseArgument(argv[++i],config.randomPlies);
+        else if (option=="--openings" && hasValue) config.openingsPath=argv[++i];
+        else if (option=="--seed" && hasValue) valid=parseArgument(argv[++i],config.seed);
+        else if (option=="--hash" && hasValue) valid=parseArgument(argv[++i],config.hash);
         else{
-            std::cout << "That move is invalid" << std::endl;
+            std::cout<<"Unknown selfplay option: "<<option<<std::endl<<SELFPLAY_USAGE<<std::endl;
+            return 1;
+        }
+        if (!valid){
+            std::cout<<"Invalid value for "<<option<<std::endl<<SELFPLAY_USAGE<<std::endl;
+            return 1;
         }
-        return false;
     }
 
-    /**
-     * @brief Updates the private variables that store the king's position (note: does not move the king)
-     * 
-     * @param row New row position of the king
-     * @param col New column position of the king
-     */
-    void updateKingPosn(int row,int col){
+    SelfPlayGenerator generator(config);
+    bool written=generator.run(argv[2],[](const SelfPlayProgress& progress){
+        std::cout<<"Games: "<<progress.games<<" Positions: "<<progress.positions<<" Positions/hour: "
+                 <<(progress.seconds>0?progress.positions*3600/progress.seconds:0)<<std::endl;
+    });
+    if (!written){
+        std::cout<<"Could not read the openings or write "<<argv[2]<<std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+static const char* const TUNE_USAGE="Usage: chess tune <data> <out.h> [--threads N] [--epochs N] [--lr X] [--lambda X] [--regularization X]";
 
-        // The king has to be in the position to be updated to retrieve the color
-        // i.e. updateKingPosn after updating the board
-        if (board[row][col].getColor()==Color::Black){
-            blackKingRow=row;
-            blackKingCol=col;
-        }
+/**
+ * @brief Tunes the evaluation on training data from the command line options and writes the weights
+ * 
+ * @param argc Number of arguments, the first four being the program, "tune", the training data and the header to write
+ * @param argv The arguments
+ * @return Exit code of the program
+ */
+int runTuner(int argc,char* argv[]){
+    TunerConfig config;
+    config.threads=std::max(1u,std::thread::hardware_concurrency());
+    for (int i=4;i<argc;++i){
+        std::string option=argv[i];
+        bool hasValue=i+1<argc;
+        bool valid=true;
+        if (option=="--threads" && hasValue) valid=parseArgument(argv[++i],config.threads);
+        else if (option=="--epochs" && hasValue) valid=parseArgument(argv[++i],config.maxEpochs);
+        else if (option=="--lr" && hasValue) valid=parseArgument(argv[++i],config.learningRate);
+        else if (option=="--lambda" && hasValue) valid=parseArgument(argv[++i],config.lambda);
+        else if (option=="--regularization" && hasValue) valid=parseArgument(argv[++i],config.regularization);
         else{
-            whiteKingRow=row;
-            whiteKingCol=col;
-        }
-    }
-
-    /**
-     * @brief Determines whether a piece can reach from source to destination in one move
-     * 
-     * @param sourceRow Row of the source
-     * @param sourceCol Column of the source
-     * @param destRow Row of the destination
-     * @param destCol Column of the destination
-     * @return true if the piece can reach the destination in one move
-     * @return false if the piece cannot reach the destination in one move
-     */
-    bool isValidMove(int sourceRow,int sourceCol,int destRow,int destCol){
-
-        // Can't move to the same square as source
-        if (sourceRow==destRow && sourceCol==destCol) return false;
-
-        // Handling move checking based on piece type
-        switch(board[sourceRow][sourceCol].getType()){
-            case Type::Pawn:
-                return (isValidPawnMove(sourceRow,sourceCol,destRow,destCol));
-            case Type::Knight:
-                return (isValidKnightMove(sourceRow,sourceCol,destRow,destCol));
-            case Type::Bishop:
-                return (isValidBishopMove(sourceRow,sourceCol,destRow,destCol));
-            case Type::Rook:
-                return (isValidRookMove(sourceRow,sourceCol,destRow,destCol));
-            case Type::Queen:
-                return (isValidQueenMove(sourceRow,sourceCol,destRow,destCol));
-            case Type::King:
-                return (isValidKingMove(sourceRow,sourceCol,destRow,destCol));
-            default:
-                break;
+            std::cout<<"Unknown tune option: "<<option<<std::endl<<TUNE_USAGE<<std::endl;
+            return 1;
         }
-        return false;
-    }
-
-    /**
-     * @brief Checks whether the king is in check
-     * 
-     * @param black Indicates whether to look at Black or White's king
-     * @return true if the king is in check
-     * @return false if the king is safe
-     */
-    bool isKingInCheck(bool black){
-
-        // Iterate through all pieces and see if they can attack the king
-        // Same color pieces will be returned false by isValidMove
-        if (black){
-            for (int i=0;i<SIZE;++i){
-                for (int j=0;j<SIZE;++j){
-                    if (board[i][j].getColor()!=Color::White) continue;
-                    if (isValidMove(i,j,blackKingRow,blackKingCol)){
-                        return true;
-                    }
-                }
-            }
+        if (!valid){
+            std::cout<<"Invalid value for "<<option<<std::endl<<TUNE_USAGE<<std::endl;
+            return 1;
+        }
+    }
+
+    EvalTuner tuner(config);
+    auto start=std::chrono::steady_clock::now();
+    if (!tuner.load(argv[2])){
+        std::cout<<"Could not read training data from "<<argv[2]<<std::endl;
+        return 1;
+    }
+    double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+    std::cout<<"Positions: "<<tuner.size()<<" Load seconds: "<<seconds<<std::endl;
+    if (tuner.size()==0) return 1;
+    std::cout<<"Scale: "<<tuner.fitScale()<<std::endl;
+    double loss=tuner.tune([](const TunerProgress& progress){
+        if (progress.epoch%10==1) std::cout<<"Epoch: "<<progress.epoch<<" Loss: "<<progress.loss<<" Seconds: "<<progress.epochSeconds<<std::endl;
+    });
+    std::cout<<"Final loss: "<<loss<<std::endl;
+    if (!writeEvalParams(tuner.result(),argv[3])){
+        std::cout<<"Could not write "<<argv[3]<<std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+static const char* const MATE_USAGE="Usage: chess mate \"<fen>\" <moves> [--threads N] [--nodes N] [--hash MB]";
+
+/**
+ * @brief Looks for a forced mate by the side to move from the command line options and prints the line
+ * 
+ * @param argc Number of arguments, the first four being the program, "mate", the FEN and the most moves to mate in
+ * @param argv The arguments
+ * @return Exit code of the program
+ */
+int findMate(int argc,char* argv[]){
+    Chessboard board;
+    if (!board.loadFEN(argv[2])){
+        std::cout<<"Invalid FEN: "<<argv[2]<<std::endl;
+        return 1;
+    }
+    int moves;
+    if (!parseArgument(argv[3],moves)){
+        std::cout<<"Invalid number of moves: "<<argv[3]<<std::endl<<MATE_USAGE<<std::endl;
+        return 1;
+    }
+    MateSolver solver;
+    solver.setThreads(std::max(1u,std::thread::hardware_concurrency()));
+    long long nodes=0;
+    for (int i=4;i<argc;++i){
+        std::string option=argv[i];
+        bool hasValue=i+1<argc;
+        bool valid=true;
+        if (option=="--threads" && hasValue){
+            int threads;
+            valid=parseArgument(argv[++i],threads);
+            if (valid) solver.setThreads(threads);
+        }
+        else if (option=="--nodes" && hasValue) valid=parseArgument(argv[++i],nodes);
+        else if (option=="--hash" && hasValue){
+            size_t megabytes;
+            valid=parseArgument(argv[++i],megabytes);
+            if (valid) solver.setHashSize(megabytes);
         }
         else{
-            for (int i=0;i<SIZE;++i){
-                for (int j=0;j<SIZE;++j){
-                    if (board[i][j].getColor()!=Color::Black) continue;
-                    if (isValidMove(i,j,whiteKingRow,whiteKingCol)){
-                        return true;
-                    }
-                }
-            }
+            std::cout<<"Unknown mate option: "<<option<<std::endl<<MATE_USAGE<<std::endl;
+            return 1;
         }
-        return false;
-    }
-
-    /**
-     * @brief Checks whether the king is in checkmate
-     * 
-     * @param black Indicates whether to look at Black or White's king
-     * @return true if the king is in checkmate
-     * @return false if the king can be saved using a move
-     */
-    bool isKingInCheckmate(bool black){
-
-        // Iterate through all the squares to find source
-        for (int i=0;i<SIZE;++i){
-            for (int j=0;j<SIZE;++j){
-
-                // Ignore pieces that we can't move in the current turn
-                if (black && board[i][j].getColor()!=Color::Black) continue;
-                if (!black && board[i][j].getColor()!=Color::White) continue;
-
-                // Iterate through all the squares to find a destination
-                for (int k=0;k<SIZE;++k){
-                    for (int l=0;l<SIZE;++l){
-                        
-                        // Check if the piece can move to the destination
-                        if (isValidMove(i,j,k,l)){
-                            
-                            // Update the board
-                            Piece temp = board[k][l];
-                            board[k][l] = board[i][j];
-                            board[i][j] = Piece();
-                            // If the king is moved, update king position
-                            if (board[k][l].getType()==Type::King) updateKingPosn(k,l);
-
-                            // Check if the move makes the king safe
-                            if (!isKingInCheck(black)){
-                                // Revert position as we do not want the player to know the safe move
-                                board[i][j] = board[k][l]; 
-                                board[k][l] = temp;
-                                if (board[i][j].getType()==Type::King) updateKingPosn(i,j);
-                                return false;
-                            }
-
-                            // If king is not safe, revert and try next iteration.
-                            board[i][j] = board[k][l]; 
-                            board[k][l] = temp;
-                            if (board[i][j].getType()==Type::King) updateKingPosn(i,j);
-                        }
-                    }
-                }
-            }
+        if (!valid){
+            std::cout<<"Invalid value for "<<option<<std::endl<<MATE_USAGE<<std::endl;
+            return 1;
         }
-        // None of the moves put the king out of check
-        return true;
     }
 
-    /**
-     * @brief Checks whether the move is valid for a pawn piece (Includes double move, En passant)
-     * 
-     * @param sourceRow Row of the source
-     * @param sourceCol Column of the source
-     * @param destRow Row of the destination
-     * @param destCol Column of the destination
-     * @return true if the pawn move is valid
-     * @return false if the pawn move is invalid
-     */
-    bool isValidPawnMove(int sourceRow,int sourceCol,int destRow,int destCol){
-
-        Piece sourcePiece = board[sourceRow][sourceCol];
-        Piece destPiece = board[destRow][destCol];
-        Color playerColor = sourcePiece.getColor();
+    MateSearchResult result=solver.solve(board,moves,nodes);
+    if (result.status==MateStatus::Mate){
+        std::cout<<"Mate in "<<result.moves<<":";
+        for (Move move:result.line){
+            std::cout<<" "<<board.toSAN(move);
+            board.makeLegalMove(move);
+        }
+        std::cout<<std::endl;
+    }
+    else if (result.status==MateStatus::NoMate) std::cout<<"No mate in "<<argv[3]<<std::endl;
+    else std::cout<<"Unknown, node limit reached"<<std::endl;
+    std::cout<<"Nodes: "<<result.nodes<<" Milliseconds: "<<result.milliseconds<<std::endl;
+    return 0;
+}
 
-        // Can't attack own piece
-        if (destPiece.getColor()==playerColor) return false;
+int main(int argc,char* argv[])
+{
+    // Load every position of an EPD file and exit
+    if (argc==3 && std::string(argv[1])=="epd"){
+        return loadEpdFile(argv[2]);
+    }
 
-        int direction = (playerColor == Color::White) ? -1:1;
+    // Replay every game of a PGN file and exit
+    if ((argc==3 || argc==4) && std::string(argv[1])=="pgn"){
+        int threads=std::max(1u,std::thread::hardware_concurrency());
+        if (argc==4 && !parseArgument(argv[3],threads)){
+            std::cout<<"Invalid thread count: "<<argv[3]<<std::endl<<"Usage: chess pgn <file> [threads]"<<std::endl;
+            return 1;
+        }
+        return replayPgn(argv[2],threads);
+    }
 
-        // Same column movement (Cannot capture)
-        if (sourceCol==destCol && destPiece.getType()==Type::None){
-            
-            // Single forward movement
-            if (destRow==sourceRow+direction) return true;
+    // Compare the batched kernels with the single position path on an EPD file and exit
+    if (argc==3 && std::string(argv[1])=="batch"){
+        return batchEpdFile(argv[2]);
+    }
 
-            // Double movement allowed if it is the pawn's first move
-            if (destRow == sourceRow + 2 * direction && !sourcePiece.hasPieceMoved()) return true;
+    // Pack the positions of an EPD file and exit
+    if (argc==4 && std::string(argv[1])=="pack"){
+        return packEpdFile(argv[2],argv[3]);
+    }
 
-            return false;
+    // Convert a PGN file into a game record file and exit
+    if (argc==4 && std::string(argv[1])=="pgn2bin"){
+        long long skipped=0;
+        long long written=convertPgnToRecords(argv[2],argv[3],skipped);
+        if (written<0){
+            std::cout<<"Could not convert "<<argv[2]<<" to "<<argv[3]<<std::endl;
+            return 1;
         }
+        std::cout<<"Games written: "<<written<<" Skipped: "<<skipped<<std::endl;
+        return 0;
+    }
 
-        // Diagonal capture movement
-        if ((destCol==sourceCol+1 || destCol==sourceCol-1) && destRow==sourceRow+direction){
+    // Replay every game of a game record file and exit
+    if (argc==3 && std::string(argv[1])=="bin"){
+        return scanRecords(argv[2]);
+    }
 
-            // If enemy piece in diagonal square, then we can capture
-            if ((destPiece.getType()!=Type::None)) return true;
+    // Build an opening book from a PGN or game record file and exit
+    if ((argc==4 || argc==5) && std::string(argv[1])=="book"){
+        int plies=20;
+        if (argc==5 && !parseArgument(argv[4],plies)){
+            std::cout<<"Invalid number of plies: "<<argv[4]<<std::endl<<"Usage: chess book <pgn|bin> <out> [plies]"<<std::endl;
+            return 1;
+        }
+        BookBuildStats stats;
+        if (!buildBook(argv[2],argv[3],plies,1,stats)){
+            std::cout<<"Could not build "<<argv[3]<<" from "<<argv[2]<<std::endl;
+            return 1;
+        }
+        std::cout<<"Games: "<<stats.games<<" Skipped: "<<stats.skipped<<" Positions: "<<stats.positions<<" Entries: "<<stats.entries<<std::endl;
+        return 0;
+    }
 
-            // Special case: En passant
-            if (board[sourceRow][destCol].getType()==Type::Pawn && board[sourceRow][destCol].getColor()!=playerColor){
-                if(prevMove[1]==prevMove[3]-2*direction && prevMove[0]==prevMove[2] && prevMove[0]-'a'==destCol){
-                    board[sourceRow][destCol]=Piece();
-                    return true;
-                }
-            }
+    // Build a position index from a game record file and exit
+    if (argc>=4 && argc<=6 && std::string(argv[1])=="index"){
+        int threads=std::max(1u,std::thread::hardware_concurrency());
+        size_t megabytes=1024;
+        if ((argc>=5 && !parseArgument(argv[4],threads)) || (argc==6 && !parseArgument(argv[5],megabytes))){
+            std::cout<<"Invalid thread count or memory size"<<std::endl<<"Usage: chess index <bin> <out> [threads] [memoryMB]"<<std::endl;
+            return 1;
         }
-        return false;
-    }
-
-    /**
-     * @brief Checks whether the move is valid for a knight piece
-     * 
-     * @param sourceRow Row of the source
-     * @param sourceCol Column of the source
-     * @param destRow Row of the destination
-     * @param destCol Column of the destination
-     * @return true if the knight move is valid
-     * @return false if the knight move is invalid
-     */
-    bool isValidKnightMove(int sourceRow,int sourceCol,int destRow,int destCol){
-
-        Piece sourcePiece = board[sourceRow][sourceCol];
-        Piece destPiece = board[destRow][destCol];
-        Color playerColor = sourcePiece.getColor();
-
-        // Can't attack it's own piece
-        if (destPiece.getColor()==playerColor) return false;
-
-        // L shaped move
-        if ((abs(destRow-sourceRow)==2 && abs(destCol-sourceCol)==1) || (abs(destRow-sourceRow)==1 && abs(destCol-sourceCol)==2)){
-            return true;
-        }
-
-        return false;
-    }
-
-    /**
-     * @brief Checks whether the move is valid for a Bishop piece
-     * 
-     * @param sourceRow Row of the source
-     * @param sourceCol Column of the source
-     * @param destRow Row of the destination
-     * @param destCol Column of the destination
-     * @return true if the bishop move is valid
-     * @return false if the bishop move is invalid
-     */
-    bool isValidBishopMove(int sourceRow,int sourceCol,int destRow,int destCol){
-
-        Piece sourcePiece = board[sourceRow][sourceCol];
-        Piece destPiece = board[destRow][destCol];
-        Color playerColor = sourcePiece.getColor();
-
-        int rowDiff= destRow-sourceRow;
-        int colDiff = destCol-sourceCol;
-
-        // Can't attack own piece
-        if (destPiece.getColor()==playerColor) return false;
-
-        // Destination is not in the same diagonal as source
-        if (abs(rowDiff)!=abs(colDiff)) return false;
-
-        int stepRow = (rowDiff > 0) ? 1 : -1; // Determine step direction for row
-        int stepCol = (colDiff > 0) ? 1 : -1; // Determine step direction for column
-        int checkRow = sourceRow + stepRow; 
-        int checkCol = sourceCol + stepCol;
-
-        //Check for any obstructions in the diagonal
-        while (checkRow != destRow && checkCol != destCol) {
-            if (board[checkRow][checkCol].getType() != Type::None) // Move is blocked by a piece
-                return false; 
-            checkRow += stepRow;
-            checkCol += stepCol;
-        }
-        return true;
-    }
-
-    /**
-     * @brief Checks whether the move is valid for a rook piece
-     * 
-     * @param sourceRow Row of the source
-     * @param sourceCol Column of the source
-     * @param destRow Row of the destination
-     * @param destCol Column of the destination
-     * @return true if the rook move is valid
-     * @return false if the rook move is invalid 
-     */
-    bool isValidRookMove(int sourceRow,int sourceCol,int destRow,int destCol){
-
-        Piece sourcePiece = board[sourceRow][sourceCol];
-        Piece destPiece = board[destRow][destCol];
-        Color playerColor = sourcePiece.getColor();
-
-        // Can't attack own piece
-        if (destPiece.getColor()==playerColor) return false;
-
-        // Vertical movement, same column
-        if (destCol==sourceCol){
-            int direction = destRow>sourceRow ? 1:-1; // Determine direction of movement
-            int checkRow = sourceRow+direction;
-
-            // Check for obstructions
-            while (checkRow!=destRow){
-                if (board[checkRow][sourceCol].getType()!=Type::None) return false; // Move is blocked by a piece
-                checkRow += direction;
-            }
-            return true;
+        size_t memory=megabytes<<20;
+        PositionIndexStats stats;
+        auto start=std::chrono::steady_clock::now();
+        if (!buildPositionIndex(argv[2],argv[3],threads,memory,stats)){
+            std::cout<<"Could not build "<<argv[3]<<" from "<<argv[2]<<std::endl;
+            return 1;
         }
+        double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+        std::cout<<"Games: "<<stats.games<<" Skipped: "<<stats.skipped<<" Positions: "<<stats.entries<<" Runs: "<<stats.runs<<" Seconds: "<<seconds<<std::endl;
+        return 0;
+    }
+
+    // Look up the games that reached a position and exit
+    if (argc==4 && std::string(argv[1])=="query"){
+        return queryIndex(argv[2],argv[3]);
+    }
 
-        // Horizontal movement, same row
-        if (destRow==sourceRow){
-            int direction = destCol>sourceCol ? 1:-1; // Determine direction of movement
-            int checkCol = sourceCol+direction;
+    // Check the position keys against Polyglot's and exit
+    if (argc==2 && std::string(argv[1])=="keys"){
+        return checkKeys();
+    }
 
-            // Check for obstructions
-            while (checkCol!=destCol){
-                if (board[sourceRow][checkCol].getType()!=Type::None) return false; // Move is blocked by a piece
-                checkCol += direction;
-            }
-            return true;
-        }
-
-        // Movement is neither horizontal/vertical
-        return false;
-    }
-
-    /**
-     * @brief Checks whether the move is valid for a Queen piece (Combination of rook,bishop)
-     * 
-     * @param sourceRow Row of the source
-     * @param sourceCol Column of the source
-     * @param destRow Row of the destination
-     * @param destCol Column of the destination
-     * @return true if the queen move is valid
-     * @return false if the queen move is invalid
-     */
-    bool isValidQueenMove(int sourceRow,int sourceCol,int destRow,int destCol){
-        // Check if the destination can be reached either by diagonal or straight move
-        return (isValidBishopMove(sourceRow,sourceCol,destRow,destCol) || isValidRookMove(sourceRow,sourceCol,destRow,destCol));
-    }
-
-    /**
-     * @brief Checks whether the move is valid for a King piece (Includes castling)
-     * 
-     * @param sourceRow Row of the source
-     * @param sourceCol Column of the source
-     * @param destRow Row of the destination
-     * @param destCol Column of the destination
-     * @return true if the king move is valid
-     * @return false if the king move is invalid or castling under checks
-     */
-    bool isValidKingMove(int sourceRow,int sourceCol,int destRow,int destCol){
-
-        Piece sourcePiece = board[sourceRow][sourceCol];
-        Piece destPiece = board[destRow][destCol];
-        Color playerColor = sourcePiece.getColor();
-
-        // Can't attack own piece
-        if (destPiece.getColor()==playerColor) return false;
-
-        int rowDiff= destRow-sourceRow;
-        int colDiff = destCol-sourceCol;
-
-        //Castling time
-        if (!sourcePiece.hasPieceMoved() && rowDiff==0){ //since piece hasnt moved,it should be in its own home row
-
-            // King side castling
-            if (destCol==2){
-
-                // Squares between castle is blocked
-                if (board[sourceRow][3].getType()!=Type::None || board[sourceRow][2].getType()!=Type::None || board[sourceRow][1].getType()!=Type::None) return false;
-                
-                // Can't castle while in check
-                if (isKingInCheck(playerColor==Color::Black)) return false;
-
-                // Can only castle if the king side rook is untouched
-                if (board[sourceRow][0].getType()==Type::Rook && !board[sourceRow][0].hasPieceMoved()){
-
-                    // Update one square towards castle
-                    Piece rook = board[sourceRow][0];
-                    board[sourceRow][3]= sourcePiece;
-                    board[sourceRow][4]= Piece();
-                    updateKingPosn(sourceRow,3);
-
-                    // Check if king is in check, if yes revert and castling is not possible
-                    if (isKingInCheck(playerColor==Color::Black)){
-                        board[sourceRow][4]=sourcePiece;
-                        board[sourceRow][3]=Piece();
-                        updateKingPosn(sourceRow,4);
-                        return false;
-                    }
-
-                    // Move to the castle square
-                    board[sourceRow][2]= sourcePiece;
-                    board[sourceRow][3]= Piece();
-                    updateKingPosn(sourceRow,2);
-
-                    // Check if king is in check, if yes revert and castling is not possible
-                    if (isKingInCheck(playerColor==Color::Black)){
-                        board[sourceRow][4]=sourcePiece;
-                        board[sourceRow][2]=Piece();
-                        updateKingPosn(sourceRow,4);
-                        return false;
-                    }
-
-                    // This reverting part im not sure if we need, revert since it will castled by the move function anyways if valid
-                    board[sourceRow][4]=sourcePiece;
-                    board[sourceRow][2]=Piece();
-                    updateKingPosn(sourceRow,4);
-
-                    // Move the rook
-                    rook.setMoved();
-                    board[sourceRow][3]= rook;
-                    board[sourceRow][0]= Piece();
-                    return true;
-                }
-            }
+    // Start and stop UCI searches back to back and exit
+    if ((argc==2 || argc==3) && std::string(argv[1])=="ucistop"){
+        return checkUciStop(argc==3?std::atoi(argv[2]):100);
+    }
 
-            //Queen side castling
-            else if (destCol==6){
-
-                // Squares between castle is blocked
-                if (board[sourceRow][5].getType()!=Type::None || board[sourceRow][6].getType()!=Type::None) return false;
-
-                // Can't castle while in check
-                if (isKingInCheck(playerColor==Color::Black)) return false;
-
-                // Can only castle if the queen side rook is untouched
-                if (board[sourceRow][7].getType()==Type::Rook && !board[sourceRow][7].hasPieceMoved()){
-
-                    // Update one square towards castle
-                    Piece rook = board[sourceRow][7];
-                    board[sourceRow][5]= sourcePiece;
-                    board[sourceRow][4]= Piece();
-                    updateKingPosn(sourceRow,5);
-
-                    // Check if king is in check, if yes revert and castling is not possible
-                    if (isKingInCheck(playerColor==Color::Black)){
-                        board[sourceRow][4]=sourcePiece;
-                        board[sourceRow][5]=Piece();
-                        updateKingPosn(sourceRow,4);
-                        return false;
-                    }
-
-                    // Move to castle square
-                    board[sourceRow][6]= sourcePiece;
-                    board[sourceRow][5]= Piece();
-                    updateKingPosn(sourceRow,6);
-
-                    // Check if king is in check, if yes revert and castling is not possible
-                    if (isKingInCheck(playerColor==Color::Black)){
-                        board[sourceRow][4]=sourcePiece;
-                        board[sourceRow][6]=Piece();
-                        updateKingPosn(sourceRow,4);
-                        return false;
-                    }
-
-                    // This reverting part im not sure if we need, revert since it will castled by the move function anyways if valid
-                    board[sourceRow][4]=sourcePiece;
-                    board[sourceRow][6]=Piece();
-                    updateKingPosn(sourceRow,4);
-
-                    // Move the rook
-                    rook.setMoved();
-                    board[sourceRow][5]= rook;
-                    board[sourceRow][7]= Piece();
-                    return true;
-                }
+    // Generate endgame tablebases and exit
+    if (argc>=4 && std::string(argv[1])=="tbgen"){
+        if (!tbPrepareDirectory(argv[2])){
+            std::cout<<"Could not create or write to "<<argv[2]<<std::endl;
+            return 1;
+        }
+        TablebaseGenerator generator(std::max(1u,std::thread::hardware_concurrency()));
+        for (int i=3;i<argc;++i){
+            if (!generator.generate(argv[i])){
+                std::cout<<"Invalid material: "<<argv[i]<<std::endl;
+                return 1;
             }
         }
+        if (!generator.save(argv[2])){
+            std::cout<<"Could not write the tables to "<<argv[2]<<std::endl;
+            return 1;
+        }
+        return 0;
+    }
 
-        // If the move is not within 1 sqaure of the king, it is invalid
-        if (abs(rowDiff)>1 || abs(colDiff)>1) return false;
+    // Search the bench positions and exit
+    if (argc>=2 && argc<=5 && std::string(argv[1])=="bench"){
+        int depth=5;
+        int threads=1;
+        int hashMegabytes=16;
+        if ((argc>=3 && !parseArgument(argv[2],depth)) || (argc>=4 && !parseArgument(argv[3],threads)) || (argc==5 && !parseArgument(argv[4],hashMegabytes))){
+            std::cout<<"Invalid depth, thread count or hash size"<<std::endl<<"Usage: chess bench [depth] [threads] [hashMB]"<<std::endl;
+            return 1;
+        }
+        return runBench(depth,threads,hashMegabytes);
+    }
 
-        return true;
+    // Generate training data by self-play and exit
+    if (argc>=3 && std::string(argv[1])=="selfplay"){
+        return runSelfPlay(argc,argv);
     }
-};
 
-/**
- * @brief Prints out the logs
- * 
- * @param moveLog Array containing the logs
- */
-void printLogs(std::vector<std::string>& moveLog){
-    std::cout<< "Move Log:" << std::endl;
-    for (int i=0;i<moveLog.size();++i){
-        std::cout<<moveLog[i]<<std::endl;
+    // Look for a forced mate and exit
+    if (argc>=4 && std::string(argv[1])=="mate"){
+        return findMate(argc,argv);
+    }
+
+    // Tune the evaluation on training data and exit
+    if (argc>=4 && std::string(argv[1])=="tune"){
+        return runTuner(argc,argv);
+    }
+
+    // Play a match between two engines and exit
+    if (argc>=4 && std::string(argv[1])=="match"){
+        return playMatch(argc,argv);
+    }
+
+    // Talk UCI to a GUI or tournament manager until it quits
+    if (argc==2 && std::string(argv[1])=="uci"){
+        Engine engine;
+        engine.loadBook("book.bin");
+        engine.loadTablebases("tb");
+        UciSession session(engine);
+        return session.run();
     }
-}
 
-int main()
-{
     // Create the main board
     Chessboard game;
 
+    // Start from a custom position if one was given
+    if (argc==3 && std::string(argv[1])=="fen"){
+        if (!game.loadFEN(argv[2])){
+            std::cout<<"Invalid FEN: "<<argv[2]<<std::endl;
+            return 1;
+        }
+    }
+
     // Print initial board
     game.printBoard();
 
     // Create an array to store moves
-    std::vector<std::string> moveLog;
+    std::vector<Move> moveLog;
+
+    // Keys of the positions played, for spotting repetitions
+    std::vector<uint64_t> positions(1,game.getKey());
+
+    // The computer player, using an opening book and endgame tablebases from the working directory if there are any
+    Engine engine;
+    engine.loadBook("book.bin");
+    engine.loadTablebases("tb");
 
     // Boolean to keep track of moves
-    bool black=false;
+    bool black=game.isBlackToMove();
 
     int prev=0;
     int temp=0;
@@ -849,25 +865,49 @@ int main()
             break;
         }
 
+        // If input is hint, print out the move the computer would play
+        if (input=="hint"){
+            Move hint=engine.predictBestMove(game,4);
+            std::cout<<(hint.isNull()?"No hint available":hint.toString())<<std::endl;
+            continue;
+        }
+
+        // If input is fen, print out the current position
+        if (input=="fen"){
+            std::cout<<game.getFEN()<<std::endl;
+            continue;
+        }
+
+        // Read the input as a move
+        Move move;
+        if (input.length()!=4 || !Move::fromString(input,move)){
+            std::cout << "Invalid move format. Please use chess notation (e.g., 'e2e4')." << std::endl;
+            continue;
+        }
+
         // If valid move, add to log, print new board and change turns
-        if (game.movePiece(input,black)){
-            moveLog.push_back(input);
+        if (game.movePiece(move,black)){
+            moveLog.push_back(move);
+            positions.push_back(game.getKey());
             black=!black;
             game.printBoard();
 
-            // Check if king is in check
-            if (game.isKingInCheck(black)){
-                // If king is in checkmate, print out log and exit
-                if(game.isKingInCheckmate(black)){
-                    std::cout<<"Checkmate! "<<(black?"White":"Black")<<" wins!"<<std::endl;
-                    std::cout<<"Do you wish to see the logs ? (y/n)"<<std::endl;
-                    char choice;
-                    std::cin >> choice;
-                    if (choice=='y') printLogs(moveLog);
-                    break;
-                }
-                std::cout << "Check" << std::endl;
+            // If the game is over, announce the result, print out log and exit
+            GameStatus status=game.gameStatus(positions);
+            if (status!=GameStatus::Ongoing){
+                if (status==GameStatus::Checkmate) std::cout<<"Checkmate! "<<(black?"White":"Black")<<" wins!"<<std::endl;
+                else std::cout<<"Draw by "<<gameStatusName(status)<<"!"<<std::endl;
+                std::cout<<"Do you wish to see the logs ? (y/n)"<<std::endl;
+                char choice;
+                std::cin >> choice;
+                if (choice=='y') printLogs(moveLog);
+                break;
             }
+            if (game.isKingInCheck(black)) std::cout << "Check" << std::endl;
+
+            // Announce the result as soon as the tablebases know it
+            std::string outcome;
+            if (engine.describeOutcome(game,outcome)) std::cout<<outcome<<std::endl;
         }
     }
 }
\ No newline at end of file
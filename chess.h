@@ -1,9 +1,18 @@
 #ifndef CHESS_H
 #define CHESS_H
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
+#include "attacks.h"
+#include "zobrist.h"
 
 // Enum to classify the type of pieces
 enum class Type
@@ -25,40 +34,234 @@ enum class Color
     White
 };
 
-// Class to identify each piece
+// Enum to classify how the game stands for the side to move
+enum class GameStatus
+{
+    Ongoing,
+    Checkmate,
+    Stalemate,
+    FiftyMoveRule,
+    ThreefoldRepetition,
+    InsufficientMaterial
+};
+
+// Returns a lower case description of a game status, e.g. "threefold repetition"
+inline const char* gameStatusName(GameStatus status)
+{
+    switch (status) {
+    case GameStatus::Checkmate:
+        return "checkmate";
+    case GameStatus::Stalemate:
+        return "stalemate";
+    case GameStatus::FiftyMoveRule:
+        return "fifty move rule";
+    case GameStatus::ThreefoldRepetition:
+        return "threefold repetition";
+    case GameStatus::InsufficientMaterial:
+        return "insufficient material";
+    default:
+        return "ongoing";
+    }
+}
+
+// Class to identify each piece, packed into one byte so the whole board fits in 64
 class Piece
 {
 private:
-    Type type;
-    Color color;
-    bool hasMoved;
+    // Type in the low three bits, color in the two above them
+    uint8_t code;
 
 public:
-    Piece(Type t = Type::None, Color c = Color::None) : type(t), color(c), hasMoved(false) {}
+    Piece(Type t = Type::None, Color c = Color::None) : code(static_cast<uint8_t>(static_cast<int>(t) | (static_cast<int>(c) << 3))) {}
 
     // Returns the type of piece
     Type getType() const
     {
-        return type;
+        return static_cast<Type>(code & 7);
     }
 
     // Returns the color of piece
     Color getColor() const
     {
-        return color;
+        return static_cast<Color>(code >> 3);
+    }
+};
+
+// Returns the piece named by a FEN letter (uppercase is white), or an empty piece if the letter is unknown
+inline Piece pieceFromLetter(char letter)
+{
+    Color color = (letter >= 'A' && letter <= 'Z') ? Color::White : Color::Black;
+    switch (letter | 0x20) {
+    case 'p':
+        return Piece(Type::Pawn, color);
+    case 'n':
+        return Piece(Type::Knight, color);
+    case 'b':
+        return Piece(Type::Bishop, color);
+    case 'r':
+        return Piece(Type::Rook, color);
+    case 'q':
+        return Piece(Type::Queen, color);
+    case 'k':
+        return Piece(Type::King, color);
+    default:
+        return Piece();
+    }
+}
+
+// Returns the FEN letter of a piece (uppercase is white), or '.' for an empty square
+inline char letterFromPiece(Piece piece)
+{
+    static const char letters[] = ".pnbrqk";
+    char letter = letters[static_cast<int>(piece.getType())];
+    if (piece.getColor() == Color::White && letter != '.') letter -= 0x20;
+    return letter;
+}
+
+// A move packed into 16 bits: source square (bits 0-5), destination square (bits 6-11) and promotion type (bits 12-14).
+// Squares are numbered row * 8 + col, with row 0 being black's home row like the board array
+class Move
+{
+private:
+    uint16_t data;
+
+public:
+    Move() : data(0) {}
+
+    Move(int sourceRow, int sourceCol, int destRow, int destCol, Type promotion = Type::None)
+        : data(static_cast<uint16_t>((sourceRow * 8 + sourceCol) | ((destRow * 8 + destCol) << 6) | (static_cast<int>(promotion) << 12))) {}
+
+    int getSourceRow() const
+    {
+        return (data >> 3) & 7;
+    }
+
+    int getSourceCol() const
+    {
+        return data & 7;
+    }
+
+    int getDestRow() const
+    {
+        return (data >> 9) & 7;
+    }
+
+    int getDestCol() const
+    {
+        return (data >> 6) & 7;
+    }
+
+    // Returns the piece a pawn promotes to, or Type::None
+    Type getPromotion() const
+    {
+        return static_cast<Type>((data >> 12) & 7);
+    }
+
+    // Returns whether this is the empty move (a1 to a1), used as "no move"
+    bool isNull() const
+    {
+        return data == 0;
+    }
+
+    // Returns the packed 16 bit value
+    uint16_t raw() const
+    {
+        return data;
+    }
+
+    static Move fromRaw(uint16_t raw)
+    {
+        Move move;
+        move.data = raw;
+        return move;
+    }
+
+    // Returns the move in coordinate notation, e.g. "e2e4" or "e7e8q"
+    std::string toString() const
+    {
+        std::string text;
+        text += static_cast<char>('a' + getSourceCol());
+        text += static_cast<char>('8' - getSourceRow());
+        text += static_cast<char>('a' + getDestCol());
+        text += static_cast<char>('8' - getDestRow());
+        if (getPromotion() != Type::None) text += letterFromPiece(Piece(getPromotion(), Color::Black));
+        return text;
+    }
+
+    /**
+     * @brief Reads a move in coordinate notation, the inverse of toString
+     *
+     * @param text Move such as "e2e4" or "e7e8q"
+     * @param move Receives the move
+     * @return false if the text is not a move in coordinate notation
+     */
+    static bool fromString(std::string_view text, Move& move)
+    {
+        if (text.size() != 4 && text.size() != 5) return false;
+        for (int i = 0; i < 4; i += 2) {
+            if (text[i] < 'a' || text[i] > 'h' || text[i + 1] < '1' || text[i + 1] > '8') return false;
+        }
+        Type promotion = Type::None;
+        if (text.size() == 5) {
+            promotion = pieceFromLetter(text[4]).getType();
+            if (promotion == Type::None || promotion == Type::Pawn || promotion == Type::King) return false;
+        }
+        move = Move('8' - text[1], text[0] - 'a', '8' - text[3], text[2] - 'a', promotion);
+        return true;
     }
 
-    // Returns whether the piece has been moved before
-    bool hasPieceMoved() {
-        return hasMoved;
+    bool operator==(const Move& other) const
+    {
+        return data == other.data;
     }
 
-    // Sets bool hasMoved to true
-    void setMoved() {
-        hasMoved = true;
+    bool operator!=(const Move& other) const
+    {
+        return data != other.data;
     }
 };
 
+// Outcome of reading a move written in standard algebraic notation
+enum class SanResult
+{
+    Ok,
+    Malformed,
+    Illegal,
+    Ambiguous
+};
+
+// One square of movement in rows and columns, rows counting down from black's home row like the board array
+struct Step
+{
+    int row;
+    int col;
+};
+
+// Knight jumps, and the eight neighbouring squares, which are also the lines a queen walks along
+static constexpr Step KNIGHT_STEPS[8] = { { 2, 1 }, { 2, -1 }, { -2, 1 }, { -2, -1 }, { 1, 2 }, { 1, -2 }, { -1, 2 }, { -1, -2 } };
+static constexpr Step KING_STEPS[8] = { { 1, 1 }, { 1, 0 }, { 1, -1 }, { 0, 1 }, { 0, -1 }, { -1, 1 }, { -1, 0 }, { -1, -1 } };
+
+// The lines of a bishop and of a rook, in the same order as KING_STEPS
+static constexpr Step DIAGONAL_STEPS[4] = { { 1, 1 }, { 1, -1 }, { -1, 1 }, { -1, -1 } };
+static constexpr Step STRAIGHT_STEPS[4] = { { 1, 0 }, { 0, 1 }, { 0, -1 }, { -1, 0 } };
+
+// The other side
+template <Color C>
+constexpr Color opponent()
+{
+    static_assert(C != Color::None, "only white and black have an opponent");
+    if constexpr (C == Color::White) return Color::Black;
+    else return Color::White;
+}
+
+// Row direction a pawn of the color moves in, white moving towards row 0
+template <Color C>
+constexpr int pawnDirection()
+{
+    if constexpr (C == Color::White) return -1;
+    else return 1;
+}
+
 // Class to hold the main chessboard and run all operations
 class Chessboard
 {
@@ -66,56 +269,561 @@ private:
     static const int SIZE = 8;
     Piece board[SIZE][SIZE];
 
+    // Bit row * 8 + col is set when the square holds a piece, kept in step with the board by setSquare
+    uint64_t occupied;
+
     // Variables to keep track of the king's postions
-    int blackKingRow;
-    int blackKingCol;
-    int whiteKingRow;
-    int whiteKingCol;
+    int8_t blackKingRow;
+    int8_t blackKingCol;
+    int8_t whiteKingRow;
+    int8_t whiteKingCol;
 
-    // Stores previous move (useful for enpassant)
-    std::vector<int> prevMove;
+    // Castling rights still held, a combination of the CASTLE_ bits
+    uint8_t castlingRights;
+
+    // Column of a pawn that just moved two squares and may be taken en passant, or -1
+    int8_t enPassantCol;
+
+    // Side to move and the move counters, kept so that a position can be written back out as FEN
+    bool blackToMove;
+    uint16_t halfmoveClock;
+    uint16_t fullmoveNumber;
 
 public:
+    // Longest FEN writeFEN can produce, including the terminating null
+    static const int MAX_FEN_LENGTH = 92;
+
+    // More moves than any position has, for the array passed to generateMoves
+    static const int MAX_MOVES = 256;
+
+    // Castling rights, named after the side and the direction the king castles in
+    static const uint8_t CASTLE_WHITE_KING_SIDE = 1;
+    static const uint8_t CASTLE_WHITE_QUEEN_SIDE = 2;
+    static const uint8_t CASTLE_BLACK_KING_SIDE = 4;
+    static const uint8_t CASTLE_BLACK_QUEEN_SIDE = 8;
+
     //Initializes the chess board
     Chessboard()
     {
+        occupied = 0;
         blackKingRow = 0;
         blackKingCol = 4;
         whiteKingRow = 7;
         whiteKingCol = 4;
 
+        castlingRights = CASTLE_WHITE_KING_SIDE | CASTLE_WHITE_QUEEN_SIDE | CASTLE_BLACK_KING_SIDE | CASTLE_BLACK_QUEEN_SIDE;
+        enPassantCol = -1;
+        blackToMove = false;
+        halfmoveClock = 0;
+        fullmoveNumber = 1;
+
         for (int i = 0; i < SIZE; ++i)
         {
-            board[1][i] = Piece(Type::Pawn, Color::Black);
-            board[6][i] = Piece(Type::Pawn, Color::White);
+            setSquare(1, i, Piece(Type::Pawn, Color::Black));
+            setSquare(6, i, Piece(Type::Pawn, Color::White));
             for (int j = 2; j < 6; ++j)
             {
-                board[j][i] = Piece();
+                setSquare(j, i, Piece());
             }
         }
-        board[0][0] = Piece(Type::Rook, Color::Black);
-        board[0][7] = Piece(Type::Rook, Color::Black);
-        board[7][0] = Piece(Type::Rook, Color::White);
-        board[7][7] = Piece(Type::Rook, Color::White);
+        setSquare(0, 0, Piece(Type::Rook, Color::Black));
+        setSquare(0, 7, Piece(Type::Rook, Color::Black));
+        setSquare(7, 0, Piece(Type::Rook, Color::White));
+        setSquare(7, 7, Piece(Type::Rook, Color::White));
+
+        setSquare(0, 1, Piece(Type::Knight, Color::Black));
+        setSquare(0, 6, Piece(Type::Knight, Color::Black));
+        setSquare(7, 1, Piece(Type::Knight, Color::White));
+        setSquare(7, 6, Piece(Type::Knight, Color::White));
+
+        setSquare(0, 2, Piece(Type::Bishop, Color::Black));
+        setSquare(0, 5, Piece(Type::Bishop, Color::Black));
+        setSquare(7, 2, Piece(Type::Bishop, Color::White));
+        setSquare(7, 5, Piece(Type::Bishop, Color::White));
+
+        setSquare(0, 3, Piece(Type::Queen, Color::Black));
+        setSquare(7, 3, Piece(Type::Queen, Color::White));
+
+        setSquare(0, 4, Piece(Type::King, Color::Black));
+        setSquare(7, 4, Piece(Type::King, Color::White));
+    }
 
-        board[0][1] = Piece(Type::Knight, Color::Black);
-        board[0][6] = Piece(Type::Knight, Color::Black);
-        board[7][1] = Piece(Type::Knight, Color::White);
-        board[7][6] = Piece(Type::Knight, Color::White);
+    /**
+     * @brief Loads a position from FEN without allocating. The move counters may be left out, so the
+     *        first four fields of an EPD line are accepted as well
+     *
+     * @param fen Text starting with the FEN, anything after the last parsed field is ignored
+     * @param consumed If not null, receives the number of characters parsed
+     * @return true if the position was loaded
+     * @return false if the FEN is malformed, in which case the board is left untouched
+     */
+    bool loadFEN(std::string_view fen, size_t* consumed = nullptr)
+    {
+        size_t pos = 0;
+        auto skipSpaces = [&]() {
+            while (pos < fen.size() && fen[pos] == ' ') ++pos;
+        };
+        auto readNumber = [&](int& value) {
+            if (pos >= fen.size() || fen[pos] < '0' || fen[pos] > '9') return false;
+            value = 0;
+            // Saturates rather than overflows, setPosition rejects anything that large
+            while (pos < fen.size() && fen[pos] >= '0' && fen[pos] <= '9') value = std::min(value * 10 + (fen[pos++] - '0'), 1 << 20);
+            return true;
+        };
+
+        // Piece placement, rank 8 first, parsed into a scratch board so a bad FEN can't leave a half loaded position
+        Piece squares[SIZE][SIZE];
+        int row = 0;
+        int col = 0;
+        skipSpaces();
+        for (; pos < fen.size() && fen[pos] != ' '; ++pos) {
+            char c = fen[pos];
+            if (c == '/') {
+                if (col != SIZE || row == SIZE - 1) return false;
+                ++row;
+                col = 0;
+            }
+            else if (c >= '1' && c <= '8') {
+                col += c - '0';
+                if (col > SIZE) return false;
+            }
+            else {
+                Piece piece = pieceFromLetter(c);
+                if (piece.getType() == Type::None || col >= SIZE) return false;
+                squares[row][col++] = piece;
+            }
+        }
+        if (row != SIZE - 1 || col != SIZE) return false;
+
+        // Side to move
+        skipSpaces();
+        if (pos >= fen.size() || (fen[pos] != 'w' && fen[pos] != 'b')) return false;
+        bool black = fen[pos++] == 'b';
+
+        // Castling rights
+        uint8_t rights = 0;
+        skipSpaces();
+        if (pos < fen.size() && fen[pos] == '-') {
+            ++pos;
+        }
+        else {
+            for (; pos < fen.size() && fen[pos] != ' '; ++pos) {
+                switch (fen[pos]) {
+                case 'K':
+                    rights |= CASTLE_WHITE_KING_SIDE;
+                    break;
+                case 'Q':
+                    rights |= CASTLE_WHITE_QUEEN_SIDE;
+                    break;
+                case 'k':
+                    rights |= CASTLE_BLACK_KING_SIDE;
+                    break;
+                case 'q':
+                    rights |= CASTLE_BLACK_QUEEN_SIDE;
+                    break;
+                default:
+                    return false;
+                }
+            }
+        }
 
-        board[0][2] = Piece(Type::Bishop, Color::Black);
-        board[0][5] = Piece(Type::Bishop, Color::Black);
-        board[7][2] = Piece(Type::Bishop, Color::White);
-        board[7][5] = Piece(Type::Bishop, Color::White);
+        // En passant target square, kept as the column of the pawn that moved past it
+        int passedCol = -1;
+        skipSpaces();
+        if (pos < fen.size() && fen[pos] == '-') {
+            ++pos;
+        }
+        else {
+            if (pos + 1 >= fen.size() || fen[pos] < 'a' || fen[pos] > 'h' || (fen[pos + 1] != '3' && fen[pos + 1] != '6')) return false;
+            passedCol = fen[pos] - 'a';
+            pos += 2;
+        }
 
-        board[0][3] = Piece(Type::Queen, Color::Black);
-        board[7][3] = Piece(Type::Queen, Color::White);
+        // Optional halfmove clock and fullmove number
+        int halfmoves = 0;
+        int fullmoves = 1;
+        size_t fieldsEnd = pos;
+        skipSpaces();
+        if (readNumber(halfmoves)) {
+            fieldsEnd = pos;
+            skipSpaces();
+            if (readNumber(fullmoves)) fieldsEnd = pos;
+        }
+        pos = fieldsEnd;
 
-        board[0][4] = Piece(Type::King, Color::Black);
-        board[7][4] = Piece(Type::King, Color::White);
+        if (!setPosition(squares, black, rights, passedCol, halfmoves, fullmoves)) return false;
+        if (consumed) *consumed = pos;
+        return true;
     }
 
-    bool checkValidSource(int sourceRow,int sourceCol,bool black) {
+    /**
+     * @brief Sets up a position from its parts, which is what loadFEN and the packed encoding load through. Castling
+     *        rights whose king or rook isn't at home and an en passant column without the pawn that moved are dropped
+     *
+     * @param squares The pieces, row 0 being black's home row
+     * @param black Whether black is to move
+     * @param rights Castling rights, a combination of the CASTLE_ bits
+     * @param passedCol Column of a pawn of the side not to move that just moved two squares, or -1
+     * @param halfmoves Halfmove clock
+     * @param fullmoves Fullmove number
+     * @return false if either side doesn't have exactly one king, a pawn stands on the first or last row or a move
+     *         counter doesn't fit in 16 bits, in which case the board is left untouched
+     */
+    bool setPosition(const Piece (&squares)[SIZE][SIZE], bool black, uint8_t rights, int passedCol, int halfmoves, int fullmoves)
+    {
+        if (halfmoves < 0 || halfmoves > UINT16_MAX || fullmoves < 0 || fullmoves > UINT16_MAX) return false;
+
+        // Find the kings and the occupied squares in one pass, checking that no pawn is on a row it can never be on
+        int kingRow[2] = { -1, -1 };
+        int kingCol[2] = { -1, -1 };
+        uint64_t occupancy = 0;
+        for (int square = 0; square < SIZE * SIZE; ++square) {
+            const Piece& piece = squares[square / SIZE][square % SIZE];
+            occupancy |= static_cast<uint64_t>(piece.getType() != Type::None) << square;
+            if (piece.getType() == Type::Pawn && (square < SIZE || square >= SIZE * (SIZE - 1))) return false;
+            if (piece.getType() != Type::King) continue;
+            int side = piece.getColor() == Color::Black ? 0 : 1;
+            if (kingRow[side] != -1) return false;
+            kingRow[side] = square / SIZE;
+            kingCol[side] = square % SIZE;
+        }
+        if (kingRow[0] == -1 || kingRow[1] == -1) return false;
+
+        // A castling right only counts while its king and rook are on their home squares
+        for (int side = 0; side < 2; ++side) {
+            int home = side == 0 ? SIZE - 1 : 0;
+            Color color = side == 0 ? Color::White : Color::Black;
+            for (int rookCol = 0; rookCol < SIZE; rookCol += SIZE - 1) {
+                const Piece& king = squares[home][4];
+                const Piece& rook = squares[home][rookCol];
+                if (king.getType() != Type::King || king.getColor() != color || rook.getType() != Type::Rook || rook.getColor() != color) {
+                    rights &= ~castlingRight(home, rookCol);
+                }
+            }
+        }
+
+        // The pawn that moved two squares stands in front of the square it passed
+        if (passedCol != -1) {
+            Piece pawn = passedCol >= 0 && passedCol < SIZE ? squares[black ? 4 : 3][passedCol] : Piece();
+            if (pawn.getType() != Type::Pawn || pawn.getColor() != (black ? Color::White : Color::Black)) passedCol = -1;
+        }
+
+        for (int i = 0; i < SIZE; ++i) {
+            for (int j = 0; j < SIZE; ++j) board[i][j] = squares[i][j];
+        }
+        occupied = occupancy;
+        blackKingRow = kingRow[0];
+        blackKingCol = kingCol[0];
+        whiteKingRow = kingRow[1];
+        whiteKingCol = kingCol[1];
+        castlingRights = rights;
+        enPassantCol = passedCol;
+        blackToMove = black;
+        halfmoveClock = halfmoves;
+        fullmoveNumber = fullmoves;
+        return true;
+    }
+
+    /**
+     * @brief Writes the position as FEN without allocating
+     *
+     * @param out Buffer of at least MAX_FEN_LENGTH characters, null terminated on return
+     * @return Length of the FEN written
+     */
+    int writeFEN(char* out) const
+    {
+        char* p = out;
+
+        // Piece placement
+        for (int i = 0; i < SIZE; ++i) {
+            int empty = 0;
+            for (int j = 0; j < SIZE; ++j) {
+                if (board[i][j].getType() == Type::None) {
+                    ++empty;
+                    continue;
+                }
+                if (empty) *p++ = static_cast<char>('0' + empty);
+                empty = 0;
+                *p++ = letterFromPiece(board[i][j]);
+            }
+            if (empty) *p++ = static_cast<char>('0' + empty);
+            if (i != SIZE - 1) *p++ = '/';
+        }
+
+        // Side to move
+        *p++ = ' ';
+        *p++ = blackToMove ? 'b' : 'w';
+
+        // Castling rights
+        *p++ = ' ';
+        char* castling = p;
+        if (canStillCastle(7, 7)) *p++ = 'K';
+        if (canStillCastle(7, 0)) *p++ = 'Q';
+        if (canStillCastle(0, 7)) *p++ = 'k';
+        if (canStillCastle(0, 0)) *p++ = 'q';
+        if (p == castling) *p++ = '-';
+
+        // En passant target, the square skipped by a double pawn push on the previous move
+        *p++ = ' ';
+        if (enPassantCol != -1) {
+            *p++ = static_cast<char>('a' + enPassantCol);
+            *p++ = blackToMove ? '3' : '6';
+        }
+        else *p++ = '-';
+
+        // Move counters
+        p += snprintf(p, MAX_FEN_LENGTH - (p - out), " %d %d", halfmoveClock, fullmoveNumber);
+        return static_cast<int>(p - out);
+    }
+
+    // Returns the position as a FEN string
+    std::string getFEN() const
+    {
+        char fen[MAX_FEN_LENGTH];
+        return std::string(fen, writeFEN(fen));
+    }
+
+    /**
+     * @brief Checks whether castling with the rook in the given corner is still allowed, i.e. neither
+     *        the king nor that rook have moved
+     *
+     * @param row Home row of the king (0 for black, 7 for white)
+     * @param rookCol Column of the rook (0 or 7)
+     * @return true if the castling right is still held
+     */
+    bool canStillCastle(int row, int rookCol) const
+    {
+        return castlingRights & castlingRight(row, rookCol);
+    }
+
+    // Returns the castling right that goes with a rook's home square, the CASTLE_ bit
+    static uint8_t castlingRight(int row, int rookCol)
+    {
+        if (row == SIZE - 1) return rookCol == SIZE - 1 ? CASTLE_WHITE_KING_SIDE : CASTLE_WHITE_QUEEN_SIDE;
+        return rookCol == SIZE - 1 ? CASTLE_BLACK_KING_SIDE : CASTLE_BLACK_QUEEN_SIDE;
+    }
+
+    // Returns the castling rights lost when a piece leaves or is taken on a square
+    static uint8_t castlingRightsAt(int row, int col)
+    {
+        if (row != 0 && row != SIZE - 1) return 0;
+        if (col == 4) return castlingRight(row, 0) | castlingRight(row, SIZE - 1);
+        return col == 0 || col == SIZE - 1 ? castlingRight(row, col) : 0;
+    }
+
+    // Returns the column of a pawn that just moved two squares and so may be taken en passant, or -1
+    int getEnPassantCol() const
+    {
+        return enPassantCol;
+    }
+
+    // Returns the castling rights still held, a combination of the CASTLE_ bits
+    uint8_t getCastlingRights() const
+    {
+        return castlingRights;
+    }
+
+    // Returns the occupied squares, bit row * 8 + col
+    uint64_t getOccupied() const
+    {
+        return occupied;
+    }
+
+    // Returns the number of moves since the last capture or pawn move, for the fifty move rule
+    int getHalfmoveClock() const
+    {
+        return halfmoveClock;
+    }
+
+    // Returns the number of the move being played, starting at 1 and going up after black moves
+    int getFullmoveNumber() const
+    {
+        return fullmoveNumber;
+    }
+
+    // Returns whether it is black's turn in the loaded position
+    bool isBlackToMove() const
+    {
+        return blackToMove;
+    }
+
+    /**
+     * @brief Tells whether the game is over and why. One legal move is enough to rule out mate and stalemate,
+     *        which take precedence over the draw rules
+     *
+     * @param history Zobrist keys of the positions of the game so far, ending with this one. Only the positions
+     *        since the last capture or pawn move are looked at, and without them repetition can't be seen
+     * @return Status of the game for the side to move
+     */
+    GameStatus gameStatus(const std::vector<uint64_t>& history = {}) const
+    {
+        Move move;
+        int found = blackToMove ? generateMovesFor<Color::Black>(&move, 1) : generateMovesFor<Color::White>(&move, 1);
+        if (found == 0) return isKingInCheck(blackToMove) ? GameStatus::Checkmate : GameStatus::Stalemate;
+        if (halfmoveClock >= 100) return GameStatus::FiftyMoveRule;
+        if (hasInsufficientMaterial()) return GameStatus::InsufficientMaterial;
+
+        // Positions before the last irreversible move can't come back
+        uint64_t key = getKey();
+        int repeats = 0;
+        size_t first = history.size() > static_cast<size_t>(halfmoveClock) ? history.size() - halfmoveClock - 1 : 0;
+        for (size_t i = first; i < history.size(); ++i) repeats += history[i] == key;
+        return repeats >= 3 ? GameStatus::ThreefoldRepetition : GameStatus::Ongoing;
+    }
+
+    /**
+     * @brief Checks whether neither side can ever mate: bare kings, a single knight or bishop, or only bishops that
+     *        all stand on squares of one color
+     *
+     * @return true if the position is a dead draw
+     */
+    bool hasInsufficientMaterial() const
+    {
+        int knights = 0;
+        uint64_t bishops = 0;
+        for (uint64_t squares = occupied; squares; squares &= squares - 1) {
+            int square = __builtin_ctzll(squares);
+            switch (board[square / SIZE][square % SIZE].getType()) {
+            case Type::Pawn:
+            case Type::Rook:
+            case Type::Queen:
+                return false;
+            case Type::Knight:
+                knights++;
+                break;
+            case Type::Bishop:
+                bishops |= 1ULL << square;
+                break;
+            default:
+                break;
+            }
+        }
+
+        // Light squares are those where row + col is even, a1 being dark
+        constexpr uint64_t LIGHT_SQUARES = 0xAA55AA55AA55AA55ULL;
+        if (knights == 0) return !(bishops & LIGHT_SQUARES) || !(bishops & ~LIGHT_SQUARES);
+        return knights == 1 && !bishops;
+    }
+
+    // Prints out the current state of the board using unicode characters to represent pieces
+    void printBoard() const
+    {
+        for (int i = 0; i < SIZE; ++i)
+        {
+            std::cout << 8 - i << " ";
+            for (int j = 0; j < SIZE; ++j)
+            {
+                Piece piece = board[i][j];
+                switch (piece.getType())
+                {
+                case Type::None:
+                    std::cout << ".";
+                    break;
+                case Type::Pawn:
+                    std::cout << (piece.getColor() == Color::White ? "♙" : "♟");
+                    break;
+                case Type::Knight:
+                    std::cout << (piece.getColor() == Color::White ? "♘" : "♞");
+                    break;
+                case Type::Bishop:
+                    std::cout << (piece.getColor() == Color::White ? "♗" : "♝");
+                    break;
+                case Type::Rook:
+                    std::cout << (piece.getColor() == Color::White ? "♖" : "♜");
+                    break;
+                case Type::Queen:
+                    std::cout << (piece.getColor() == Color::White ? "♕" : "♛");
+                    break;
+                case Type::King:
+                    std::cout << (piece.getColor() == Color::White ? "♔" : "♚");
+                    break;
+                }
+                std::cout << " ";
+            }
+            std::cout << std::endl;
+        }
+        std::cout << "# a b c d e f g h" << std::endl;
+    }
+
+    /**
+     * @brief Counts the moves of every line up to a depth, to compare with perft. The counters are added to, so
+     *        each depth includes the ones before it, and checkmating moves are only counted as checkmates
+     * @param depth How many more moves to compute
+     * @param black Indicates if it is black's turn
+     * @param count No. of possibilites
+     * @param checks No. of checks
+     * @param captures No. of captures
+     * @param checkmates No. of checkmates
+     */
+    void countPossibilites(int depth, bool black, int& count, int& checks, int& captures, int& checkmates) const {
+        if (depth == 0) {
+            return;
+        }
+
+        // Count for the given side, which need not be the side to move
+        Chessboard position = *this;
+        position.blackToMove = black;
+        Move moves[MAX_MOVES];
+        int legal = position.generateMoves(moves);
+        for (int i = 0; i < legal; ++i) {
+            Move move = moves[i];
+            if (board[move.getDestRow()][move.getDestCol()].getType() != Type::None) captures++;
+            Chessboard child = position;
+            child.makeLegalMove(move);
+
+            // Checkmates end the line and aren't counted as possibilities
+            if (position.givesCheck(move)) {
+                if (child.isKingInCheckmate(!black)) {
+                    checkmates++;
+                    continue;
+                }
+                checks++;
+            }
+            count++;
+            child.countPossibilites(depth - 1, !black, count, checks, captures, checkmates);
+        }
+    }
+
+    /**
+     * @brief Computes the Zobrist key of the position. The en passant file only counts when a pawn of the side
+     *        to move can actually capture, as in Polyglot
+     *
+     * @return 64 bit key of the position
+     */
+    uint64_t getKey() const
+    {
+        uint64_t key = 0;
+        for (uint64_t squares = occupied; squares; squares &= squares - 1) {
+            int square = __builtin_ctzll(squares);
+            const Piece& piece = board[square / SIZE][square % SIZE];
+            int kind = 2 * (static_cast<int>(piece.getType()) - 1) + (piece.getColor() == Color::White ? 1 : 0);
+            key ^= zobristPiece(kind, SIZE - 1 - square / SIZE, square % SIZE);
+        }
+
+        if (canStillCastle(7, 7)) key ^= ZOBRIST_RANDOM.values[ZOBRIST_CASTLE + 0];
+        if (canStillCastle(7, 0)) key ^= ZOBRIST_RANDOM.values[ZOBRIST_CASTLE + 1];
+        if (canStillCastle(0, 7)) key ^= ZOBRIST_RANDOM.values[ZOBRIST_CASTLE + 2];
+        if (canStillCastle(0, 0)) key ^= ZOBRIST_RANDOM.values[ZOBRIST_CASTLE + 3];
+
+        // After a double pawn push, count the file if a pawn of the side to move stands beside the pushed pawn
+        if (enPassantCol != -1) {
+            Color us = blackToMove ? Color::Black : Color::White;
+            int pawnRow = blackToMove ? 4 : 3;
+            for (int side = -1; side <= 1; side += 2) {
+                int col = enPassantCol + side;
+                if (col < 0 || col >= SIZE) continue;
+                if (board[pawnRow][col].getType() == Type::Pawn && board[pawnRow][col].getColor() == us) {
+                    key ^= ZOBRIST_RANDOM.values[ZOBRIST_EN_PASSANT + enPassantCol];
+                    break;
+                }
+            }
+        }
+
+        if (!blackToMove) key ^= ZOBRIST_RANDOM.values[ZOBRIST_TURN];
+        return key;
+    }
+
+    bool checkValidSource(int sourceRow,int sourceCol,bool black) const {
         // Check if there is a piece at the source square
         if (board[sourceRow][sourceCol].getType() == Type::None)
         {
@@ -140,81 +848,72 @@ public:
      * @return true when the input is valid
      * @return false when the input is invalid
      */
-    bool movePiece(const std::vector<int>& move, bool black)
+    bool movePiece(const std::string& move, bool black)
     {
         // Validate input length
-        if (move.size() != 4)
+        if (move.length() != 4)
         {
             std::cout << "Invalid move format. Please use chess notation (e.g., 'e2e4')." << std::endl;
             return false;
         }
 
-        // Extract source and destination squares
-        int sourceRow = move[0];
-        int sourceCol = move[1];
-        int destRow = move[2];
-        int destCol = move[3];
-
-        // Check if source and destination squares are within the board
-        if (sourceRow < 0 || sourceRow >= SIZE || sourceCol < 0 || sourceCol >= SIZE ||
-            destRow < 0 || destRow >= SIZE || destCol < 0 || destCol >= SIZE)
+        // Convert the coordinates to a move, which also checks that both squares are on the board
+        Move parsed;
+        if (!Move::fromString(move, parsed))
         {
             std::cout << "Invalid move. Source or destination square is out of bounds." << std::endl;
             return false;
         }
+        return movePiece(parsed, black);
+    }
+
+    /**
+     * @brief Checks whether the move is valid and plays it, asking which piece to promote to when a pawn reaches
+     *        the last rank
+     *
+     * @param move The move, any promotion in it is ignored
+     * @param black indicates if it is black's turn
+     * @return true when the move was played
+     * @return false when the move is invalid
+     */
+    bool movePiece(Move move, bool black)
+    {
+        int sourceRow = move.getSourceRow();
+        int sourceCol = move.getSourceCol();
+        int destRow = move.getDestRow();
+        int destCol = move.getDestCol();
 
         if (!checkValidSource(sourceRow,sourceCol,black)) return false;
 
         if (isValidMove(sourceRow, sourceCol, destRow, destCol)) {
 
-            // If the move is valid, update the board
-            Piece temp = board[destRow][destCol];
-            board[destRow][destCol] = board[sourceRow][sourceCol];
-            board[sourceRow][sourceCol] = Piece();
-
-            // If the king moved, update king position
-            if (board[destRow][destCol].getType() == Type::King) {
-                updateKingPosn(destRow, destCol);
-            }
-
-            // If the king is in check after the move, it is invalid and we should revert back
-            if (isKingInCheck(black)) {
-                board[sourceRow][sourceCol] = board[destRow][destCol];
-                board[destRow][destCol] = temp;
-                if (board[sourceRow][sourceCol].getType() == Type::King) {
-                    updateKingPosn(sourceRow, sourceCol);
-                }
+            // If the king would be in check after the move, it is invalid
+            if (leavesKingInCheck(Move(sourceRow, sourceCol, destRow, destCol))) {
                 std::cout << "That move puts your king in check" << std::endl;
-
                 return false;
             }
 
             // If pawn reaches either end of ranks, it can promote to another piece
-            if (board[destRow][destCol].getType() == Type::Pawn && (destRow == 0 || destRow == 7)) {
+            Type promotion = Type::None;
+            if (board[sourceRow][sourceCol].getType() == Type::Pawn && (destRow == 0 || destRow == 7)) {
                 std::cout << "What would you like to promote to ? (Q,R,N,B)" << std::endl;
-                Color pawnColor = board[destRow][destCol].getColor();
-                bool done = false;
-                while (!done) {
+                while (promotion == Type::None) {
                     char input;
                     std::cin >> input;
 
                     // The user selects the piece they want to promote to;
                     switch (input) {
                     case 'Q':
-                        board[destRow][destCol] = Piece(Type::Queen, pawnColor);
-                        done = true;
+                        promotion = Type::Queen;
                         break;
                     case 'R':
-                        board[destRow][destCol] = Piece(Type::Rook, pawnColor);
-                        done = true;
+                        promotion = Type::Rook;
                         break;
                     case 'N':
-                        board[destRow][destCol] = Piece(Type::Knight, pawnColor);
-                        done = true;
+                        promotion = Type::Knight;
                         break;
                     case 'B':
-                        board[destRow][destCol] = Piece(Type::Bishop, pawnColor);
-                        done = true;
+                        promotion = Type::Bishop;
                         break;
                     default:
                         std::cout << "Invalid Promotion" << std::endl;
@@ -222,18 +921,9 @@ public:
                 }
             }
 
-            // We just moved a piece to destRow, destCol so we set is as moved
-            board[destRow][destCol].setMoved();
-
-            // Store the move into prevMove
-            prevMove = move;
-
-            if (isKingInCheck(!black)) {
-                if (isKingInCheckmate(!black)) {
-                    std::cout << "Game over! " <<(black?"Black":"White")<< " Wins!" << std::endl;
-                }
-                else std::cout << "Check!" << std::endl;
-            }
+            // Update the board, pass the turn and update the move counters
+            blackToMove = black;
+            makeLegalMove(Move(sourceRow, sourceCol, destRow, destCol, promotion));
 
             // The move is valid and didn't run into any obstructions
             return true;
@@ -244,6 +934,287 @@ public:
         return false;
     }
 
+    /**
+     * @brief Plays a move for the side to move without printing or prompting. Promotions take the piece from the move
+     *
+     * @param move Move to play
+     * @return true if the move was legal and has been played
+     * @return false if the move is illegal, in which case the board is left untouched
+     */
+    bool makeMove(Move move)
+    {
+        if (!isLegalMove(move)) return false;
+        makeLegalMove(move);
+        return true;
+    }
+
+    /**
+     * @brief Checks whether a move is legal for the side to move. Like every other query this only reads the board,
+     *        so any number of threads may ask about one shared position at the same time
+     *
+     * @param move Move to check, a pawn reaching the last rank must name the piece it promotes to
+     * @return true if the move is legal
+     */
+    bool isLegalMove(Move move) const
+    {
+        int sourceRow = move.getSourceRow();
+        int sourceCol = move.getSourceCol();
+        int destRow = move.getDestRow();
+        int destCol = move.getDestCol();
+        const Piece& piece = board[sourceRow][sourceCol];
+
+        if (piece.getColor() != (blackToMove ? Color::Black : Color::White)) return false;
+        if (!isValidMove(sourceRow, sourceCol, destRow, destCol)) return false;
+
+        // A pawn reaching the last rank must promote, and nothing else may
+        Type promotion = move.getPromotion();
+        if (piece.getType() == Type::Pawn && (destRow == 0 || destRow == SIZE - 1)) {
+            if (promotion != Type::Knight && promotion != Type::Bishop && promotion != Type::Rook && promotion != Type::Queen) return false;
+        }
+        else if (promotion != Type::None) {
+            return false;
+        }
+        return !leavesKingInCheck(move);
+    }
+
+    /**
+     * @brief Checks whether a move would leave the mover's own king attacked, working out the position after the
+     *        move from the occupied squares instead of playing it
+     *
+     * @param move A move the piece on its source square can make
+     * @return true if the move is illegal because of check
+     */
+    bool leavesKingInCheck(Move move) const
+    {
+        return board[move.getSourceRow()][move.getSourceCol()].getColor() == Color::Black ? leavesKingInCheckFor<Color::Black>(move)
+                                                                                           : leavesKingInCheckFor<Color::White>(move);
+    }
+
+    /**
+     * @brief Tells whether a move checks the enemy king, without playing it. The moved piece checks directly when the
+     *        king is one of the squares it attacks from its destination, and a piece behind it checks when the move
+     *        opens a line to the king
+     *
+     * @param move A legal move of the piece on its source square, which need not belong to the side to move
+     * @return true if the enemy king is in check after the move
+     */
+    bool givesCheck(Move move) const
+    {
+        Color color = board[move.getSourceRow()][move.getSourceCol()].getColor();
+        if (color == Color::White) return givesCheckFor<Color::White>(move);
+        if (color == Color::Black) return givesCheckFor<Color::Black>(move);
+        return false;
+    }
+
+    /**
+     * @brief Plays a move taken from generateMoves without validating it again, which is what the search does at
+     *        every node. Passing any other move leaves the board in an undefined state
+     *
+     * @param move A legal move for the side to move
+     */
+    void makeLegalMove(Move move)
+    {
+        int sourceRow = move.getSourceRow();
+        int sourceCol = move.getSourceCol();
+        int destRow = move.getDestRow();
+        int destCol = move.getDestCol();
+        Piece piece = board[sourceRow][sourceCol];
+        bool black = blackToMove;
+        bool resetsClock = piece.getType() == Type::Pawn || board[destRow][destCol].getType() != Type::None;
+
+        enPassantCol = -1;
+        if (piece.getType() == Type::King) {
+
+            // Castling also moves the rook next to the king's destination
+            if (destCol - sourceCol == 2 || sourceCol - destCol == 2) {
+                int rookCol = destCol == 2 ? 0 : SIZE - 1;
+                setSquare(sourceRow, (sourceCol + destCol) / 2, board[sourceRow][rookCol]);
+                setSquare(sourceRow, rookCol, Piece());
+            }
+        }
+        else if (piece.getType() == Type::Pawn) {
+
+            // A diagonal move onto an empty square is en passant, the captured pawn is beside the source
+            if (sourceCol != destCol && board[destRow][destCol].getType() == Type::None) setSquare(sourceRow, destCol, Piece());
+            if (destRow == 0 || destRow == SIZE - 1) piece = Piece(move.getPromotion(), piece.getColor());
+            if (destRow - sourceRow == 2 || sourceRow - destRow == 2) enPassantCol = static_cast<int8_t>(sourceCol);
+        }
+
+        setSquare(destRow, destCol, piece);
+        setSquare(sourceRow, sourceCol, Piece());
+        if (piece.getType() == Type::King) updateKingPosn(destRow, destCol);
+
+        // Moving the king or a rook, or taking a rook at home, gives up castling on that side
+        castlingRights &= ~(castlingRightsAt(sourceRow, sourceCol) | castlingRightsAt(destRow, destCol));
+        halfmoveClock = resetsClock ? 0 : halfmoveClock + 1;
+        if (black) ++fullmoveNumber;
+        blackToMove = !black;
+    }
+
+    /**
+     * @brief Lists every legal move of the side to move, in the order the pieces appear on the board
+     *
+     * @param moves Array of at least MAX_MOVES moves, receives the legal moves
+     * @return Number of legal moves
+     */
+    int generateMoves(Move* moves) const
+    {
+        return blackToMove ? generateMovesFor<Color::Black>(moves, MAX_MOVES) : generateMovesFor<Color::White>(moves, MAX_MOVES);
+    }
+
+    /**
+     * @brief Reads a move in standard algebraic notation (e.g. "Nbd7", "exd6", "e8=Q+", "O-O") for the side to move
+     *
+     * @param san The move text, check and annotation marks are allowed
+     * @param move Receives the move when the result is SanResult::Ok
+     * @return SanResult::Ok if exactly one legal move matches, otherwise why the text could not be read
+     */
+    SanResult parseSAN(std::string_view san, Move& move) const
+    {
+        // Drop check, mate and annotation marks
+        while (!san.empty() && (san.back() == '+' || san.back() == '#' || san.back() == '!' || san.back() == '?')) san.remove_suffix(1);
+        if (san.size() < 2) return SanResult::Malformed;
+
+        // Castling moves the king two squares towards the rook
+        int homeRow = blackToMove ? 0 : 7;
+        if (san == "O-O" || san == "0-0") {
+            move = Move(homeRow, 4, homeRow, 6);
+            return isLegalMove(move) ? SanResult::Ok : SanResult::Illegal;
+        }
+        if (san == "O-O-O" || san == "0-0-0") {
+            move = Move(homeRow, 4, homeRow, 2);
+            return isLegalMove(move) ? SanResult::Ok : SanResult::Illegal;
+        }
+
+        // Moving piece, pawns have no letter
+        Type type = Type::Pawn;
+        size_t i = 0;
+        if (san[0] >= 'A' && san[0] <= 'Z') {
+            type = pieceFromLetter(san[0]).getType();
+            if (type == Type::None || type == Type::Pawn) return SanResult::Malformed;
+            i = 1;
+        }
+
+        // Promotion, written "e8=Q" or "e8Q"
+        Type promotion = Type::None;
+        if (type == Type::Pawn && san.size() > 2 && san.back() >= 'A' && san.back() <= 'Z') {
+            promotion = pieceFromLetter(san.back()).getType();
+            if (promotion == Type::None || promotion == Type::Pawn || promotion == Type::King) return SanResult::Malformed;
+            san.remove_suffix(1);
+            if (san.back() == '=') san.remove_suffix(1);
+        }
+
+        // Destination square
+        if (san.size() < i + 2) return SanResult::Malformed;
+        char file = san[san.size() - 2];
+        char rank = san[san.size() - 1];
+        if (file < 'a' || file > 'h' || rank < '1' || rank > '8') return SanResult::Malformed;
+        int destRow = SIZE - (rank - '0');
+        int destCol = file - 'a';
+
+        // Optional disambiguation and capture mark
+        int fromRow = -1;
+        int fromCol = -1;
+        for (size_t j = i; j < san.size() - 2; ++j) {
+            char c = san[j];
+            if (c >= 'a' && c <= 'h') fromCol = c - 'a';
+            else if (c >= '1' && c <= '8') fromRow = SIZE - (c - '0');
+            else if (c != 'x' && c != ':' && c != '-') return SanResult::Malformed;
+        }
+
+        // A pawn move without a file is a push along the destination file
+        if (type == Type::Pawn && fromCol == -1) fromCol = destCol;
+
+        // Exactly one piece of that type must be able to make the move legally
+        Color color = blackToMove ? Color::Black : Color::White;
+        int matches = 0;
+        for (int row = 0; row < SIZE; ++row) {
+            if (fromRow != -1 && row != fromRow) continue;
+            for (int col = 0; col < SIZE; ++col) {
+                if (fromCol != -1 && col != fromCol) continue;
+                if (board[row][col].getType() != type || board[row][col].getColor() != color) continue;
+                Move candidate(row, col, destRow, destCol, promotion);
+                if (isLegalMove(candidate)) {
+                    move = candidate;
+                    ++matches;
+                }
+            }
+        }
+        if (matches == 0) return SanResult::Illegal;
+        return matches == 1 ? SanResult::Ok : SanResult::Ambiguous;
+    }
+
+    /**
+     * @brief Writes a legal move of the side to move in standard algebraic notation, the inverse of parseSAN
+     *
+     * @param move Legal move to write
+     * @return The move, e.g. "Nbd7", "exd6", "e8=Q+" or "O-O"
+     */
+    std::string toSAN(Move move) const
+    {
+        int sourceRow = move.getSourceRow();
+        int sourceCol = move.getSourceCol();
+        int destRow = move.getDestRow();
+        int destCol = move.getDestCol();
+        Type type = board[sourceRow][sourceCol].getType();
+        bool capture = board[destRow][destCol].getType() != Type::None || (type == Type::Pawn && sourceCol != destCol);
+        std::string san;
+
+        if (type == Type::King && abs(destCol - sourceCol) == 2) san = destCol == 6 ? "O-O" : "O-O-O";
+        else {
+            if (type == Type::Pawn) {
+                if (capture) san += static_cast<char>('a' + sourceCol);
+            }
+            else {
+                san += letterFromPiece(Piece(type, Color::White));
+
+                // Name the file, the rank or both when another piece of the same type can go to the same square
+                Move moves[MAX_MOVES];
+                int count = generateMoves(moves);
+                bool ambiguous = false;
+                bool sameFile = false;
+                bool sameRank = false;
+                for (int i = 0; i < count; ++i) {
+                    Move other = moves[i];
+                    if (other == move || other.getDestRow() != destRow || other.getDestCol() != destCol) continue;
+                    if (board[other.getSourceRow()][other.getSourceCol()].getType() != type) continue;
+                    ambiguous = true;
+                    sameFile = sameFile || other.getSourceCol() == sourceCol;
+                    sameRank = sameRank || other.getSourceRow() == sourceRow;
+                }
+                if (ambiguous && (!sameFile || sameRank)) san += static_cast<char>('a' + sourceCol);
+                if (ambiguous && sameFile) san += static_cast<char>('0' + SIZE - sourceRow);
+            }
+            if (capture) san += 'x';
+            san += static_cast<char>('a' + destCol);
+            san += static_cast<char>('0' + SIZE - destRow);
+            if (move.getPromotion() != Type::None) {
+                san += '=';
+                san += letterFromPiece(Piece(move.getPromotion(), Color::White));
+            }
+        }
+
+        Chessboard after = *this;
+        if (after.makeMove(move) && after.isKingInCheck(after.blackToMove)) {
+            Move replies[MAX_MOVES];
+            san += after.generateMoves(replies) == 0 ? '#' : '+';
+        }
+        return san;
+    }
+
+    /**
+     * @brief Puts a piece on a square, or empties it with Piece(), keeping the occupied squares up to date
+     *
+     * @param row Row of the square
+     * @param col Column of the square
+     * @param piece The piece
+     */
+    void setSquare(int row, int col, const Piece& piece) {
+        board[row][col] = piece;
+        if (piece.getType() == Type::None) occupied &= ~squareBit(row, col);
+        else occupied |= squareBit(row, col);
+    }
+
     /**
      * @brief Updates the private variables that store the king's position (note: does not move the king)
      *
@@ -274,7 +1245,7 @@ public:
      * @return true if the piece can reach the destination in one move
      * @return false if the piece cannot reach the destination in one move
      */
-    bool isValidMove(int sourceRow, int sourceCol, int destRow, int destCol) {
+    bool isValidMove(int sourceRow, int sourceCol, int destRow, int destCol) const {
 
         // Can't move to the same square as source
         if (sourceRow == destRow && sourceCol == destCol) return false;
@@ -306,31 +1277,44 @@ public:
      * @return true if the king is in check
      * @return false if the king is safe
      */
-    bool isKingInCheck(bool black) {
+    bool isKingInCheck(bool black) const {
+        return black ? isAttackedBy<Color::White>(blackKingRow, blackKingCol) : isAttackedBy<Color::Black>(whiteKingRow, whiteKingCol);
+    }
 
-        // Iterate through all pieces and see if they can attack the king
-        // Same color pieces will be returned false by isValidMove
-        if (black) {
-            for (int i = 0; i < SIZE; ++i) {
-                for (int j = 0; j < SIZE; ++j) {
-                    if (board[i][j].getColor() != Color::White) continue;
-                    if (isValidMove(i, j, blackKingRow, blackKingCol)) {
-                        return true;
-                    }
-                }
-            }
-        }
-        else {
-            for (int i = 0; i < SIZE; ++i) {
-                for (int j = 0; j < SIZE; ++j) {
-                    if (board[i][j].getColor() != Color::Black) continue;
-                    if (isValidMove(i, j, whiteKingRow, whiteKingCol)) {
-                        return true;
-                    }
-                }
-            }
-        }
-        return false;
+    /**
+     * @brief Checks whether a square is attacked, looking outwards from the square for each kind of attacker
+     *        rather than asking every piece whether it reaches it
+     *
+     * @param row Row of the square
+     * @param col Column of the square
+     * @return true if a piece of the color By attacks the square
+     */
+    template <Color By>
+    bool isAttackedBy(int row, int col) const {
+        return isAttackedBy<By>(row, col, occupied);
+    }
+
+    /**
+     * @brief Checks whether a square is attacked in the position a move would leave behind, without playing it
+     *
+     * @param row Row of the square
+     * @param col Column of the square
+     * @param occupancy Squares that block sliding pieces
+     * @param captured Squares whose pieces have been taken. They no longer attack, though the piece that took them
+     *        still blocks
+     * @return true if a piece of the color By attacks the square
+     */
+    template <Color By>
+    bool isAttackedBy(int row, int col, uint64_t occupancy, uint64_t captured = 0) const {
+
+        // Pawns attack diagonally forward, so the attacking pawns stand where a pawn of the other color on the
+        // square would attack. Knights and kings attack symmetrically
+        int square = row * SIZE + col;
+        uint64_t attackers = occupancy & ~captured;
+        if (piecesAmong<By, Type::Pawn>(ATTACKS.pawn[By == Color::White ? 1 : 0][square] & attackers)) return true;
+        if (piecesAmong<By, Type::Knight>(ATTACKS.knight[square] & attackers)) return true;
+        if (piecesAmong<By, Type::King>(ATTACKS.king[square] & attackers)) return true;
+        return attackedAlongLines<By, Type::Bishop>(row, col, occupancy, captured) || attackedAlongLines<By, Type::Rook>(row, col, occupancy, captured);
     }
 
     /**
@@ -340,50 +1324,15 @@ public:
      * @return true if the king is in checkmate
      * @return false if the king can be saved using a move
      */
-    bool isKingInCheckmate(bool black) {
-
-        // Iterate through all the squares to find source
-        for (int i = 0; i < SIZE; ++i) {
-            for (int j = 0; j < SIZE; ++j) {
-
-                // Ignore pieces that we can't move in the current turn
-                if (black && board[i][j].getColor() != Color::Black) continue;
-                if (!black && board[i][j].getColor() != Color::White) continue;
-
-                // Iterate through all the squares to find a destination
-                for (int k = 0; k < SIZE; ++k) {
-                    for (int l = 0; l < SIZE; ++l) {
-
-                        // Check if the piece can move to the destination
-                        if (isValidMove(i, j, k, l)) {
-
-                            // Update the board
-                            Piece temp = board[k][l];
-                            board[k][l] = board[i][j];
-                            board[i][j] = Piece();
-                            // If the king is moved, update king position
-                            if (board[k][l].getType() == Type::King) updateKingPosn(k, l);
-
-                            // Check if the move makes the king safe
-                            if (!isKingInCheck(black)) {
-                                // Revert position as we do not want the player to know the safe move
-                                board[i][j] = board[k][l];
-                                board[k][l] = temp;
-                                if (board[i][j].getType() == Type::King) updateKingPosn(i, j);
-                                return false;
-                            }
-
-                            // If king is not safe, revert and try next iteration.
-                            board[i][j] = board[k][l];
-                            board[k][l] = temp;
-                            if (board[i][j].getType() == Type::King) updateKingPosn(i, j);
-                        }
-                    }
-                }
-            }
-        }
-        // None of the moves put the king out of check
-        return true;
+    bool isKingInCheckmate(bool black) const {
+
+        // Look for a single legal move of that side, which is all it takes to get out of check. Asking about the side
+        // that isn't to move needs a copy with the turn passed, since en passant and castling depend on it
+        Move move;
+        if (black == blackToMove) return (black ? generateMovesFor<Color::Black>(&move, 1) : generateMovesFor<Color::White>(&move, 1)) == 0;
+        Chessboard turn = *this;
+        turn.blackToMove = black;
+        return (black ? turn.generateMovesFor<Color::Black>(&move, 1) : turn.generateMovesFor<Color::White>(&move, 1)) == 0;
     }
 
     /**
@@ -396,7 +1345,7 @@ public:
      * @return true if the pawn move is valid
      * @return false if the pawn move is invalid
      */
-    bool isValidPawnMove(int sourceRow, int sourceCol, int destRow, int destCol) {
+    bool isValidPawnMove(int sourceRow, int sourceCol, int destRow, int destCol) const {
 
         Piece sourcePiece = board[sourceRow][sourceCol];
         Piece destPiece = board[destRow][destCol];
@@ -406,6 +1355,7 @@ public:
         if (destPiece.getColor() == playerColor) return false;
 
         int direction = (playerColor == Color::White) ? -1 : 1;
+        uint64_t dest = squareBit(destRow, destCol);
 
         // Same column movement (Cannot capture)
         if (sourceCol == destCol && destPiece.getType() == Type::None) {
@@ -413,24 +1363,21 @@ public:
             // Single forward movement
             if (destRow == sourceRow + direction) return true;
 
-            // Double movement allowed if it is the pawn's first move
-            if (destRow == sourceRow + 2 * direction && !sourcePiece.hasPieceMoved()) return true;
+            // Double movement allowed if it is the pawn's first move and the square it passes over is empty
+            if (destRow == sourceRow + 2 * direction && sourceRow == (playerColor == Color::White ? 6 : 1) && board[sourceRow + direction][sourceCol].getType() == Type::None) return true;
 
             return false;
         }
 
         // Diagonal capture movement
-        if ((destCol == sourceCol + 1 || destCol == sourceCol - 1) && destRow == sourceRow + direction) {
+        if (ATTACKS.pawn[playerColor == Color::White ? 0 : 1][sourceRow * SIZE + sourceCol] & dest) {
 
             // If enemy piece in diagonal square, then we can capture
             if ((destPiece.getType() != Type::None)) return true;
 
             // Special case: En passant
             if (board[sourceRow][destCol].getType() == Type::Pawn && board[sourceRow][destCol].getColor() != playerColor) {
-                if (prevMove[0] == prevMove[2] - 2 * direction && prevMove[1] == prevMove[3] && prevMove[1] == destCol) {
-                    board[sourceRow][destCol] = Piece();
-                    return true;
-                }
+                if (enPassantCol == destCol && sourceRow == (playerColor == Color::White ? 3 : 4)) return true;
             }
         }
         return false;
@@ -446,7 +1393,7 @@ public:
      * @return true if the knight move is valid
      * @return false if the knight move is invalid
      */
-    bool isValidKnightMove(int sourceRow, int sourceCol, int destRow, int destCol) {
+    bool isValidKnightMove(int sourceRow, int sourceCol, int destRow, int destCol) const {
 
         Piece sourcePiece = board[sourceRow][sourceCol];
         Piece destPiece = board[destRow][destCol];
@@ -456,11 +1403,7 @@ public:
         if (destPiece.getColor() == playerColor) return false;
 
         // L shaped move
-        if ((abs(destRow - sourceRow) == 2 && abs(destCol - sourceCol) == 1) || (abs(destRow - sourceRow) == 1 && abs(destCol - sourceCol) == 2)) {
-            return true;
-        }
-
-        return false;
+        return (ATTACKS.knight[sourceRow * SIZE + sourceCol] & squareBit(destRow, destCol)) != 0;
     }
 
     /**
@@ -473,7 +1416,7 @@ public:
      * @return true if the bishop move is valid
      * @return false if the bishop move is invalid
      */
-    bool isValidBishopMove(int sourceRow, int sourceCol, int destRow, int destCol) {
+    bool isValidBishopMove(int sourceRow, int sourceCol, int destRow, int destCol) const {
 
         Piece sourcePiece = board[sourceRow][sourceCol];
         Piece destPiece = board[destRow][destCol];
@@ -486,21 +1429,12 @@ public:
         if (destPiece.getColor() == playerColor) return false;
 
         // Destination is not in the same diagonal as source
-        if (abs(rowDiff) != abs(colDiff)) return false;
-
-        int stepRow = (rowDiff > 0) ? 1 : -1; // Determine step direction for row
-        int stepCol = (colDiff > 0) ? 1 : -1; // Determine step direction for column
-        int checkRow = sourceRow + stepRow;
-        int checkCol = sourceCol + stepCol;
+        int source = sourceRow * SIZE + sourceCol;
+        int dest = destRow * SIZE + destCol;
+        if (rowDiff == 0 || colDiff == 0 || !ATTACKS.line[source][dest]) return false;
 
         //Check for any obstructions in the diagonal
-        while (checkRow != destRow && checkCol != destCol) {
-            if (board[checkRow][checkCol].getType() != Type::None) // Move is blocked by a piece
-                return false;
-            checkRow += stepRow;
-            checkCol += stepCol;
-        }
-        return true;
+        return (ATTACKS.between[source][dest] & occupied) == 0;
     }
 
     /**
@@ -513,7 +1447,7 @@ public:
      * @return true if the rook move is valid
      * @return false if the rook move is invalid
      */
-    bool isValidRookMove(int sourceRow, int sourceCol, int destRow, int destCol) {
+    bool isValidRookMove(int sourceRow, int sourceCol, int destRow, int destCol) const {
 
         Piece sourcePiece = board[sourceRow][sourceCol];
         Piece destPiece = board[destRow][destCol];
@@ -522,34 +1456,11 @@ public:
         // Can't attack own piece
         if (destPiece.getColor() == playerColor) return false;
 
-        // Vertical movement, same column
-        if (destCol == sourceCol) {
-            int direction = destRow > sourceRow ? 1 : -1; // Determine direction of movement
-            int checkRow = sourceRow + direction;
-
-            // Check for obstructions
-            while (checkRow != destRow) {
-                if (board[checkRow][sourceCol].getType() != Type::None) return false; // Move is blocked by a piece
-                checkRow += direction;
-            }
-            return true;
-        }
-
-        // Horizontal movement, same row
-        if (destRow == sourceRow) {
-            int direction = destCol > sourceCol ? 1 : -1; // Determine direction of movement
-            int checkCol = sourceCol + direction;
-
-            // Check for obstructions
-            while (checkCol != destCol) {
-                if (board[sourceRow][checkCol].getType() != Type::None) return false; // Move is blocked by a piece
-                checkCol += direction;
-            }
-            return true;
-        }
-
         // Movement is neither horizontal/vertical
-        return false;
+        if (destRow != sourceRow && destCol != sourceCol) return false;
+
+        // Check for obstructions
+        return (ATTACKS.between[sourceRow * SIZE + sourceCol][destRow * SIZE + destCol] & occupied) == 0;
     }
 
     /**
@@ -562,7 +1473,7 @@ public:
      * @return true if the queen move is valid
      * @return false if the queen move is invalid
      */
-    bool isValidQueenMove(int sourceRow, int sourceCol, int destRow, int destCol) {
+    bool isValidQueenMove(int sourceRow, int sourceCol, int destRow, int destCol) const {
         // Check if the destination can be reached either by diagonal or straight move
         return (isValidBishopMove(sourceRow, sourceCol, destRow, destCol) || isValidRookMove(sourceRow, sourceCol, destRow, destCol));
     }
@@ -577,7 +1488,7 @@ public:
      * @return true if the king move is valid
      * @return false if the king move is invalid or castling under checks
      */
-    bool isValidKingMove(int sourceRow, int sourceCol, int destRow, int destCol) {
+    bool isValidKingMove(int sourceRow, int sourceCol, int destRow, int destCol) const {
 
         Piece sourcePiece = board[sourceRow][sourceCol];
         Piece destPiece = board[destRow][destCol];
@@ -587,123 +1498,377 @@ public:
         if (destPiece.getColor() == playerColor) return false;
 
         int rowDiff = destRow - sourceRow;
-        int colDiff = destCol - sourceCol;
 
-        //Castling time
-        if (!sourcePiece.hasPieceMoved() && rowDiff == 0) { //since piece hasnt moved,it should be in its own home row
-
-            // King side castling
-            if (destCol == 2) {
+        // Castling, queen side to column 2 and king side to column 6. Holding the right means the king and the rook
+        // are on their home squares
+        int homeRow = playerColor == Color::White ? SIZE - 1 : 0;
+        if (sourceRow == homeRow && rowDiff == 0 && (destCol == 2 || destCol == 6)) {
+            int source = sourceRow * SIZE + sourceCol;
+            int rookCol = destCol == 2 ? 0 : SIZE - 1;
+
+            // Nothing may stand between the rook and the king
+            if (canStillCastle(homeRow, rookCol) && !(ATTACKS.between[source][sourceRow * SIZE + rookCol] & occupied)) {
+
+                // The king can't castle out of, through or into check. The squares it crosses are looked at with
+                // the king taken off its square, as they would be with the king standing on them
+                uint64_t withoutKing = occupied & ~(1ULL << source);
+                int passCol = (sourceCol + destCol) / 2;
+                if (playerColor == Color::White) {
+                    return !isAttackedBy<Color::Black>(sourceRow, sourceCol) && !isAttackedBy<Color::Black>(sourceRow, passCol, withoutKing) &&
+                           !isAttackedBy<Color::Black>(sourceRow, destCol, withoutKing);
+                }
+                return !isAttackedBy<Color::White>(sourceRow, sourceCol) && !isAttackedBy<Color::White>(sourceRow, passCol, withoutKing) &&
+                       !isAttackedBy<Color::White>(sourceRow, destCol, withoutKing);
+            }
+        }
 
-                // Squares between castle is blocked
-                if (board[sourceRow][3].getType() != Type::None || board[sourceRow][2].getType() != Type::None || board[sourceRow][1].getType() != Type::None) return false;
+        // If the move is not within 1 sqaure of the king, it is invalid
+        return (ATTACKS.king[sourceRow * SIZE + sourceCol] & squareBit(destRow, destCol)) != 0;
+    }
+private:
+    // What every legal move of the side to move has to respect, worked out once per position
+    struct MoveConstraints
+    {
+        // Square of the king and the enemy pieces giving check
+        int king;
+        uint64_t checkers;
 
-                // Can't castle while in check
-                if (isKingInCheck(playerColor == Color::Black)) return false;
+        // Squares other pieces may move to: anywhere, the checker and the squares between it and the king, or
+        // nowhere in double check
+        uint64_t targets;
 
-                // Can only castle if the king side rook is untouched
-                if (board[sourceRow][0].getType() == Type::Rook && !board[sourceRow][0].hasPieceMoved()) {
+        // Pieces that would expose the king by leaving the line between it and an enemy slider
+        uint64_t pinned;
+    };
 
-                    // Update one square towards castle
-                    Piece rook = board[sourceRow][0];
-                    board[sourceRow][3] = sourcePiece;
-                    board[sourceRow][4] = Piece();
-                    updateKingPosn(sourceRow, 3);
+    // Returns whether a square holds the given piece
+    template <Color C, Type T>
+    bool holds(int row, int col) const
+    {
+        return board[row][col].getType() == T && board[row][col].getColor() == C;
+    }
 
-                    // Check if king is in check, if yes revert and castling is not possible
-                    if (isKingInCheck(playerColor == Color::Black)) {
-                        board[sourceRow][4] = sourcePiece;
-                        board[sourceRow][3] = Piece();
-                        updateKingPosn(sourceRow, 4);
-                        return false;
-                    }
+    // Returns the squares of a set that hold the given piece
+    template <Color C, Type T>
+    uint64_t piecesAmong(uint64_t squares) const
+    {
+        uint64_t found = 0;
+        for (; squares; squares &= squares - 1) {
+            int square = __builtin_ctzll(squares);
+            if (holds<C, T>(square / SIZE, square % SIZE)) found |= squares & (0 - squares);
+        }
+        return found;
+    }
 
-                    // Move to the castle square
-                    board[sourceRow][2] = sourcePiece;
-                    board[sourceRow][3] = Piece();
-                    updateKingPosn(sourceRow, 2);
-
-                    // Check if king is in check, if yes revert and castling is not possible
-                    if (isKingInCheck(playerColor == Color::Black)) {
-                        board[sourceRow][4] = sourcePiece;
-                        board[sourceRow][2] = Piece();
-                        updateKingPosn(sourceRow, 4);
-                        return false;
-                    }
+    // Returns whether a piece moves along the lines of the given step, straight for rooks and diagonal for bishops
+    template <Color C>
+    bool slidesAlong(const Piece& piece, const Step& step) const
+    {
+        if (piece.getColor() != C) return false;
+        bool diagonal = step.row != 0 && step.col != 0;
+        return piece.getType() == Type::Queen || piece.getType() == (diagonal ? Type::Bishop : Type::Rook);
+    }
 
-                    // This reverting part im not sure if we need, revert since it will castled by the move function anyways if valid
-                    board[sourceRow][4] = sourcePiece;
-                    board[sourceRow][2] = Piece();
-                    updateKingPosn(sourceRow, 4);
+    /**
+     * @brief Walks the lines of a bishop or a rook from a square and returns whether the first piece met is one of
+     *        the attacker's pieces that moves along them
+     *
+     * @param occupancy Squares that block the lines, the occupied squares unless a piece is being looked through
+     * @param captured Squares that block without attacking, see isAttackedBy
+     */
+    template <Color By, Type Slider>
+    bool attackedAlongLines(int row, int col, uint64_t occupancy, uint64_t captured = 0) const
+    {
+        static_assert(Slider == Type::Bishop || Slider == Type::Rook, "only bishops and rooks have lines of their own");
+        constexpr const Step* steps = Slider == Type::Bishop ? DIAGONAL_STEPS : STRAIGHT_STEPS;
+        for (int i = 0; i < 4; ++i) {
+            for (int r = row + steps[i].row, c = col + steps[i].col; r >= 0 && r < SIZE && c >= 0 && c < SIZE; r += steps[i].row, c += steps[i].col) {
+                if (!(occupancy & squareBit(r, c))) continue;
+                if (captured & squareBit(r, c)) break;
+                const Piece& piece = board[r][c];
+                if (piece.getColor() == By && (piece.getType() == Slider || piece.getType() == Type::Queen)) return true;
+                break;
+            }
+        }
+        return false;
+    }
 
-                    // Move the rook
-                    rook.setMoved();
-                    board[sourceRow][3] = rook;
-                    board[sourceRow][0] = Piece();
-                    return true;
+    // Finds the checkers and the pinned pieces of the side Us, which must be the side to move
+    template <Color Us>
+    MoveConstraints findConstraints() const
+    {
+        constexpr Color Them = opponent<Us>();
+        MoveConstraints constraints;
+        int kingRow = Us == Color::White ? whiteKingRow : blackKingRow;
+        int kingCol = Us == Color::White ? whiteKingCol : blackKingCol;
+        constraints.king = kingRow * SIZE + kingCol;
+        constraints.checkers = piecesAmong<Them, Type::Pawn>(ATTACKS.pawn[Us == Color::White ? 0 : 1][constraints.king] & occupied) |
+                               piecesAmong<Them, Type::Knight>(ATTACKS.knight[constraints.king] & occupied);
+        constraints.pinned = 0;
+
+        // Along each line the first piece met checks if it is an enemy slider of that line. If it is one of ours
+        // and the next piece is such a slider, ours is pinned
+        for (const Step& step : KING_STEPS) {
+            int own = -1;
+            for (int r = kingRow + step.row, c = kingCol + step.col; r >= 0 && r < SIZE && c >= 0 && c < SIZE; r += step.row, c += step.col) {
+                if (!(occupied & squareBit(r, c))) continue;
+                if (board[r][c].getColor() == Us) {
+                    if (own != -1) break;
+                    own = r * SIZE + c;
+                    continue;
                 }
+                if (slidesAlong<Them>(board[r][c], step)) {
+                    if (own == -1) constraints.checkers |= squareBit(r, c);
+                    else constraints.pinned |= 1ULL << own;
+                }
+                break;
             }
+        }
+
+        if (!constraints.checkers) constraints.targets = ~0ULL;
+        else if (constraints.checkers & (constraints.checkers - 1)) constraints.targets = 0;
+        else constraints.targets = constraints.checkers | ATTACKS.between[constraints.king][__builtin_ctzll(constraints.checkers)];
+        return constraints;
+    }
+
+    // Returns whether a piece of the given type on a square attacks the enemy king, with occupancy blocking lines
+    template <Color Us>
+    bool attacksFrom(Type type, int square, int king, uint64_t occupancy) const
+    {
+        switch (type) {
+        case Type::Pawn:
+            return ATTACKS.pawn[Us == Color::White ? 0 : 1][square] & (1ULL << king);
+        case Type::Knight:
+            return ATTACKS.knight[square] & (1ULL << king);
+        case Type::Bishop:
+        case Type::Rook:
+        case Type::Queen: {
+            if (!ATTACKS.line[square][king] || (ATTACKS.between[square][king] & occupancy)) return false;
+            bool diagonal = square / SIZE != king / SIZE && square % SIZE != king % SIZE;
+            return type == Type::Queen || type == (diagonal ? Type::Bishop : Type::Rook);
+        }
+        default:
+            return false;
+        }
+    }
 
-            //Queen side castling
-            else if (destCol == 6) {
+    // Checks for a move of the side Us, see leavesKingInCheck
+    template <Color Us>
+    bool leavesKingInCheckFor(Move move) const
+    {
+        int sourceRow = move.getSourceRow();
+        int sourceCol = move.getSourceCol();
+        int destRow = move.getDestRow();
+        int destCol = move.getDestCol();
+        uint64_t captured = squareBit(destRow, destCol);
+        uint64_t occupancy = (occupied & ~squareBit(sourceRow, sourceCol)) | captured;
+        Type type = board[sourceRow][sourceCol].getType();
+
+        // En passant takes a pawn beside the source, castling also moves the rook
+        if (type == Type::Pawn && sourceCol != destCol && board[destRow][destCol].getType() == Type::None) {
+            occupancy &= ~squareBit(sourceRow, destCol);
+        }
+        else if (type == Type::King && (destCol - sourceCol == 2 || sourceCol - destCol == 2)) {
+            occupancy = (occupancy & ~squareBit(sourceRow, destCol == 2 ? 0 : SIZE - 1)) | squareBit(sourceRow, (sourceCol + destCol) / 2);
+        }
 
-                // Squares between castle is blocked
-                if (board[sourceRow][5].getType() != Type::None || board[sourceRow][6].getType() != Type::None) return false;
+        if (type == Type::King) return isAttackedBy<opponent<Us>()>(destRow, destCol, occupancy, captured);
+        if (Us == Color::White) return isAttackedBy<Color::Black>(whiteKingRow, whiteKingCol, occupancy, captured);
+        return isAttackedBy<Color::White>(blackKingRow, blackKingCol, occupancy, captured);
+    }
 
-                // Can't castle while in check
-                if (isKingInCheck(playerColor == Color::Black)) return false;
+    // Checks for a move of the side Us, see givesCheck
+    template <Color Us>
+    bool givesCheckFor(Move move) const
+    {
+        int sourceRow = move.getSourceRow();
+        int sourceCol = move.getSourceCol();
+        int destRow = move.getDestRow();
+        int destCol = move.getDestCol();
+        int source = sourceRow * SIZE + sourceCol;
+        int dest = destRow * SIZE + destCol;
+        int kingRow = Us == Color::White ? blackKingRow : whiteKingRow;
+        int kingCol = Us == Color::White ? blackKingCol : whiteKingCol;
+        int king = kingRow * SIZE + kingCol;
+        Type type = board[sourceRow][sourceCol].getType();
+
+        // The squares the move empties, which are the only ones that can open a line to the king
+        uint64_t vacated = 1ULL << source;
+        uint64_t occupancy = occupied | (1ULL << dest);
+        if (type == Type::Pawn) {
+            if (move.getPromotion() != Type::None) type = move.getPromotion();
+            if (sourceCol != destCol && board[destRow][destCol].getType() == Type::None) vacated |= squareBit(sourceRow, destCol);
+        }
+        else if (type == Type::King && (destCol - sourceCol == 2 || sourceCol - destCol == 2)) {
 
-                // Can only castle if the queen side rook is untouched
-                if (board[sourceRow][7].getType() == Type::Rook && !board[sourceRow][7].hasPieceMoved()) {
+            // Castling can only check with the rook, which lands beside the king
+            int rookSquare = sourceRow * SIZE + (sourceCol + destCol) / 2;
+            vacated |= squareBit(sourceRow, destCol == 2 ? 0 : SIZE - 1);
+            occupancy = (occupancy & ~vacated) | (1ULL << rookSquare);
+            if (attacksFrom<Us>(Type::Rook, rookSquare, king, occupancy)) return true;
+        }
+        occupancy &= ~vacated;
 
-                    // Update one square towards castle
-                    Piece rook = board[sourceRow][7];
-                    board[sourceRow][5] = sourcePiece;
-                    board[sourceRow][4] = Piece();
-                    updateKingPosn(sourceRow, 5);
+        if (attacksFrom<Us>(type, dest, king, occupancy)) return true;
 
-                    // Check if king is in check, if yes revert and castling is not possible
-                    if (isKingInCheck(playerColor == Color::Black)) {
-                        board[sourceRow][4] = sourcePiece;
-                        board[sourceRow][5] = Piece();
-                        updateKingPosn(sourceRow, 4);
-                        return false;
-                    }
+        // Discovered check, only possible when a vacated square lies on a line through the king
+        bool aligned = false;
+        for (uint64_t squares = vacated; squares; squares &= squares - 1) aligned |= ATTACKS.line[king][__builtin_ctzll(squares)] != 0;
+        return aligned && (attackedAlongLines<Us, Type::Bishop>(kingRow, kingCol, occupancy) || attackedAlongLines<Us, Type::Rook>(kingRow, kingCol, occupancy));
+    }
 
-                    // Move to castle square
-                    board[sourceRow][6] = sourcePiece;
-                    board[sourceRow][5] = Piece();
-                    updateKingPosn(sourceRow, 6);
-
-                    // Check if king is in check, if yes revert and castling is not possible
-                    if (isKingInCheck(playerColor == Color::Black)) {
-                        board[sourceRow][4] = sourcePiece;
-                        board[sourceRow][6] = Piece();
-                        updateKingPosn(sourceRow, 4);
-                        return false;
-                    }
+    // Adds a move known to be legal, once for every piece a pawn on the last rank can become
+    template <bool Promotes>
+    void addMove(int row, int col, int destRow, int destCol, Move* moves, int& count, int limit) const
+    {
+        if constexpr (Promotes) {
+            static const Type promotions[4] = { Type::Queen, Type::Rook, Type::Bishop, Type::Knight };
+            for (Type promotion : promotions) {
+                if (count < limit) moves[count++] = Move(row, col, destRow, destCol, promotion);
+            }
+        }
+        else if (count < limit) {
+            moves[count++] = Move(row, col, destRow, destCol);
+        }
+    }
 
-                    // This reverting part im not sure if we need, revert since it will castled by the move function anyways if valid
-                    board[sourceRow][4] = sourcePiece;
-                    board[sourceRow][6] = Piece();
-                    updateKingPosn(sourceRow, 4);
+    /**
+     * @brief Adds the legal moves of one piece of the given type. Other than en passant and castling, which are
+     *        rare enough to be played out with isLegalMove, a move is legal when it lands on an allowed square
+     *
+     * @param allowed Squares the piece may move to: the targets, narrowed to the line through the king when pinned
+     */
+    template <Color Us, Type T>
+    void addPieceMoves(int row, int col, const MoveConstraints& constraints, uint64_t allowed, Move* moves, int& count, int limit) const
+    {
+        constexpr Color Them = opponent<Us>();
+        if constexpr (T == Type::Pawn) {
+            constexpr int direction = pawnDirection<Us>();
+            constexpr int promotionRow = Us == Color::White ? 0 : SIZE - 1;
+            int destRow = row + direction;
+            bool promotes = destRow == promotionRow;
+            auto add = [&](int destCol) {
+                if (promotes) addMove<true>(row, col, destRow, destCol, moves, count, limit);
+                else addMove<false>(row, col, destRow, destCol, moves, count, limit);
+            };
+
+            // Pushes onto empty squares, two at once from the starting square
+            if (board[destRow][col].getType() == Type::None) {
+                if (allowed & squareBit(destRow, col)) add(col);
+                int doubleRow = destRow + direction;
+                if (row == (Us == Color::White ? 6 : 1) && board[doubleRow][col].getType() == Type::None &&
+                    (allowed & squareBit(doubleRow, col))) {
+                    addMove<false>(row, col, doubleRow, col, moves, count, limit);
+                }
+            }
 
-                    // Move the rook
-                    rook.setMoved();
-                    board[sourceRow][5] = rook;
-                    board[sourceRow][7] = Piece();
-                    return true;
+            // Captures, and en passant onto the empty square behind a pawn that just moved two squares
+            for (int destCol = col - 1; destCol <= col + 1; destCol += 2) {
+                if (destCol < 0 || destCol >= SIZE) continue;
+                const Piece& target = board[destRow][destCol];
+                if (target.getColor() == Them) {
+                    if (allowed & squareBit(destRow, destCol)) add(destCol);
+                }
+                else if (target.getType() == Type::None && enPassantCol == destCol && row == (Us == Color::White ? 3 : 4)) {
+                    Move move(row, col, destRow, destCol);
+                    if (count < limit && isLegalMove(move)) moves[count++] = move;
                 }
             }
         }
+        else if constexpr (T == Type::Knight) {
+            for (const Step& step : KNIGHT_STEPS) {
+                int r = row + step.row;
+                int c = col + step.col;
+                if (r < 0 || r >= SIZE || c < 0 || c >= SIZE || board[r][c].getColor() == Us || !(allowed & squareBit(r, c))) continue;
+                addMove<false>(row, col, r, c, moves, count, limit);
+            }
+        }
+        else if constexpr (T == Type::King) {
+            // The king may not step onto an attacked square, looking through the king itself so that it can't
+            // escape along the line of a slider checking it
+            uint64_t withoutKing = occupied & ~(1ULL << constraints.king);
+            for (const Step& step : KING_STEPS) {
+                int r = row + step.row;
+                int c = col + step.col;
+                if (r < 0 || r >= SIZE || c < 0 || c >= SIZE || board[r][c].getColor() == Us || isAttackedBy<Them>(r, c, withoutKing)) continue;
+                addMove<false>(row, col, r, c, moves, count, limit);
+            }
+            constexpr uint8_t rights = Us == Color::White ? CASTLE_WHITE_KING_SIDE | CASTLE_WHITE_QUEEN_SIDE : CASTLE_BLACK_KING_SIDE | CASTLE_BLACK_QUEEN_SIDE;
+            if ((castlingRights & rights) && !constraints.checkers) {
+                for (int destCol = 2; destCol <= 6; destCol += 4) {
+                    Move move(row, col, row, destCol);
+                    if (board[row][destCol].getColor() != Us && count < limit && isLegalMove(move)) moves[count++] = move;
+                }
+            }
+        }
+        else {
+            // Sliding pieces walk each of their lines until something is in the way
+            constexpr const Step* steps = T == Type::Bishop ? DIAGONAL_STEPS : T == Type::Rook ? STRAIGHT_STEPS : KING_STEPS;
+            constexpr int lines = T == Type::Queen ? 8 : 4;
+            for (int i = 0; i < lines; ++i) {
+                for (int r = row + steps[i].row, c = col + steps[i].col; r >= 0 && r < SIZE && c >= 0 && c < SIZE; r += steps[i].row, c += steps[i].col) {
+                    if (board[r][c].getColor() == Us) break;
+                    if (allowed & squareBit(r, c)) addMove<false>(row, col, r, c, moves, count, limit);
+                    if (board[r][c].getType() != Type::None) break;
+                }
+            }
+        }
+    }
 
-        // If the move is not within 1 sqaure of the king, it is invalid
-        if (abs(rowDiff) > 1 || abs(colDiff) > 1) return false;
-
-        return true;
+    /**
+     * @brief Lists the legal moves of one side, which must be the side to move. Checkers and pins are found first,
+     *        so no move has to be played out to see whether it leaves the king in check
+     *
+     * @param moves Receives the moves
+     * @param limit Stop after this many moves, 1 to only find out whether there is any
+     * @return Number of moves found
+     */
+    template <Color Us>
+    int generateMovesFor(Move* moves, int limit) const
+    {
+        MoveConstraints constraints = findConstraints<Us>();
+        int count = 0;
+        for (int row = 0; row < SIZE && count < limit; ++row) {
+            for (int col = 0; col < SIZE && count < limit; ++col) {
+                const Piece& piece = board[row][col];
+                if (piece.getColor() != Us) continue;
+                int square = row * SIZE + col;
+                uint64_t allowed = constraints.targets;
+                if (constraints.pinned & (1ULL << square)) allowed &= ATTACKS.line[constraints.king][square];
+                switch (piece.getType()) {
+                case Type::Pawn:
+                    addPieceMoves<Us, Type::Pawn>(row, col, constraints, allowed, moves, count, limit);
+                    break;
+                case Type::Knight:
+                    addPieceMoves<Us, Type::Knight>(row, col, constraints, allowed, moves, count, limit);
+                    break;
+                case Type::Bishop:
+                    addPieceMoves<Us, Type::Bishop>(row, col, constraints, allowed, moves, count, limit);
+                    break;
+                case Type::Rook:
+                    addPieceMoves<Us, Type::Rook>(row, col, constraints, allowed, moves, count, limit);
+                    break;
+                case Type::Queen:
+                    addPieceMoves<Us, Type::Queen>(row, col, constraints, allowed, moves, count, limit);
+                    break;
+                case Type::King:
+                    addPieceMoves<Us, Type::King>(row, col, constraints, allowed, moves, count, limit);
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+        return count;
     }
-    Piece getPiece(int row, int col) {
+
+public:
+    Piece getPiece(int row, int col) const {
         return board[row][col];
     }
 };
+
+// A position is plain data that copies with memcpy, which is what makes copy-make search cheap
+static_assert(std::is_trivially_copyable<Chessboard>::value, "Chessboard must stay trivially copyable");
+static_assert(sizeof(Chessboard) <= 128, "Chessboard must stay within two cache lines");
 #endif
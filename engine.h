@@ -0,0 +1,509 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "book.h"
+#include "chess.h"
+#include "evaluation.h"
+#include "search_stats.h"
+#include "tablebase.h"
+#include "time_manager.h"
+
+// Scores are in centipawns from the side to move. Mates score MATE_SCORE minus the plies until the mate
+static const int MATE_SCORE = 100000;
+static const int INFINITE_SCORE = MATE_SCORE + 1;
+static const int MAX_PLY = 64;
+
+// Returns whether a score is a forced mate for either side
+inline bool isMateScore(int score)
+{
+    return abs(score) >= MATE_SCORE - 2 * MAX_PLY - TB_MAX_DISTANCE;
+}
+
+// Progress of a search, handed out after every finished iteration
+struct SearchReport
+{
+    int depth;
+    int score;
+    long long nodes;
+    long long milliseconds;
+    std::vector<Move> pv;
+};
+
+/**
+ * @brief Shared hash table of search results. Entries are two 64 bit words, the key stored XORed with the data,
+ *        so a torn write by another thread just reads as a miss and no locks are needed
+ */
+class TranspositionTable
+{
+public:
+    enum Bound : uint8_t
+    {
+        Exact,
+        Lower,
+        Upper
+    };
+
+    struct Data
+    {
+        Move move;
+        int score;
+        int depth;
+        Bound bound;
+    };
+
+private:
+    struct Entry
+    {
+        std::atomic<uint64_t> key;
+        std::atomic<uint64_t> data;
+    };
+
+    std::unique_ptr<Entry[]> entries;
+    uint64_t mask;
+
+public:
+    TranspositionTable() : mask(0)
+    {
+        resize(16);
+    }
+
+    // Resizes the table to the largest power of two entries that fits, and clears it
+    void resize(size_t megabytes)
+    {
+        uint64_t count = 1;
+        while (count * 2 * sizeof(Entry) <= std::max<size_t>(megabytes, 1) << 20) count *= 2;
+        entries.reset(new Entry[count]);
+        mask = count - 1;
+        clear();
+    }
+
+    void clear()
+    {
+        for (uint64_t i = 0; i <= mask; ++i) {
+            entries[i].key.store(0, std::memory_order_relaxed);
+            entries[i].data.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    bool probe(uint64_t key, Data& result) const
+    {
+        const Entry& entry = entries[key & mask];
+        uint64_t data = entry.data.load(std::memory_order_relaxed);
+        if ((entry.key.load(std::memory_order_relaxed) ^ data) != key || data == 0) return false;
+        result.move = Move::fromRaw(static_cast<uint16_t>(data));
+        result.depth = static_cast<int>((data >> 16) & 0xFF);
+        result.bound = static_cast<Bound>((data >> 24) & 3);
+        result.score = static_cast<int32_t>(data >> 32);
+        return true;
+    }
+
+    void store(uint64_t key, Move move, int score, int depth, Bound bound)
+    {
+        uint64_t data = move.raw() | (static_cast<uint64_t>(depth & 0xFF) << 16) | (static_cast<uint64_t>(bound) << 24) |
+                        (static_cast<uint64_t>(static_cast<uint32_t>(score)) << 32) | (1ULL << 26);
+        Entry& entry = entries[key & mask];
+        entry.key.store(key ^ data, std::memory_order_relaxed);
+        entry.data.store(data, std::memory_order_relaxed);
+    }
+};
+
+// Picks moves for the computer player
+class Engine
+{
+private:
+    // State of one search thread
+    struct Worker
+    {
+        long long nodes;
+        int rootDepth;
+        int completedDepth;
+        Move pv[MAX_PLY + 1][MAX_PLY + 1];
+        int pvLength[MAX_PLY + 1];
+#ifdef CHESS_SEARCH_STATS
+        SearchStats stats;
+#endif
+    };
+
+    PolyglotBook book;
+    Tablebases tablebases;
+    TranspositionTable table;
+    int threads;
+    long long nodes;
+
+    // Shared by the threads of a search
+    std::atomic<bool> stopped;
+    std::atomic<bool> pondering;
+    std::atomic<long long> sharedNodes;
+    SearchLimits limits;
+    TimeManager timeManager;
+#ifdef CHESS_SEARCH_STATS
+    SearchStats searchStats;
+#endif
+
+    /**
+     * @brief Turns a tablebase value into a search score
+     *
+     * @param value Distance to mate in plies or TB_DRAW
+     * @param ply Plies from the root to the probed position
+     */
+    static int tablebaseScore(uint8_t value, int ply)
+    {
+        if (value > TB_MAX_DISTANCE) return 0;
+        int mateScore = MATE_SCORE - ply - value;
+        return value % 2 ? mateScore : -mateScore;
+    }
+
+    // Mate scores are stored relative to the position rather than the root
+    static int scoreToTable(int score, int ply)
+    {
+        return isMateScore(score) ? (score > 0 ? score + ply : score - ply) : score;
+    }
+
+    static int scoreFromTable(int score, int ply)
+    {
+        return isMateScore(score) ? (score > 0 ? score - ply : score + ply) : score;
+    }
+
+    // The first iteration always finishes, so there is a move to play however early the search is stopped
+    bool isStopped(const Worker& worker) const
+    {
+        return worker.rootDepth > 1 && stopped.load(std::memory_order_relaxed);
+    }
+
+    // Checked every thousand nodes
+    bool checkLimits()
+    {
+        sharedNodes.fetch_add(1024, std::memory_order_relaxed);
+        if (limits.nodes && sharedNodes.load(std::memory_order_relaxed) >= limits.nodes) return true;
+        return !pondering.load(std::memory_order_relaxed) && timeManager.hardLimitReached();
+    }
+
+    /**
+     * @brief Alpha-beta search. Positions the tablebases cover return their exact score without searching further
+     *
+     * @param worker The searching thread
+     * @param board Position to search
+     * @param depth Plies left to search
+     * @param alpha Score the side to move is already sure of
+     * @param beta Score the opponent is already sure of
+     * @param ply Plies from the root
+     * @return Score of the position from the side to move, meaningless once the search is stopped
+     */
+    int search(Worker& worker, const Chessboard& board, int depth, int alpha, int beta, int ply)
+    {
+        worker.pvLength[ply] = ply;
+        if ((++worker.nodes & 1023) == 0 && checkLimits()) stopped = true;
+        if (isStopped(worker)) return 0;
+
+        uint8_t value;
+        if (ply > 0 && tablebases.probe(board, value)) return tablebaseScore(value, ply);
+        if (depth == 0 || ply >= MAX_PLY) {
+            SEARCH_STAT(worker.stats.leafNodes++);
+            SEARCH_TIMER(worker.stats, Evaluation);
+            return evaluate(board);
+        }
+
+        // A result from an earlier search that is deep enough ends the search here, otherwise its move is tried first
+        uint64_t key = board.getKey();
+        TranspositionTable::Data entry;
+        Move hashMove;
+        SEARCH_STAT(worker.stats.hashProbes++);
+        if (table.probe(key, entry)) {
+            SEARCH_STAT(worker.stats.hashHits++);
+            hashMove = entry.move;
+            int score = scoreFromTable(entry.score, ply);
+            if (ply > 0 && entry.depth >= depth &&
+                (entry.bound == TranspositionTable::Exact || (entry.bound == TranspositionTable::Lower && score >= beta) ||
+                 (entry.bound == TranspositionTable::Upper && score <= alpha))) {
+                SEARCH_STAT(worker.stats.hashCutoffs++);
+                return score;
+            }
+        }
+
+        Move moves[Chessboard::MAX_MOVES];
+        int count;
+        {
+            SEARCH_TIMER(worker.stats, MoveGeneration);
+            count = board.generateMoves(moves);
+        }
+        if (count == 0) {
+            SEARCH_TIMER(worker.stats, CheckDetection);
+            return board.isKingInCheck(board.isBlackToMove()) ? -MATE_SCORE + ply : 0;
+        }
+
+        // The hash move, then captures of the most valuable pieces, then the quiet moves
+        int order[Chessboard::MAX_MOVES];
+        for (int i = 0; i < count; ++i) {
+            Type captured = board.getPiece(moves[i].getDestRow(), moves[i].getDestCol()).getType();
+            order[i] = moves[i] == hashMove ? 1000 : static_cast<int>(captured) * 10 - static_cast<int>(board.getPiece(moves[i].getSourceRow(), moves[i].getSourceCol()).getType());
+        }
+
+        int originalAlpha = alpha;
+        Move best;
+        for (int i = 0; i < count; ++i) {
+            int pick = i;
+            for (int j = i + 1; j < count; ++j) {
+                if (order[j] > order[pick]) pick = j;
+            }
+            std::swap(moves[i], moves[pick]);
+            std::swap(order[i], order[pick]);
+
+            Chessboard child = board;
+            {
+                SEARCH_TIMER(worker.stats, MakeMove);
+                child.makeLegalMove(moves[i]);
+            }
+            int score = -search(worker, child, depth - 1, -beta, -alpha, ply + 1);
+            if (isStopped(worker)) return 0;
+            if (score > alpha) {
+                alpha = score;
+                best = moves[i];
+                worker.pv[ply][ply] = moves[i];
+                for (int next = ply + 1; next < worker.pvLength[ply + 1]; ++next) worker.pv[ply][next] = worker.pv[ply + 1][next];
+                worker.pvLength[ply] = std::max(worker.pvLength[ply + 1], ply + 1);
+                if (alpha >= beta) {
+                    SEARCH_STAT(worker.stats.betaCutoffs++);
+                    SEARCH_STAT(if (i == 0) worker.stats.firstMoveCutoffs++);
+                    break;
+                }
+            }
+        }
+
+        TranspositionTable::Bound bound = alpha >= beta ? TranspositionTable::Lower : alpha > originalAlpha ? TranspositionTable::Exact : TranspositionTable::Upper;
+        table.store(key, best.isNull() ? hashMove : best, scoreToTable(alpha, ply), depth, bound);
+        return alpha;
+    }
+
+    /**
+     * @brief Searches one ply deeper at a time until a limit is hit
+     *
+     * @param worker The searching thread
+     * @param board Root position
+     * @param maxDepth Deepest iteration to run
+     * @param firstDepth Depth to start at, helpers start at different depths so they don't all do the same work
+     * @param report Called after every finished iteration. Null for helper threads, which leave the timing to the main thread
+     * @param pv Receives the principal variation of the last finished iteration
+     */
+    void iterate(Worker& worker, const Chessboard& board, int maxDepth, int firstDepth, const std::function<void(const SearchReport&)>* report,
+                 std::vector<Move>& pv)
+    {
+        for (int depth = firstDepth; depth <= maxDepth; ++depth) {
+            worker.rootDepth = depth;
+            SEARCH_STAT(long long nodesBefore = worker.nodes);
+            SEARCH_STAT(uint64_t cyclesBefore = readCycles());
+            int score = search(worker, board, depth, -INFINITE_SCORE, INFINITE_SCORE, 0);
+            SEARCH_STAT(worker.stats.depthNodes[depth] += worker.nodes - nodesBefore);
+            SEARCH_STAT(worker.stats.depthCycles[depth] += readCycles() - cyclesBefore);
+            SEARCH_STAT(worker.stats.cycles += readCycles() - cyclesBefore);
+            if (isStopped(worker)) break;
+            pv.assign(worker.pv[0], worker.pv[0] + worker.pvLength[0]);
+            worker.completedDepth = depth;
+            if (!report) continue;
+            if (*report) (*report)({ depth, score, sharedNodes.load() + (worker.nodes & 1023), timeManager.elapsed(), pv });
+
+            // Out of time for another iteration, or a forced mate was found. While pondering the clock isn't ours yet
+            if (limits.infinite || pondering.load()) continue;
+            if (timeManager.stopAfterIteration(pv.empty() ? 0 : pv[0].raw(), score)) break;
+            if (isMateScore(score) && MATE_SCORE - abs(score) <= depth) break;
+        }
+    }
+
+public:
+    Engine() : threads(1), nodes(0), stopped(false), pondering(false), sharedNodes(0) {}
+
+    // Scores a position from the side to move, see evaluation.h
+    static int evaluate(const Chessboard& board)
+    {
+        return evaluatePosition(board);
+    }
+
+    /**
+     * @brief Loads the opening book that is consulted before anything else
+     *
+     * @param path Path of a Polyglot book
+     * @return true if the book was loaded
+     */
+    bool loadBook(const char* path)
+    {
+        return book.open(path);
+    }
+
+    /**
+     * @brief Maps the endgame tablebases of a directory
+     *
+     * @param directory Directory with the tables written by tbgen
+     * @return Number of tables loaded
+     */
+    int loadTablebases(const char* directory)
+    {
+        return tablebases.open(directory);
+    }
+
+    // Sets the size of the hash table in megabytes, clearing it
+    void setHashSize(size_t megabytes)
+    {
+        table.resize(megabytes);
+    }
+
+    // Sets how many threads search together
+    void setThreads(int count)
+    {
+        threads = std::max(1, count);
+    }
+
+    // Forgets everything learned in earlier searches, for a new game
+    void clearHash()
+    {
+        table.clear();
+    }
+
+    // Returns the number of positions searched by the last search
+    long long getNodes() const
+    {
+        return nodes;
+    }
+
+    // Makes a running search return as soon as possible. Safe to call from another thread
+    void stop()
+    {
+        stopped = true;
+    }
+
+    /**
+     * @brief Clears the stop of an earlier search. A search started on another thread must be prepared with this
+     *        before the thread starts, so that a stop sent right after the start isn't lost
+     */
+    void resetStop()
+    {
+        stopped = false;
+    }
+
+    /**
+     * @brief The opponent played the expected move. The ponder search carries on as a normal timed search, keeping
+     *        its iterations and hash entries, with the clock starting now. Safe to call from another thread
+     */
+    void ponderHit()
+    {
+        timeManager.restart();
+        pondering = false;
+    }
+
+#ifdef CHESS_SEARCH_STATS
+    // Returns the counters of the last search, added up over its threads
+    const SearchStats& getSearchStats() const
+    {
+        return searchStats;
+    }
+
+#endif
+    // Returns the time planning of the searches so far
+    const TimeManager& getTimeManager() const
+    {
+        return timeManager;
+    }
+
+    /**
+     * @brief Describes the forced outcome of a position the tablebases cover, e.g. "White mates in 12"
+     *
+     * @param board Position to look at
+     * @param text Receives the description
+     * @return false if the position isn't in the tablebases
+     */
+    bool describeOutcome(const Chessboard& board, std::string& text) const
+    {
+        uint8_t value;
+        if (!tablebases.probe(board, value)) return false;
+        if (value > TB_MAX_DISTANCE) {
+            text = "Tablebase draw";
+            return true;
+        }
+        bool whiteMates = (value % 2 == 1) != board.isBlackToMove();
+        text = std::string(whiteMates ? "White" : "Black") + " mates in " + std::to_string((value + 1) / 2);
+        return true;
+    }
+
+    /**
+     * @brief Searches a position within the given limits. Book moves are played straight away. Extra threads
+     *        search the same position and share what they find through the hash table. A stop sent before the
+     *        search begins is kept and ends it after the first iteration, and the search clears it when it returns
+     *
+     * @param board Position to move in
+     * @param searchLimits When to stop
+     * @param report If set, called with the progress of the main thread after every finished iteration
+     * @param ponderMove If not null, receives the expected reply to the chosen move, or a null move
+     * @return The chosen move, or a null move if there is none
+     */
+    Move think(const Chessboard& board, const SearchLimits& searchLimits, const std::function<void(const SearchReport&)>& report = nullptr,
+               Move* ponderMove = nullptr)
+    {
+        if (ponderMove) *ponderMove = Move();
+        nodes = 0;
+        SEARCH_STAT(searchStats.clear());
+
+        // Book moves cost no thinking time
+        Move bookMove = book.bestMove(board);
+        if (!bookMove.isNull()) {
+            stopped = false;
+            return bookMove;
+        }
+
+        limits = searchLimits;
+        Move rootMoves[Chessboard::MAX_MOVES];
+        timeManager.begin(limits, board.isBlackToMove(), board.generateMoves(rootMoves));
+        pondering = limits.ponder;
+        sharedNodes = 0;
+
+        // In a tablebase position every move leads to a known score, so one ply is enough
+        uint8_t value;
+        int maxDepth = limits.depth > 0 ? std::min(limits.depth, MAX_PLY) : MAX_PLY;
+        if (tablebases.probe(board, value)) maxDepth = 1;
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::vector<std::vector<Move>> pvs(threads);
+        for (int i = 0; i < threads; ++i) workers.emplace_back(new Worker());
+        std::vector<std::thread> helpers;
+        for (int i = 1; i < threads; ++i) {
+            helpers.emplace_back([&, i]() { iterate(*workers[i], board, maxDepth, 1 + i % 2, nullptr, pvs[i]); });
+        }
+        iterate(*workers[0], board, maxDepth, 1, &report, pvs[0]);
+        stopped = true;
+        for (std::thread& helper : helpers) helper.join();
+        stopped = false;
+
+        for (const std::unique_ptr<Worker>& worker : workers) nodes += worker->nodes;
+#ifdef CHESS_SEARCH_STATS
+        for (const std::unique_ptr<Worker>& worker : workers) {
+            worker->stats.nodes = worker->nodes;
+            searchStats.add(worker->stats);
+        }
+#endif
+        timeManager.finish(workers[0]->completedDepth);
+        if (pvs[0].empty()) return Move();
+        if (ponderMove && pvs[0].size() > 1) *ponderMove = pvs[0][1];
+        return pvs[0][0];
+    }
+
+    /**
+     * @brief Picks a move for the side to move, taking it straight from the opening book when the position is in it
+     *
+     * @param board Position to move in
+     * @param depth How many moves ahead to look
+     * @return The chosen move, or a null move if there is none
+     */
+    Move predictBestMove(const Chessboard& board, int depth)
+    {
+        SearchLimits searchLimits;
+        searchLimits.depth = std::max(depth, 1);
+        return think(board, searchLimits);
+    }
+};
+#endif
@@ -0,0 +1,154 @@
+#ifndef EPD_H
+#define EPD_H
+
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+#include "chess.h"
+#include "mapped_file.h"
+
+// One EPD operation, e.g. `bm Nf3;` has the opcode "bm" and the operand "Nf3"
+struct EpdOpcode
+{
+    std::string_view opcode;
+    std::string_view operand;
+};
+
+// One line of an EPD file. The views point into the reader's mapping and stay valid until the reader is closed
+struct EpdRecord
+{
+    static const int MAX_OPCODES = 32;
+
+    std::string_view line;
+    size_t offset;
+    EpdOpcode opcodes[MAX_OPCODES];
+    int opcodeCount;
+
+    // Returns the operand of the given opcode, or an empty view if the line doesn't have it
+    std::string_view find(std::string_view opcode) const
+    {
+        for (int i = 0; i < opcodeCount; ++i) {
+            if (opcodes[i].opcode == opcode) return opcodes[i].operand;
+        }
+        return std::string_view();
+    }
+};
+
+// Streams the positions of an EPD file through a read only memory mapping, so no line is ever copied
+class EpdReader
+{
+private:
+    MappedFile file;
+    size_t pos;
+
+public:
+    EpdReader() : pos(0) {}
+
+    /**
+     * @brief Maps an EPD file for reading
+     *
+     * @param path Path of the file
+     * @return true if the file was opened
+     * @return false if the file could not be opened or mapped
+     */
+    bool open(const char* path)
+    {
+        pos = 0;
+        return file.open(path);
+    }
+
+    // Unmaps the file, invalidating every record handed out so far
+    void close()
+    {
+        file.close();
+        pos = 0;
+    }
+
+    /**
+     * @brief Reads the next line holding a position, skipping blank lines and '#' comments
+     *
+     * @param record Receives the line and its opcodes
+     * @return true if a line was read
+     * @return false at the end of the file
+     */
+    bool next(EpdRecord& record)
+    {
+        const char* data = file.begin();
+        size_t size = file.length();
+        while (pos < size) {
+            size_t start = pos;
+            const void* newline = memchr(data + pos, '\n', size - pos);
+            size_t end = newline ? static_cast<const char*>(newline) - data : size;
+            pos = newline ? end + 1 : size;
+
+            std::string_view line(data + start, end - start);
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            size_t first = line.find_first_not_of(" \t");
+            if (first == std::string_view::npos || line[first] == '#') continue;
+
+            record.line = line;
+            record.offset = start;
+            record.opcodeCount = 0;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Reads the next position into a board and splits the operations that follow it
+     *
+     * @param board Receives the position
+     * @param record Receives the line and its opcodes
+     * @return true if a line was read, check record.opcodeCount >= 0 to see whether the position was valid
+     * @return false at the end of the file
+     */
+    bool next(Chessboard& board, EpdRecord& record)
+    {
+        if (!next(record)) return false;
+
+        size_t consumed = 0;
+        if (!board.loadFEN(record.line, &consumed)) {
+            record.opcodeCount = -1;
+            return true;
+        }
+        parseOpcodes(record.line.substr(consumed), record);
+        return true;
+    }
+
+    // Returns how far through the file the reader is, in bytes
+    size_t offset() const
+    {
+        return pos;
+    }
+
+private:
+    // Splits `opcode operand;` pairs. Semicolons inside double quoted operands don't end the operation
+    static void parseOpcodes(std::string_view text, EpdRecord& record)
+    {
+        size_t i = 0;
+        while (i < text.size() && record.opcodeCount < EpdRecord::MAX_OPCODES) {
+            while (i < text.size() && (text[i] == ' ' || text[i] == '\t')) ++i;
+            if (i == text.size()) break;
+
+            size_t opcodeStart = i;
+            while (i < text.size() && text[i] != ' ' && text[i] != '\t' && text[i] != ';') ++i;
+            std::string_view opcode = text.substr(opcodeStart, i - opcodeStart);
+
+            while (i < text.size() && (text[i] == ' ' || text[i] == '\t')) ++i;
+            size_t operandStart = i;
+            bool quoted = false;
+            while (i < text.size() && (quoted || text[i] != ';')) {
+                if (text[i] == '"') quoted = !quoted;
+                ++i;
+            }
+            size_t operandEnd = i;
+            while (operandEnd > operandStart && (text[operandEnd - 1] == ' ' || text[operandEnd - 1] == '\t')) --operandEnd;
+            if (i < text.size()) ++i;
+
+            EpdOpcode& op = record.opcodes[record.opcodeCount++];
+            op.opcode = opcode;
+            op.operand = text.substr(operandStart, operandEnd - operandStart);
+        }
+    }
+};
+#endif
@@ -0,0 +1,73 @@
+#ifndef EVALUATION_H
+#define EVALUATION_H
+
+#include <cstdint>
+#include "chess.h"
+
+/*
+ * Static evaluation: material and piece-square values, each with a middlegame and an endgame weight. The two are
+ * blended by the game phase, which counts 1 for every knight and bishop, 2 for every rook and 4 for every queen
+ * on the board, up to EVAL_PHASE_MAX for the full set of pieces.
+ */
+
+static const int EVAL_PHASE_MAX = 24;
+static const int EVAL_PHASE_WEIGHTS[6] = { 0, 1, 1, 2, 4, 0 };
+
+// Weights of the evaluation, indexed by [0 middlegame, 1 endgame][Type - 1]
+struct EvalParams
+{
+    int material[2][6];
+    int pieceSquare[2][6][64];
+};
+
+#include "eval_params.h"
+
+// Value of each piece on each square, indexed by [phase][0 white, 1 black][Type - 1][row * 8 + col]. Black's are
+// negative, so the sum over the board is the score from white's side
+struct EvalTables
+{
+    int values[2][2][6][64];
+};
+
+constexpr EvalTables makeEvalTables(const EvalParams& params)
+{
+    EvalTables tables = {};
+    for (int phase = 0; phase < 2; ++phase) {
+        for (int type = 0; type < 6; ++type) {
+            for (int square = 0; square < 64; ++square) {
+                int mirrored = (7 - square / 8) * 8 + square % 8;
+                tables.values[phase][0][type][square] = params.material[phase][type] + params.pieceSquare[phase][type][square];
+                tables.values[phase][1][type][square] = -(params.material[phase][type] + params.pieceSquare[phase][type][mirrored]);
+            }
+        }
+    }
+    return tables;
+}
+
+static constexpr EvalTables EVAL_TABLES = makeEvalTables(EVAL_PARAMS);
+
+/**
+ * @brief Evaluates a position
+ *
+ * @param board The position
+ * @return Score in centipawns from the side to move
+ */
+inline int evaluatePosition(const Chessboard& board)
+{
+    int middlegame = 0;
+    int endgame = 0;
+    int phase = 0;
+    for (uint64_t squares = board.getOccupied(); squares; squares &= squares - 1) {
+        int square = __builtin_ctzll(squares);
+        Piece piece = board.getPiece(square / 8, square % 8);
+        int color = piece.getColor() == Color::Black;
+        int type = static_cast<int>(piece.getType()) - 1;
+        middlegame += EVAL_TABLES.values[0][color][type][square];
+        endgame += EVAL_TABLES.values[1][color][type][square];
+        phase += EVAL_PHASE_WEIGHTS[type];
+    }
+    if (phase > EVAL_PHASE_MAX) phase = EVAL_PHASE_MAX;
+    int score = (middlegame * phase + endgame * (EVAL_PHASE_MAX - phase)) / EVAL_PHASE_MAX;
+    return board.isBlackToMove() ? -score : score;
+}
+#endif
@@ -0,0 +1,335 @@
+#ifndef GAME_RECORD_H
+#define GAME_RECORD_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "chess.h"
+#include "mapped_file.h"
+#include "pgn.h"
+
+/*
+ * Binary game record file, all fields little endian:
+ *
+ *   File header (32 bytes)   magic "CHESSGR1", version, flags, game count, index offset
+ *   Games                    one after another, each starting on a 2 byte boundary
+ *     Game header (4 bytes)  ply count, result, flags
+ *     FEN (optional)         length byte and text, present if the game has GAME_HAS_FEN, then padded to 2 bytes
+ *     Moves                  ply count 16 bit moves, the value of Move::raw()
+ *     Evals (optional)       ply count 16 bit centipawn scores, present if the file has FILE_HAS_EVALS
+ *   Index                    8 byte aligned, game count 64 bit offsets of the game headers
+ */
+
+static const char GAME_RECORD_MAGIC[8] = { 'C', 'H', 'E', 'S', 'S', 'G', 'R', '1' };
+static const uint32_t GAME_RECORD_VERSION = 1;
+
+// File flags
+static const uint32_t FILE_HAS_EVALS = 1;
+
+// Game flags
+static const uint8_t GAME_HAS_FEN = 1;
+
+// Eval value meaning "no score for this move"
+static const int16_t NO_EVAL = INT16_MIN;
+
+struct GameRecordFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t gameCount;
+    uint64_t indexOffset;
+};
+static_assert(sizeof(GameRecordFileHeader) == 32, "the file header is part of the format");
+
+struct GameRecordHeader
+{
+    uint16_t plyCount;
+    uint8_t result;
+    uint8_t flags;
+};
+static_assert(sizeof(GameRecordHeader) == 4, "the game header is part of the format");
+
+// One game of a record file, pointing straight into the mapping
+struct GameRecordView
+{
+    int plyCount;
+    GameResult result;
+    std::string_view fen;
+    const uint16_t* moves;
+    const int16_t* evals;
+
+    // Returns the move at a ply
+    Move move(int ply) const
+    {
+        return Move::fromRaw(moves[ply]);
+    }
+
+    // Returns the score of the move at a ply, or NO_EVAL if the file has none
+    int eval(int ply) const
+    {
+        return evals ? evals[ply] : NO_EVAL;
+    }
+};
+
+// Writes a game record file through a buffered stream. The index is kept in memory until close
+class GameRecordWriter
+{
+private:
+    FILE* file;
+    std::string path;
+    uint32_t flags;
+    uint64_t offset;
+    bool failed;
+    std::vector<uint64_t> index;
+
+    // A short write is remembered and fails close, so a full disk never leaves a file that looks complete
+    void write(const void* data, size_t size)
+    {
+        if (fwrite(data, 1, size, file) != size) failed = true;
+        offset += size;
+    }
+
+    void pad(size_t alignment)
+    {
+        static const char zeros[8] = {};
+        if (offset % alignment) write(zeros, alignment - offset % alignment);
+    }
+
+public:
+    GameRecordWriter() : file(nullptr), flags(0), offset(0), failed(false) {}
+
+    ~GameRecordWriter()
+    {
+        close();
+    }
+
+    GameRecordWriter(const GameRecordWriter&) = delete;
+    GameRecordWriter& operator=(const GameRecordWriter&) = delete;
+
+    /**
+     * @brief Creates a record file
+     *
+     * @param filePath Path of the file
+     * @param withEvals Whether every move carries a score
+     * @return true if the file was created
+     * @return false if the file could not be created
+     */
+    bool open(const char* filePath, bool withEvals)
+    {
+        close();
+        file = fopen(filePath, "wb");
+        if (!file) return false;
+        setvbuf(file, nullptr, _IOFBF, 1 << 20);
+
+        path = filePath;
+        flags = withEvals ? FILE_HAS_EVALS : 0;
+        offset = 0;
+        failed = false;
+        index.clear();
+
+        // Placeholder header, rewritten with the counts on close
+        GameRecordFileHeader header = {};
+        write(&header, sizeof(header));
+        return true;
+    }
+
+    /**
+     * @brief Appends a game
+     *
+     * @param moves Moves of the game
+     * @param plyCount Number of moves, at most 65535
+     * @param result Result of the game
+     * @param fen Starting position, empty for the initial position
+     * @param evals Score of every move, ignored unless the file was opened with evals (null writes NO_EVAL)
+     * @return true if the game was written
+     * @return false if the game is too long or the FEN doesn't fit in a length byte
+     */
+    bool addGame(const Move* moves, int plyCount, GameResult result, std::string_view fen = std::string_view(), const int16_t* evals = nullptr)
+    {
+        if (!file || plyCount < 0 || plyCount > UINT16_MAX || fen.size() > UINT8_MAX) return false;
+
+        index.push_back(offset);
+        GameRecordHeader header;
+        header.plyCount = static_cast<uint16_t>(plyCount);
+        header.result = static_cast<uint8_t>(result);
+        header.flags = fen.empty() ? 0 : GAME_HAS_FEN;
+        write(&header, sizeof(header));
+
+        if (!fen.empty()) {
+            uint8_t length = static_cast<uint8_t>(fen.size());
+            write(&length, 1);
+            write(fen.data(), fen.size());
+            pad(2);
+        }
+
+        // Move is a single 16 bit field, so an array of them is already in the on disk layout
+        static_assert(sizeof(Move) == sizeof(uint16_t), "moves are written as their raw value");
+        write(moves, plyCount * sizeof(uint16_t));
+
+        if (flags & FILE_HAS_EVALS) {
+            for (int i = 0; i < plyCount; ++i) {
+                int16_t eval = evals ? evals[i] : NO_EVAL;
+                write(&eval, sizeof(eval));
+            }
+        }
+        return true;
+    }
+
+    // Returns the number of games written so far
+    uint64_t gameCount() const
+    {
+        return index.size();
+    }
+
+    // Writes the index and the final header, then closes the file. If anything failed to write, the file is removed
+    bool close()
+    {
+        if (!file) return true;
+
+        pad(8);
+        GameRecordFileHeader header;
+        memcpy(header.magic, GAME_RECORD_MAGIC, sizeof(header.magic));
+        header.version = GAME_RECORD_VERSION;
+        header.flags = flags;
+        header.gameCount = index.size();
+        header.indexOffset = offset;
+        write(index.data(), index.size() * sizeof(uint64_t));
+
+        bool ok = !failed && !ferror(file) && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = fclose(file) == 0 && ok;
+        if (!ok) remove(path.c_str());
+        file = nullptr;
+        index.clear();
+        return ok;
+    }
+};
+
+// Reads a game record file in place through a memory mapping
+class GameRecordReader
+{
+private:
+    MappedFile file;
+    const GameRecordFileHeader* header;
+    const uint64_t* index;
+
+public:
+    GameRecordReader() : header(nullptr), index(nullptr) {}
+
+    /**
+     * @brief Maps a record file and checks its header
+     *
+     * @param path Path of the file
+     * @return true if the file is a valid record file
+     * @return false if the file could not be mapped or is not a record file
+     */
+    bool open(const char* path)
+    {
+        header = nullptr;
+        index = nullptr;
+        if (!file.open(path)) return false;
+        if (file.length() < sizeof(GameRecordFileHeader)) return false;
+
+        const GameRecordFileHeader* candidate = reinterpret_cast<const GameRecordFileHeader*>(file.begin());
+        if (memcmp(candidate->magic, GAME_RECORD_MAGIC, sizeof(candidate->magic)) != 0 || candidate->version != GAME_RECORD_VERSION) return false;
+        if (candidate->indexOffset % 8 || candidate->indexOffset < sizeof(GameRecordFileHeader) || candidate->indexOffset > file.length() ||
+            candidate->gameCount > (file.length() - candidate->indexOffset) / sizeof(uint64_t)) {
+            return false;
+        }
+
+        header = candidate;
+        index = reinterpret_cast<const uint64_t*>(file.begin() + header->indexOffset);
+        return true;
+    }
+
+    // Returns the number of games in the file
+    uint64_t size() const
+    {
+        return header ? header->gameCount : 0;
+    }
+
+    // Returns whether the moves carry scores
+    bool hasEvals() const
+    {
+        return header && (header->flags & FILE_HAS_EVALS);
+    }
+
+    /**
+     * @brief Returns a game by number, without copying it. The game is checked against the file first, so a corrupt
+     *        or truncated file never makes it point outside the mapping
+     *
+     * @param number Number of the game
+     * @param view Receives the game
+     * @return false if the game doesn't lie within the games area of the file or has an unknown result
+     */
+    bool game(uint64_t number, GameRecordView& view) const
+    {
+        if (number >= size()) return false;
+        uint64_t offset = index[number];
+        uint64_t end = header->indexOffset;
+        if (offset % 2 || offset < sizeof(GameRecordFileHeader) || offset > end - sizeof(GameRecordHeader)) return false;
+
+        const char* p = file.begin() + offset;
+        const GameRecordHeader* game = reinterpret_cast<const GameRecordHeader*>(p);
+        p += sizeof(GameRecordHeader);
+        uint64_t left = end - offset - sizeof(GameRecordHeader);
+        if (game->result > static_cast<uint8_t>(GameResult::Draw)) return false;
+
+        view.plyCount = game->plyCount;
+        view.result = static_cast<GameResult>(game->result);
+        view.fen = std::string_view();
+        if (game->flags & GAME_HAS_FEN) {
+            if (left < 2) return false;
+            uint8_t length = static_cast<uint8_t>(*p);
+            uint64_t span = (1 + length + 1) & ~1;
+            if (span > left) return false;
+            view.fen = std::string_view(p + 1, length);
+            p += span;
+            left -= span;
+        }
+
+        uint64_t moveBytes = static_cast<uint64_t>(view.plyCount) * sizeof(uint16_t);
+        if ((hasEvals() ? 2 * moveBytes : moveBytes) > left) return false;
+        view.moves = reinterpret_cast<const uint16_t*>(p);
+        view.evals = hasEvals() ? reinterpret_cast<const int16_t*>(p + moveBytes) : nullptr;
+        return true;
+    }
+};
+
+/**
+ * @brief Converts a PGN file into a record file. Games with a bad move are skipped
+ *
+ * @param pgnPath Path of the PGN file
+ * @param recordPath Path of the record file to create
+ * @param skipped Receives the number of games that could not be replayed
+ * @return Number of games written, or -1 if a file could not be opened
+ */
+inline long long convertPgnToRecords(const char* pgnPath, const char* recordPath, long long& skipped)
+{
+    PgnReader reader;
+    GameRecordWriter writer;
+    if (!reader.open(pgnPath) || !writer.open(recordPath, false)) return -1;
+
+    std::string_view text = reader.text();
+    std::vector<Move> moves;
+    Chessboard board;
+    PgnGame game;
+    PgnError error;
+    GameResult result;
+    skipped = 0;
+
+    size_t pos = reader.nextGameStart(0);
+    while (reader.nextGame(pos, text.size(), game)) {
+        moves.clear();
+        if (!replayPgnGame(game, text.data(), board, result, error, [&](const Chessboard&, Move move) { moves.push_back(move); }) ||
+            !writer.addGame(moves.data(), static_cast<int>(moves.size()), result, pgnTag(game.text, "FEN"))) {
+            ++skipped;
+        }
+    }
+    long long written = static_cast<long long>(writer.gameCount());
+    return writer.close() ? written : -1;
+}
+#endif
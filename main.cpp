@@ -4,6 +4,7 @@
 #include <vector>
 #include "shader_s.h"
 #include "chess.h"
+#include "engine.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -13,10 +14,52 @@ constexpr float squareSize = 0.8f / boardSize;
 
 struct WindowData {
     Chessboard* chessboard;
-    std::vector<int> move;
+    Engine* engine;
+    // Square of the piece picked up with the first click, or -1
+    int selected;
     bool black;
+    std::vector<uint64_t> positions;
 };
 
+// Passes the turn after a move and announces check, checkmate and draws for the side that is now to move
+void finishTurn(WindowData* windowData) {
+    windowData->black = !windowData->black;
+    windowData->positions.push_back(windowData->chessboard->getKey());
+    GameStatus status = windowData->chessboard->gameStatus(windowData->positions);
+    if (status == GameStatus::Checkmate) {
+        std::cout << "Game over! " << (windowData->black ? "White" : "Black") << " Wins!" << std::endl;
+        return;
+    }
+    if (status != GameStatus::Ongoing) {
+        std::cout << "Game over! Draw by " << gameStatusName(status) << std::endl;
+        return;
+    }
+    if (windowData->chessboard->isKingInCheck(windowData->black)) std::cout << "Check!" << std::endl;
+
+    // Announce the result as soon as the tablebases know it
+    std::string outcome;
+    if (windowData->engine->describeOutcome(*windowData->chessboard, outcome)) std::cout << outcome << std::endl;
+}
+
+// Pressing B lets the computer play a move for the side to move
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (key != GLFW_KEY_B || action != GLFW_PRESS) return;
+
+    WindowData* windowData = static_cast<WindowData*>(glfwGetWindowUserPointer(window));
+    if (!windowData) return;
+
+    Move move = windowData->engine->predictBestMove(*windowData->chessboard, 4);
+    if (move.isNull()) {
+        std::cout << "The computer has no move to suggest" << std::endl;
+        return;
+    }
+    if (windowData->chessboard->makeMove(move)) {
+        std::cout << "Computer plays " << move.toString() << std::endl;
+        windowData->selected = -1;
+        finishTurn(windowData);
+    }
+}
+
 void window_size_callback(GLFWwindow* window, int width, int height) {
     int newDimension = std::min(width, height);
     glfwSetWindowSize(window, newDimension, newDimension);
@@ -49,23 +92,19 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
         WindowData* windowData = static_cast<WindowData*>(glfwGetWindowUserPointer(window));
         if (windowData) {
             if (row >= 0 && row < 8 && col >= 0 && col < 8) {
-                if (windowData->move.empty()) {
-                    if (windowData->chessboard->checkValidSource(row, col, windowData->black)) {
-                        windowData->move.push_back(row);
-                        windowData->move.push_back(col);
-                    }
+                if (windowData->selected == -1) {
+                    if (windowData->chessboard->checkValidSource(row, col, windowData->black)) windowData->selected = row * boardSize + col;
                 }
                 else {
-                    windowData->move.push_back(row);
-                    windowData->move.push_back(col);
-                    if (windowData->chessboard->movePiece(windowData->move, windowData->black)) {
-                        windowData->black = !windowData->black;
+                    Move move(windowData->selected / boardSize, windowData->selected % boardSize, row, col);
+                    if (windowData->chessboard->movePiece(move, windowData->black)) {
+                        finishTurn(windowData);
                     }
-                    windowData->move.clear();
+                    windowData->selected = -1;
                 }
             }
             else {
-                windowData->move.clear();
+                windowData->selected = -1;
             }
         }
         else {
@@ -248,6 +287,7 @@ int main() {
     glfwSetWindowSizeCallback(window, window_size_callback);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetKeyCallback(window, key_callback);
 
     std::vector<float> vertices;
     std::vector<float> colors;
@@ -292,7 +332,12 @@ int main() {
     textures[10] = loadTexture("images/bishop_b.png");
     textures[11] = loadTexture("images/pawn_b.png");
 
-    WindowData windowData = { &Game,{},false };
+    // The computer player, using an opening book and endgame tablebases from the working directory if there are any
+    Engine engine;
+    engine.loadBook("book.bin");
+    engine.loadTablebases("tb");
+
+    WindowData windowData = { &Game,&engine,-1,false,{ Game.getKey() } };
     glfwSetWindowUserPointer(window, &windowData);
 
     // Render loop
@@ -0,0 +1,100 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Read only memory mapping of a whole file
+class MappedFile
+{
+private:
+    int fd;
+    const char* data;
+    size_t size;
+
+public:
+    MappedFile() : fd(-1), data(nullptr), size(0) {}
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /**
+     * @brief Maps a file for reading
+     *
+     * @param path Path of the file
+     * @param sequential Hint that the file will be read front to back once
+     * @return true if the file was mapped
+     * @return false if the file could not be opened or mapped
+     */
+    bool open(const char* path, bool sequential = true)
+    {
+        close();
+        fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close();
+            return false;
+        }
+        size = static_cast<size_t>(info.st_size);
+
+        // An empty file can't be mapped, but it is still a valid file
+        if (size > 0) {
+            void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                close();
+                return false;
+            }
+            data = static_cast<const char*>(mapping);
+
+            // Let the kernel read ahead and drop pages behind us, or skip read ahead for lookups
+            madvise(mapping, size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        }
+        return true;
+    }
+
+    // Unmaps the file, invalidating every pointer into it
+    void close()
+    {
+        if (data) munmap(const_cast<char*>(data), size);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+        data = nullptr;
+        size = 0;
+    }
+
+    // Returns whether a file is open
+    bool isOpen() const
+    {
+        return fd >= 0;
+    }
+
+    // Returns the contents of the file
+    std::string_view text() const
+    {
+        return std::string_view(data, size);
+    }
+
+    // Returns the start of the mapping, or null for an empty file
+    const char* begin() const
+    {
+        return data;
+    }
+
+    // Returns the size of the file in bytes
+    size_t length() const
+    {
+        return size;
+    }
+};
+#endif
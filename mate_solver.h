@@ -0,0 +1,465 @@
+#ifndef MATE_SOLVER_H
+#define MATE_SOLVER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "chess.h"
+
+/*
+ * Mate finder based on depth-first proof-number search (df-pn). Every node has a proof number, the least number of
+ * leaves that still have to be shown to be mates to prove the attacker mates from it, and a disproof number, the same
+ * for showing it doesn't. The search always expands the most proving node, the one on which those numbers depend
+ * most, so it follows forcing lines such as checks with few replies much deeper than the rest.
+ *
+ * The numbers are kept from the side to move as phi and delta: phi is the proof number at attacker nodes and the
+ * disproof number at defender nodes, delta the other one. A node with phi 0 is won for its side to move, one with
+ * delta 0 lost. The attacker wins by mating within the remaining plies, the defender by avoiding it, so the
+ * remaining plies are part of each node and the search graph has no cycles.
+ */
+
+static const uint32_t MATE_INFINITY = (1u << 28) - 1;
+static const int MATE_MAX_MOVES = 32;
+
+// What a mate search found out
+enum class MateStatus
+{
+    Mate,
+    NoMate,
+    Unknown
+};
+
+// Outcome of a mate search
+struct MateSearchResult
+{
+    MateStatus status;
+
+    // Moves to mate, and the forcing line with the longest defence, when status is Mate
+    int moves;
+    std::vector<Move> line;
+
+    long long nodes;
+    long long milliseconds;
+};
+
+/**
+ * @brief Shared table of proof and disproof numbers. A bucket of four entries fills a cache line, each entry being
+ *        two 64 bit words with the key stored XORed with the data like in the TranspositionTable, so threads
+ *        share it without locks. Solved nodes and nodes with large subtrees are kept over the others
+ */
+class ProofTable
+{
+private:
+    struct Entry
+    {
+        std::atomic<uint64_t> key;
+        std::atomic<uint64_t> data;
+    };
+
+    static const int BUCKET_SIZE = 4;
+
+    std::unique_ptr<Entry[]> entries;
+    uint64_t mask;
+
+    // Priority of an entry when a bucket is full
+    static int worth(uint64_t data)
+    {
+        uint32_t phi = data & MATE_INFINITY;
+        uint32_t delta = (data >> 28) & MATE_INFINITY;
+        if (phi == 0 || delta == 0) return 256;
+        return static_cast<int>(data >> 56);
+    }
+
+public:
+    ProofTable() : mask(0)
+    {
+        resize(16);
+    }
+
+    // Resizes the table to the largest power of two buckets that fits, and clears it
+    void resize(size_t megabytes)
+    {
+        uint64_t count = 1;
+        while (count * 2 * BUCKET_SIZE * sizeof(Entry) <= std::max<size_t>(megabytes, 1) << 20) count *= 2;
+        entries.reset(new Entry[count * BUCKET_SIZE]);
+        mask = count - 1;
+        clear();
+    }
+
+    void clear()
+    {
+        for (uint64_t i = 0; i < (mask + 1) * BUCKET_SIZE; ++i) {
+            entries[i].key.store(0, std::memory_order_relaxed);
+            entries[i].data.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    bool probe(uint64_t key, uint32_t& phi, uint32_t& delta) const
+    {
+        const Entry* bucket = &entries[(key & mask) * BUCKET_SIZE];
+        for (int i = 0; i < BUCKET_SIZE; ++i) {
+            uint64_t data = bucket[i].data.load(std::memory_order_relaxed);
+            if ((bucket[i].key.load(std::memory_order_relaxed) ^ data) != key || data == 0) continue;
+            phi = data & MATE_INFINITY;
+            delta = (data >> 28) & MATE_INFINITY;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Stores the numbers of a node
+     *
+     * @param key Key of the node
+     * @param phi Its phi
+     * @param delta Its delta
+     * @param nodes Size of the search that found them, which decides what is replaced
+     */
+    void store(uint64_t key, uint32_t phi, uint32_t delta, long long nodes)
+    {
+        int work = 0;
+        while (work < 255 && (1LL << work) < nodes) ++work;
+        uint64_t data = phi | (static_cast<uint64_t>(delta) << 28) | (static_cast<uint64_t>(work) << 56);
+        Entry* bucket = &entries[(key & mask) * BUCKET_SIZE];
+        Entry* victim = &bucket[0];
+        int victimWorth = 257;
+        for (int i = 0; i < BUCKET_SIZE; ++i) {
+            uint64_t old = bucket[i].data.load(std::memory_order_relaxed);
+            if ((bucket[i].key.load(std::memory_order_relaxed) ^ old) == key || old == 0) {
+                victim = &bucket[i];
+                break;
+            }
+            if (worth(old) < victimWorth) {
+                victim = &bucket[i];
+                victimWorth = worth(old);
+            }
+        }
+        victim->key.store(key ^ data, std::memory_order_relaxed);
+        victim->data.store(data, std::memory_order_relaxed);
+    }
+};
+
+/**
+ * @brief Finds forced mates with df-pn. solve looks for a mate in 1, then 2 and so on up to the asked number of
+ *        moves, which finds the shortest one; positions proven or refuted at one number stay in the table for the
+ *        next. Extra threads run the same search over the shared table, each breaking ties between equally good
+ *        moves differently, so they work on different parts of the tree and hand each other their results.
+ *        Repetitions and the fifty move rule are ignored, as in composed problems
+ */
+class MateSolver
+{
+private:
+    ProofTable table;
+    int threads;
+    long long nodeLimit;
+    std::atomic<bool> stopped;
+    std::atomic<bool> limitReached;
+    std::atomic<long long> sharedNodes;
+
+    // State of one search thread
+    struct Worker
+    {
+        int id;
+        long long nodes;
+        long long unreported;
+    };
+
+    // A move of a node being expanded, with the last numbers seen for the node it leads to
+    struct Child
+    {
+        Move move;
+        uint64_t key;
+        uint32_t phi;
+        uint32_t delta;
+    };
+
+    // Mixes the remaining plies into the key of a position
+    static uint64_t nodeKey(const Chessboard& board, int remaining)
+    {
+        return board.getKey() ^ (static_cast<uint64_t>(remaining + 1) * 0x9E3779B97F4A7C15ULL);
+    }
+
+    static uint32_t addNumbers(uint32_t a, uint32_t b)
+    {
+        if (a >= MATE_INFINITY || b >= MATE_INFINITY) return MATE_INFINITY;
+        return std::min(a + b, MATE_INFINITY - 1);
+    }
+
+    /**
+     * @brief Finds the numbers of a node that hasn't been expanded yet. Nodes without moves and nodes out of plies
+     *        are solved; the others start with phi 1 and delta their number of moves, as each of them has to be
+     *        refuted for the side to move to lose
+     *
+     * @param board The position
+     * @param remaining Plies left for the attacker to mate in
+     * @param attacker Whether the attacker is to move
+     * @param phi Receives phi
+     * @param delta Receives delta
+     */
+    static void initialNumbers(const Chessboard& board, int remaining, bool attacker, uint32_t& phi, uint32_t& delta)
+    {
+        bool inCheck = board.isKingInCheck(board.isBlackToMove());
+        bool sideWins;
+        if (remaining == 0 && !inCheck) sideWins = !attacker;
+        else {
+            Move moves[Chessboard::MAX_MOVES];
+            int count = board.generateMoves(moves);
+            if (count == 0) sideWins = !inCheck && !attacker;
+            else if (remaining == 0) sideWins = !attacker;
+            else {
+                phi = 1;
+                delta = static_cast<uint32_t>(count);
+                return;
+            }
+        }
+        phi = sideWins ? 0 : MATE_INFINITY;
+        delta = sideWins ? MATE_INFINITY : 0;
+    }
+
+    // Counts a node, and stops every thread once the limit is reached
+    void countNode(Worker& worker)
+    {
+        worker.nodes++;
+        if (++worker.unreported < 1024) return;
+        long long total = sharedNodes.fetch_add(worker.unreported) + worker.unreported;
+        worker.unreported = 0;
+        if (nodeLimit > 0 && total >= nodeLimit) {
+            limitReached = true;
+            stopped = true;
+        }
+    }
+
+    /**
+     * @brief Expands a node until its phi reaches thresholdPhi or its delta reaches thresholdDelta, then stores it
+     *
+     * @param worker The thread's state
+     * @param board The position
+     * @param key Key of the node
+     * @param remaining Plies left for the attacker to mate in, at least 1
+     * @param attacker Whether the attacker is to move
+     * @param thresholdPhi Bound on phi
+     * @param thresholdDelta Bound on delta
+     * @param phi Receives phi
+     * @param delta Receives delta
+     */
+    void expand(Worker& worker, const Chessboard& board, uint64_t key, int remaining, bool attacker, uint32_t thresholdPhi, uint32_t thresholdDelta,
+                uint32_t& phi, uint32_t& delta)
+    {
+        countNode(worker);
+        long long startNodes = worker.nodes;
+        Move moves[Chessboard::MAX_MOVES];
+        int count = board.generateMoves(moves);
+        Child children[Chessboard::MAX_MOVES];
+        int childCount = 0;
+        for (int i = 0; i < count; ++i) {
+            // A defender left without plies escapes unless mated, so the last attacker ply only needs checks
+            if (remaining == 1 && !board.givesCheck(moves[i])) continue;
+            Chessboard child = board;
+            child.makeLegalMove(moves[i]);
+            Child& entry = children[childCount++];
+            entry.move = moves[i];
+            entry.key = nodeKey(child, remaining - 1);
+            if (table.probe(entry.key, entry.phi, entry.delta)) continue;
+            initialNumbers(child, remaining - 1, !attacker, entry.phi, entry.delta);
+            table.store(entry.key, entry.phi, entry.delta, 0);
+        }
+
+        for (;;) {
+            // The side to move wins through any child that loses, and loses only when every child wins
+            phi = MATE_INFINITY;
+            delta = 0;
+            int best = -1;
+            uint32_t secondDelta = MATE_INFINITY;
+            for (int i = 0; i < childCount; ++i) {
+                int index = (i + worker.id * 7) % childCount;
+                Child& entry = children[index];
+
+                // Alone, only the child just expanded changes, and that one's numbers came back from expand. With
+                // other threads, the table has their progress on the rest
+                if (threads > 1) table.probe(entry.key, entry.phi, entry.delta);
+                delta = addNumbers(delta, entry.phi);
+                if (best < 0 || entry.delta < phi) {
+                    if (best >= 0) secondDelta = phi;
+                    phi = entry.delta;
+                    best = index;
+                }
+                else if (entry.delta < secondDelta) secondDelta = entry.delta;
+            }
+            if (phi >= thresholdPhi || delta >= thresholdDelta || stopped) break;
+
+            // Expand the most proving child, until it stops being the best, with a little slack so that the search
+            // doesn't keep switching between two children of about the same size
+            Child& entry = children[best];
+            uint32_t childThresholdPhi = thresholdDelta - delta + entry.phi;
+            uint32_t childThresholdDelta = std::min<uint64_t>(thresholdPhi, secondDelta + 1 + secondDelta / 4);
+            Chessboard child = board;
+            child.makeLegalMove(entry.move);
+            expand(worker, child, entry.key, remaining - 1, !attacker, childThresholdPhi, childThresholdDelta, entry.phi, entry.delta);
+        }
+        if (!stopped) table.store(key, phi, delta, worker.nodes - startNodes);
+    }
+
+    /**
+     * @brief Solves a node with every thread, each starting with infinite thresholds
+     *
+     * @param board The position
+     * @param remaining Plies left for the attacker to mate in
+     * @param attacker Whether the attacker is to move
+     * @param workerCount Number of threads to use
+     * @return MateStatus::Mate if the side to move loses to the attacker or is the attacker and mates,
+     *         MateStatus::NoMate if not, MateStatus::Unknown if the node limit was reached first
+     */
+    MateStatus solveNode(const Chessboard& board, int remaining, bool attacker, int workerCount)
+    {
+        uint32_t phi;
+        uint32_t delta;
+        uint64_t key = nodeKey(board, remaining);
+        if (!table.probe(key, phi, delta)) initialNumbers(board, remaining, attacker, phi, delta);
+        if (phi != 0 && delta != 0) {
+            if (limitReached) return MateStatus::Unknown;
+            stopped = false;
+            std::vector<Worker> workers(workerCount);
+            std::vector<std::thread> helpers;
+            for (int i = 0; i < workerCount; ++i) workers[i] = { i, 0, 0 };
+            for (int i = 1; i < workerCount; ++i) {
+                helpers.emplace_back([&, i]() {
+                    uint32_t helperPhi;
+                    uint32_t helperDelta;
+                    expand(workers[i], board, key, remaining, attacker, MATE_INFINITY, MATE_INFINITY, helperPhi, helperDelta);
+                });
+            }
+            expand(workers[0], board, key, remaining, attacker, MATE_INFINITY, MATE_INFINITY, phi, delta);
+            stopped = true;
+            for (std::thread& helper : helpers) helper.join();
+            for (const Worker& worker : workers) sharedNodes += worker.unreported;
+            if (phi != 0 && delta != 0) return MateStatus::Unknown;
+        }
+        bool sideWins = phi == 0;
+        return sideWins == attacker ? MateStatus::Mate : MateStatus::NoMate;
+    }
+
+    /**
+     * @brief Finds the least plies in which the attacker mates from a node, trying every count of the right parity
+     *        up to a bound
+     *
+     * @param board The position
+     * @param maxRemaining The bound, at which the node is known to be a mate
+     * @param attacker Whether the attacker is to move
+     * @return The least plies
+     */
+    int matingPlies(const Chessboard& board, int maxRemaining, bool attacker)
+    {
+        for (int remaining = maxRemaining % 2; remaining < maxRemaining; remaining += 2) {
+            if (solveNode(board, remaining, attacker, 1) == MateStatus::Mate) return remaining;
+        }
+        return maxRemaining;
+    }
+
+    /**
+     * @brief Follows a proven mate: the attacker plays a move that still mates in time, the defender the reply
+     *        that delays the mate the longest
+     *
+     * @param board Position with the attacker to move
+     * @param remaining The least plies in which the attacker mates
+     * @param line Receives the moves
+     * @return false if the node limit cut the line short
+     */
+    bool buildLine(Chessboard board, int remaining, std::vector<Move>& line)
+    {
+        Move moves[Chessboard::MAX_MOVES];
+        while (remaining > 0) {
+            int count = board.generateMoves(moves);
+            Move mating;
+            for (int i = 0; i < count && mating.isNull(); ++i) {
+                Chessboard child = board;
+                child.makeLegalMove(moves[i]);
+                if (solveNode(child, remaining - 1, false, 1) == MateStatus::Mate) mating = moves[i];
+            }
+            if (mating.isNull()) return false;
+            line.push_back(mating);
+            board.makeLegalMove(mating);
+
+            int replyCount = board.generateMoves(moves);
+            if (replyCount == 0) return true;
+            Move longest;
+            int longestPlies = -1;
+            for (int i = 0; i < replyCount; ++i) {
+                Chessboard child = board;
+                child.makeLegalMove(moves[i]);
+                int plies = matingPlies(child, remaining - 2, true);
+                if (plies > longestPlies) {
+                    longest = moves[i];
+                    longestPlies = plies;
+                }
+            }
+            if (limitReached) return false;
+            line.push_back(longest);
+            board.makeLegalMove(longest);
+            remaining = longestPlies;
+        }
+        return true;
+    }
+
+public:
+    MateSolver() : threads(1), nodeLimit(0), stopped(false), limitReached(false), sharedNodes(0) {}
+
+    // Sets the size of the proof table in megabytes, clearing it
+    void setHashSize(size_t megabytes)
+    {
+        table.resize(megabytes);
+    }
+
+    // Sets how many threads search together
+    void setThreads(int count)
+    {
+        threads = std::max(1, count);
+    }
+
+    // Forgets the nodes solved by earlier searches
+    void clearHash()
+    {
+        table.clear();
+    }
+
+    // Makes a running search give up as soon as possible. Safe to call from another thread
+    void stop()
+    {
+        limitReached = true;
+        stopped = true;
+    }
+
+    /**
+     * @brief Looks for a mate by the side to move
+     *
+     * @param board The position
+     * @param maxMoves Longest mate to look for, in moves of the side to move, at most MATE_MAX_MOVES
+     * @param maxNodes Nodes to search before giving up, 0 for no limit
+     * @return The shortest mate and its line, or whether there is none within maxMoves
+     */
+    MateSearchResult solve(const Chessboard& board, int maxMoves, long long maxNodes = 0)
+    {
+        auto start = std::chrono::steady_clock::now();
+        nodeLimit = maxNodes;
+        limitReached = false;
+        sharedNodes = 0;
+        MateSearchResult result = { MateStatus::NoMate, 0, {}, 0, 0 };
+        for (int moves = 1; moves <= std::min(maxMoves, MATE_MAX_MOVES); ++moves) {
+            MateStatus status = solveNode(board, 2 * moves - 1, true, threads);
+            if (status == MateStatus::NoMate) continue;
+            result.status = status;
+            if (status == MateStatus::Mate) {
+                result.moves = moves;
+                if (!buildLine(board, 2 * moves - 1, result.line)) result.line.clear();
+            }
+            break;
+        }
+        result.nodes = sharedNodes;
+        result.milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        return result;
+    }
+};
+#endif
@@ -0,0 +1,183 @@
+#ifndef PACKED_POSITION_H
+#define PACKED_POSITION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include "chess.h"
+
+/*
+ * Packed position, 32 bytes, all fields little endian:
+ *
+ *   occupancy        64 bit mask of the occupied squares, bit row * 8 + col with row 0 being black's home row
+ *   pieces           one 4 bit code per set bit of occupancy in ascending square order, low nibble first. The code
+ *                    is the Type value, plus 8 for black pieces. Code 7 is a pawn that has just moved two squares
+ *                    and can be taken en passant. Unused nibbles are zero
+ *   state            bit 0 set when black is to move, bits 1-4 the Chessboard::CASTLE_ rights
+ *   halfmoveClock    capped at 255
+ *   fullmoveNumber
+ *   reserved         zero
+ *
+ * The en passant pawn is only marked when a pawn of the side to move stands beside it, as in the Zobrist key, so
+ * two boards that are the same position with the same counters always pack to the same bytes and the struct can
+ * be compared and hashed as plain memory.
+ */
+
+static const uint8_t PACKED_PASSED_PAWN = 7;
+static const uint8_t PACKED_BLACK = 8;
+
+struct alignas(32) PackedPosition
+{
+    uint64_t occupancy;
+    uint8_t pieces[16];
+    uint8_t state;
+    uint8_t halfmoveClock;
+    uint16_t fullmoveNumber;
+    uint8_t reserved[4];
+};
+static_assert(sizeof(PackedPosition) == 32, "packed positions are part of the dataset format");
+
+/**
+ * @brief Packs a position
+ *
+ * @param board The position
+ * @param out Receives the packed position
+ * @return false if the board has more than 32 pieces, in which case out is zeroed
+ */
+inline bool packPosition(const Chessboard& board, PackedPosition& out)
+{
+    out = PackedPosition();
+    uint64_t occupied = board.getOccupied();
+    if (__builtin_popcountll(occupied) > 32) return false;
+
+    // The pawn that can be taken en passant, if a pawn of the side to move is beside it
+    bool black = board.isBlackToMove();
+    int passedSquare = -1;
+    int passedCol = board.getEnPassantCol();
+    if (passedCol != -1) {
+        int row = black ? 4 : 3;
+        for (int col = passedCol - 1; col <= passedCol + 1; col += 2) {
+            if (col < 0 || col >= 8) continue;
+            Piece piece = board.getPiece(row, col);
+            if (piece.getType() == Type::Pawn && piece.getColor() == (black ? Color::Black : Color::White)) passedSquare = row * 8 + passedCol;
+        }
+    }
+
+    int index = 0;
+    for (uint64_t squares = occupied; squares; squares &= squares - 1, ++index) {
+        int square = __builtin_ctzll(squares);
+        Piece piece = board.getPiece(square / 8, square % 8);
+        uint8_t code = square == passedSquare ? PACKED_PASSED_PAWN : static_cast<uint8_t>(piece.getType());
+        if (piece.getColor() == Color::Black) code |= PACKED_BLACK;
+        out.pieces[index / 2] |= static_cast<uint8_t>(code << (4 * (index % 2)));
+    }
+
+    out.occupancy = occupied;
+    out.state = static_cast<uint8_t>((black ? 1 : 0) | (board.getCastlingRights() << 1));
+    out.halfmoveClock = static_cast<uint8_t>(board.getHalfmoveClock() < 255 ? board.getHalfmoveClock() : 255);
+    out.fullmoveNumber = static_cast<uint16_t>(board.getFullmoveNumber());
+    return true;
+}
+
+/**
+ * @brief Unpacks a position
+ *
+ * @param in The packed position
+ * @param board Receives the position
+ * @return false if the packed position is corrupt, in which case the board is left untouched
+ */
+inline bool unpackPosition(const PackedPosition& in, Chessboard& board)
+{
+    Piece pieces[8][8];
+    bool black = in.state & 1;
+    int passedCol = -1;
+    int index = 0;
+    for (uint64_t squares = in.occupancy; squares; squares &= squares - 1, ++index) {
+        if (index == 32) return false;
+        int square = __builtin_ctzll(squares);
+        int code = (in.pieces[index / 2] >> (4 * (index % 2))) & 15;
+        Type type = static_cast<Type>(code & 7);
+        if (type == Type::None) return false;
+        if ((code & 7) == PACKED_PASSED_PAWN) {
+            type = Type::Pawn;
+            passedCol = square % 8;
+        }
+        pieces[square / 8][square % 8] = Piece(type, (code & PACKED_BLACK) ? Color::Black : Color::White);
+    }
+    return board.setPosition(pieces, black, (in.state >> 1) & 15, passedCol, in.halfmoveClock, in.fullmoveNumber);
+}
+
+// Returns whether two packed positions are the same, one 32 byte compare
+inline bool operator==(const PackedPosition& a, const PackedPosition& b)
+{
+#if defined(__AVX2__)
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&a));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&b));
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) == -1;
+#else
+    uint64_t x[4], y[4];
+    std::memcpy(x, &a, sizeof(x));
+    std::memcpy(y, &b, sizeof(y));
+    return ((x[0] ^ y[0]) | (x[1] ^ y[1]) | (x[2] ^ y[2]) | (x[3] ^ y[3])) == 0;
+#endif
+}
+
+inline bool operator!=(const PackedPosition& a, const PackedPosition& b)
+{
+    return !(a == b);
+}
+
+// Hashes a packed position. The four words are multiplied independently, so the compiler can do them side by side
+inline uint64_t hashPackedPosition(const PackedPosition& position)
+{
+    uint64_t words[4];
+    std::memcpy(words, &position, sizeof(words));
+    uint64_t hash = (words[0] * 0x9E3779B97F4A7C15ULL) ^ (words[1] * 0xBF58476D1CE4E5B9ULL) ^ (words[2] * 0x94D049BB133111EBULL) ^
+                    (words[3] * 0xD6E8FEB86659FD93ULL);
+    hash ^= hash >> 32;
+    hash *= 0xD6E8FEB86659FD93ULL;
+    return hash ^ (hash >> 29);
+}
+
+// Hash functor for unordered containers of packed positions
+struct PackedPositionHash
+{
+    size_t operator()(const PackedPosition& position) const
+    {
+        return static_cast<size_t>(hashPackedPosition(position));
+    }
+};
+
+/**
+ * @brief Packs an array of positions
+ *
+ * @param boards The positions
+ * @param count Number of positions
+ * @param out Array of count packed positions, those that can't be packed are zeroed
+ * @return Number of positions packed
+ */
+inline size_t packPositions(const Chessboard* boards, size_t count, PackedPosition* out)
+{
+    size_t packed = 0;
+    for (size_t i = 0; i < count; ++i) packed += packPosition(boards[i], out[i]);
+    return packed;
+}
+
+/**
+ * @brief Unpacks an array of positions
+ *
+ * @param in The packed positions
+ * @param count Number of positions
+ * @param boards Array of count boards, those whose packed position is corrupt are left untouched
+ * @return Number of positions unpacked
+ */
+inline size_t unpackPositions(const PackedPosition* in, size_t count, Chessboard* boards)
+{
+    size_t unpacked = 0;
+    for (size_t i = 0; i < count; ++i) unpacked += unpackPosition(in[i], boards[i]);
+    return unpacked;
+}
+#endif
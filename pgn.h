@@ -0,0 +1,364 @@
+#ifndef PGN_H
+#define PGN_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "chess.h"
+#include "mapped_file.h"
+
+// Result of a game as given by its termination marker
+enum class GameResult : uint8_t
+{
+    Unknown,
+    WhiteWins,
+    BlackWins,
+    Draw
+};
+
+// One game of a PGN file, the text points into the reader's mapping
+struct PgnGame
+{
+    std::string_view text;
+    size_t offset;
+};
+
+// A move that could not be replayed
+struct PgnError
+{
+    size_t offset;
+    std::string_view move;
+    SanResult reason;
+};
+
+// Totals of a replay run
+struct PgnReplayStats
+{
+    long long games;
+    long long plies;
+    long long errors;
+    double seconds;
+};
+
+// Returns a printable name for why a move could not be read
+inline const char* sanResultName(SanResult result)
+{
+    switch (result) {
+    case SanResult::Ok:
+        return "ok";
+    case SanResult::Malformed:
+        return "malformed";
+    case SanResult::Illegal:
+        return "illegal";
+    case SanResult::Ambiguous:
+        return "ambiguous";
+    }
+    return "";
+}
+
+// Maps a PGN file and splits it into games without copying any text
+class PgnReader
+{
+private:
+    MappedFile file;
+
+public:
+    /**
+     * @brief Maps a PGN file for reading
+     *
+     * @param path Path of the file
+     * @return true if the file was opened
+     * @return false if the file could not be opened or mapped
+     */
+    bool open(const char* path)
+    {
+        return file.open(path);
+    }
+
+    // Unmaps the file, invalidating every game handed out so far
+    void close()
+    {
+        file.close();
+    }
+
+    // Returns the whole file
+    std::string_view text() const
+    {
+        return file.text();
+    }
+
+    /**
+     * @brief Finds where the first game at or after a byte offset starts. A game starts at a tag line
+     *        whose previous line is not a tag line, so it works from any offset in the file
+     *
+     * @param pos Byte offset to search from
+     * @return Offset of the game start, or the file size if there is none
+     */
+    size_t nextGameStart(size_t pos) const
+    {
+        std::string_view text = file.text();
+
+        // Move to the start of a line and find out whether the line before it is a tag
+        size_t lineStart = pos;
+        if (pos != 0 && text[pos - 1] != '\n') {
+            size_t newline = text.find('\n', pos);
+            if (newline == std::string_view::npos) return text.size();
+            lineStart = newline + 1;
+        }
+        bool prevIsTag = false;
+        if (lineStart >= 2) {
+            size_t newline = text.rfind('\n', lineStart - 2);
+            prevIsTag = text[newline == std::string_view::npos ? 0 : newline + 1] == '[';
+        }
+
+        while (lineStart < text.size()) {
+            bool isTag = text[lineStart] == '[';
+            if (isTag && !prevIsTag) return lineStart;
+            prevIsTag = isTag;
+
+            size_t newline = text.find('\n', lineStart);
+            if (newline == std::string_view::npos) break;
+            lineStart = newline + 1;
+        }
+        return text.size();
+    }
+
+    /**
+     * @brief Reads the game that starts at pos and moves pos to the start of the next one
+     *
+     * @param pos Offset of a game start, as returned by nextGameStart
+     * @param end Games starting at or after this offset are not read
+     * @param game Receives the game
+     * @return true if a game was read
+     * @return false if there are no more games before end
+     */
+    bool nextGame(size_t& pos, size_t end, PgnGame& game) const
+    {
+        std::string_view text = file.text();
+        if (pos >= end || pos >= text.size()) return false;
+
+        size_t next = nextGameStart(pos + 1);
+        game.text = text.substr(pos, next - pos);
+        game.offset = pos;
+        pos = next;
+        return true;
+    }
+};
+
+/**
+ * @brief Returns the value of a tag in a game's tag section, e.g. pgnTag(game, "FEN")
+ *
+ * @param game Text of the game
+ * @param name Name of the tag
+ * @return The value without quotes, or an empty view if the game doesn't have the tag
+ */
+inline std::string_view pgnTag(std::string_view game, std::string_view name)
+{
+    size_t pos = 0;
+    while (pos < game.size() && game[pos] == '[') {
+        size_t lineEnd = game.find('\n', pos);
+        std::string_view line = game.substr(pos, lineEnd == std::string_view::npos ? std::string_view::npos : lineEnd - pos);
+        if (line.size() > name.size() + 1 && line.substr(1, name.size()) == name && line[name.size() + 1] == ' ') {
+            size_t open = line.find('"');
+            size_t close = line.rfind('"');
+            if (open != std::string_view::npos && close > open) return line.substr(open + 1, close - open - 1);
+        }
+        if (lineEnd == std::string_view::npos) break;
+        pos = lineEnd + 1;
+    }
+    return std::string_view();
+}
+
+/**
+ * @brief Replays the moves of a game, skipping comments, variations, NAGs and move numbers
+ *
+ * @param game Game to replay
+ * @param fileStart Start of the file, used to turn positions in the game into file offsets
+ * @param board Receives the final position
+ * @param result Receives the game's termination marker
+ * @param error Receives the first move that could not be played
+ * @param onMove Called as onMove(board, move) before each move is played
+ * @return true if every move was played
+ * @return false if a move was malformed, illegal or ambiguous, or the FEN tag was invalid
+ */
+template <class OnMove>
+bool replayPgnGame(const PgnGame& game, const char* fileStart, Chessboard& board, GameResult& result, PgnError& error, OnMove onMove)
+{
+    std::string_view text = game.text;
+    result = GameResult::Unknown;
+
+    // Games can start from a set up position
+    std::string_view fen = pgnTag(text, "FEN");
+    board = Chessboard();
+    if (!fen.empty() && !board.loadFEN(fen)) {
+        error.offset = fen.data() - fileStart;
+        error.move = fen;
+        error.reason = SanResult::Malformed;
+        return false;
+    }
+
+    size_t i = 0;
+    while (i < text.size()) {
+        char c = text[i];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '.') {
+            ++i;
+        }
+        else if (c == '[') {
+            // Tag pair, the value may contain brackets inside quotes
+            bool quoted = false;
+            while (i < text.size() && (quoted || text[i] != ']')) {
+                if (text[i] == '"') quoted = !quoted;
+                ++i;
+            }
+            ++i;
+        }
+        else if (c == '{') {
+            size_t close = text.find('}', i);
+            i = close == std::string_view::npos ? text.size() : close + 1;
+        }
+        else if (c == ';' || (c == '%' && (i == 0 || text[i - 1] == '\n'))) {
+            size_t newline = text.find('\n', i);
+            i = newline == std::string_view::npos ? text.size() : newline + 1;
+        }
+        else if (c == '(') {
+            // Variations can nest and hold comments with parentheses in them
+            int depth = 0;
+            while (i < text.size()) {
+                if (text[i] == '{') {
+                    size_t close = text.find('}', i);
+                    i = close == std::string_view::npos ? text.size() : close;
+                }
+                else if (text[i] == '(') ++depth;
+                else if (text[i] == ')' && --depth == 0) break;
+                ++i;
+            }
+            ++i;
+        }
+        else if (c == '$') {
+            ++i;
+            while (i < text.size() && text[i] >= '0' && text[i] <= '9') ++i;
+        }
+        else {
+            size_t start = i;
+            while (i < text.size() && text[i] != ' ' && text[i] != '\t' && text[i] != '\r' && text[i] != '\n' &&
+                   text[i] != '{' && text[i] != '(' && text[i] != ')' && text[i] != ';' && text[i] != '$') ++i;
+            std::string_view token = text.substr(start, i - start);
+
+            // Termination marker
+            if (token == "1-0" || token == "0-1" || token == "1/2-1/2" || token == "*") {
+                if (token == "1-0") result = GameResult::WhiteWins;
+                else if (token == "0-1") result = GameResult::BlackWins;
+                else if (token == "1/2-1/2") result = GameResult::Draw;
+                return true;
+            }
+
+            // Move numbers such as "12." or "12...", possibly glued to the move as in "1.e4"
+            size_t digits = 0;
+            while (digits < token.size() && token[digits] >= '0' && token[digits] <= '9') ++digits;
+            if (digits > 0 && digits < token.size() && token[digits] == '.') {
+                while (digits < token.size() && token[digits] == '.') ++digits;
+                token.remove_prefix(digits);
+                if (token.empty()) continue;
+            }
+            else if (digits == token.size()) {
+                continue;
+            }
+
+            Move move;
+            SanResult read = board.parseSAN(token, move);
+            if (read != SanResult::Ok) {
+                error.offset = token.data() - fileStart;
+                error.move = token;
+                error.reason = read;
+                return false;
+            }
+            onMove(static_cast<const Chessboard&>(board), move);
+            board.makeMove(move);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Replays every game of a PGN file in parallel. The file is cut into one byte range per thread,
+ *        each range aligned to a game start, and progress is printed once a second
+ *
+ * @param reader Opened PGN file
+ * @param threads Number of worker threads
+ * @param errors Receives the first bad move of each game that could not be replayed, sorted by offset
+ * @return Totals of the run
+ */
+inline PgnReplayStats replayPgnFile(const PgnReader& reader, int threads, std::vector<PgnError>& errors)
+{
+    if (threads < 1) threads = 1;
+    std::string_view text = reader.text();
+    const char* fileStart = text.data();
+
+    // Split the file into ranges that start at game boundaries
+    std::vector<size_t> bounds(threads + 1);
+    for (int t = 0; t < threads; ++t) bounds[t] = reader.nextGameStart(text.size() / threads * t);
+    bounds[threads] = text.size();
+
+    std::atomic<long long> games(0);
+    std::atomic<long long> plies(0);
+    std::vector<std::vector<PgnError>> threadErrors(threads);
+    auto start = std::chrono::steady_clock::now();
+
+    // The last worker to finish stops the clock and wakes the progress loop, so the time isn't rounded up to its period
+    std::mutex doneMutex;
+    std::condition_variable doneCondition;
+    int running = threads;
+    auto end = start;
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            Chessboard board;
+            PgnGame game;
+            PgnError error;
+            GameResult result;
+            size_t pos = bounds[t];
+            while (reader.nextGame(pos, bounds[t + 1], game)) {
+                long long gamePlies = 0;
+                if (!replayPgnGame(game, fileStart, board, result, error, [&](const Chessboard&, Move) { ++gamePlies; })) {
+                    threadErrors[t].push_back(error);
+                }
+                plies.fetch_add(gamePlies, std::memory_order_relaxed);
+                games.fetch_add(1, std::memory_order_relaxed);
+            }
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (--running == 0) {
+                end = std::chrono::steady_clock::now();
+                doneCondition.notify_one();
+            }
+        });
+    }
+
+    // Report progress once a second while the workers run
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        while (!doneCondition.wait_for(lock, std::chrono::seconds(1), [&]() { return running == 0; })) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Games: " << games.load() << " Games/sec: " << static_cast<long long>(games.load() / seconds) << std::endl;
+        }
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    for (std::vector<PgnError>& list : threadErrors) errors.insert(errors.end(), list.begin(), list.end());
+    std::sort(errors.begin(), errors.end(), [](const PgnError& a, const PgnError& b) { return a.offset < b.offset; });
+
+    PgnReplayStats stats;
+    stats.games = games.load();
+    stats.plies = plies.load();
+    stats.errors = static_cast<long long>(errors.size());
+    stats.seconds = std::chrono::duration<double>(end - start).count();
+    return stats;
+}
+#endif
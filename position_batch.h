@@ -0,0 +1,635 @@
+#ifndef POSITION_BATCH_H
+#define POSITION_BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+#include "chess.h"
+#include "evaluation.h"
+#include "packed_position.h"
+
+/*
+ * Many independent positions in struct of arrays layout: one array of bitboards per color and piece type, with the
+ * same bit numbering as attacks.h. The kernels work on a whole vector of positions at once, one position per 64 bit
+ * lane, so every shift, mask and popcount handles 8 positions with AVX-512, 4 with AVX2 and 1 otherwise. Nothing in
+ * a kernel branches on a single position: where the positions of a vector disagree, e.g. on the side to move, both
+ * answers are computed and the lanes pick theirs with a mask.
+ *
+ * The lane types all offer the same operators, and the kernels are templates over them. Build with -march=native
+ * (or -mavx2, or -mavx512f -mavx512bw) to get the vector versions, otherwise BatchLanes is the scalar one.
+ */
+
+// One position per kernel call, always available. Also runs the positions left over after the last full vector
+struct ScalarLanes
+{
+    static const int WIDTH = 1;
+    uint64_t value;
+
+    static ScalarLanes load(const uint64_t* source) { return { *source }; }
+    static ScalarLanes broadcast(uint64_t x) { return { x }; }
+    void store(uint64_t* destination) const { *destination = value; }
+
+    ScalarLanes operator&(ScalarLanes other) const { return { value & other.value }; }
+    ScalarLanes operator|(ScalarLanes other) const { return { value | other.value }; }
+    ScalarLanes operator^(ScalarLanes other) const { return { value ^ other.value }; }
+    ScalarLanes operator~() const { return { ~value }; }
+    ScalarLanes operator+(ScalarLanes other) const { return { value + other.value }; }
+    ScalarLanes operator-(ScalarLanes other) const { return { value - other.value }; }
+    ScalarLanes operator<<(int bits) const { return { value << bits }; }
+    ScalarLanes operator>>(int bits) const { return { value >> bits }; }
+
+    // All ones in the lanes that aren't zero
+    ScalarLanes nonZero() const { return { value ? ~0ULL : 0 }; }
+    ScalarLanes popcount() const { return { static_cast<uint64_t>(__builtin_popcountll(value)) }; }
+
+    // Multiplies the low 32 bits of the lanes as signed numbers
+    ScalarLanes operator*(ScalarLanes other) const
+    {
+        return { static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(value)) * static_cast<int32_t>(other.value)) };
+    }
+
+    // All ones in the lanes that are negative as signed numbers
+    ScalarLanes negative() const { return { static_cast<int64_t>(value) < 0 ? ~0ULL : 0 }; }
+    bool any() const { return value != 0; }
+};
+
+#if defined(__AVX2__)
+struct Avx2Lanes
+{
+    static const int WIDTH = 4;
+    __m256i value;
+
+    static Avx2Lanes load(const uint64_t* source) { return { _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source)) }; }
+    static Avx2Lanes broadcast(uint64_t x) { return { _mm256_set1_epi64x(static_cast<long long>(x)) }; }
+    void store(uint64_t* destination) const { _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination), value); }
+
+    Avx2Lanes operator&(Avx2Lanes other) const { return { _mm256_and_si256(value, other.value) }; }
+    Avx2Lanes operator|(Avx2Lanes other) const { return { _mm256_or_si256(value, other.value) }; }
+    Avx2Lanes operator^(Avx2Lanes other) const { return { _mm256_xor_si256(value, other.value) }; }
+    Avx2Lanes operator~() const { return { _mm256_xor_si256(value, _mm256_set1_epi64x(-1)) }; }
+    Avx2Lanes operator+(Avx2Lanes other) const { return { _mm256_add_epi64(value, other.value) }; }
+    Avx2Lanes operator-(Avx2Lanes other) const { return { _mm256_sub_epi64(value, other.value) }; }
+    Avx2Lanes operator<<(int bits) const { return { _mm256_slli_epi64(value, bits) }; }
+    Avx2Lanes operator>>(int bits) const { return { _mm256_srli_epi64(value, bits) }; }
+
+    Avx2Lanes nonZero() const { return ~Avx2Lanes{ _mm256_cmpeq_epi64(value, _mm256_setzero_si256()) }; }
+
+    // Counts the bits of every nibble with a table lookup, then adds up the bytes of each lane
+    Avx2Lanes popcount() const
+    {
+        const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i nibble = _mm256_set1_epi8(0x0F);
+        __m256i low = _mm256_shuffle_epi8(table, _mm256_and_si256(value, nibble));
+        __m256i high = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(value, 4), nibble));
+        return { _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256()) };
+    }
+
+    Avx2Lanes operator*(Avx2Lanes other) const { return { _mm256_mul_epi32(value, other.value) }; }
+    Avx2Lanes negative() const { return { _mm256_cmpgt_epi64(_mm256_setzero_si256(), value) }; }
+    bool any() const { return !_mm256_testz_si256(value, value); }
+};
+#endif
+
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+// The shifts, multiply and broadcast are the zero masked forms, the plain ones make GCC 12 warn about its own headers
+struct Avx512Lanes
+{
+    static const int WIDTH = 8;
+    __m512i value;
+
+    static Avx512Lanes load(const uint64_t* source) { return { _mm512_loadu_si512(source) }; }
+    static Avx512Lanes broadcast(uint64_t x) { return { _mm512_set1_epi64(static_cast<long long>(x)) }; }
+    void store(uint64_t* destination) const { _mm512_storeu_si512(destination, value); }
+
+    Avx512Lanes operator&(Avx512Lanes other) const { return { _mm512_and_si512(value, other.value) }; }
+    Avx512Lanes operator|(Avx512Lanes other) const { return { _mm512_or_si512(value, other.value) }; }
+    Avx512Lanes operator^(Avx512Lanes other) const { return { _mm512_xor_si512(value, other.value) }; }
+    Avx512Lanes operator~() const { return { _mm512_xor_si512(value, _mm512_set1_epi64(-1)) }; }
+    Avx512Lanes operator+(Avx512Lanes other) const { return { _mm512_add_epi64(value, other.value) }; }
+    Avx512Lanes operator-(Avx512Lanes other) const { return { _mm512_sub_epi64(value, other.value) }; }
+    Avx512Lanes operator<<(int bits) const { return { _mm512_maskz_slli_epi64(0xFF, value, bits) }; }
+    Avx512Lanes operator>>(int bits) const { return { _mm512_maskz_srli_epi64(0xFF, value, bits) }; }
+
+    Avx512Lanes nonZero() const { return { _mm512_maskz_set1_epi64(_mm512_test_epi64_mask(value, value), -1) }; }
+
+    Avx512Lanes popcount() const
+    {
+#if defined(__AVX512VPOPCNTDQ__)
+        return { _mm512_popcnt_epi64(value) };
+#else
+        const __m512i table = _mm512_maskz_broadcast_i32x4(0xFFFF, _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4));
+        const __m512i nibble = _mm512_set1_epi8(0x0F);
+        __m512i low = _mm512_shuffle_epi8(table, _mm512_and_si512(value, nibble));
+        __m512i high = _mm512_shuffle_epi8(table, _mm512_and_si512(_mm512_srli_epi16(value, 4), nibble));
+        return { _mm512_sad_epu8(_mm512_add_epi8(low, high), _mm512_setzero_si512()) };
+#endif
+    }
+
+    Avx512Lanes operator*(Avx512Lanes other) const { return { _mm512_maskz_mul_epi32(0xFF, value, other.value) }; }
+    Avx512Lanes negative() const { return { _mm512_maskz_set1_epi64(_mm512_cmplt_epi64_mask(value, _mm512_setzero_si512()), -1) }; }
+    bool any() const { return _mm512_test_epi64_mask(value, value) != 0; }
+};
+using BatchLanes = Avx512Lanes;
+#elif defined(__AVX2__)
+using BatchLanes = Avx2Lanes;
+#else
+using BatchLanes = ScalarLanes;
+#endif
+
+static const uint64_t BATCH_COL_A = 0x0101010101010101ULL;
+static const uint64_t BATCH_COL_H = 0x8080808080808080ULL;
+static const uint64_t BATCH_PROMOTION_ROWS = 0xFF000000000000FFULL;
+
+// Moves every lane's squares by a signed number of bits, positive towards white's side
+template <int Bits, class L>
+inline L shiftSquares(L squares)
+{
+    if constexpr (Bits > 0) return squares << Bits;
+    else return squares >> -Bits;
+}
+
+/*
+ * One step in a direction. Bits is how far the square number moves and Landing the squares the step can end on,
+ * which keeps steps from wrapping around to the other side of the board
+ */
+template <int Bits, uint64_t Landing, class L>
+inline L stepSquares(L squares)
+{
+    return shiftSquares<Bits>(squares) & L::broadcast(Landing);
+}
+
+// Squares reached by sliding from every square of a set in one direction, up to and including the first occupied one
+template <int Bits, uint64_t Landing, class L>
+inline L slideSquares(L from, L empty)
+{
+    L open = empty & L::broadcast(Landing);
+    from = from | (open & shiftSquares<Bits>(from));
+    open = open & shiftSquares<Bits>(open);
+    from = from | (open & shiftSquares<2 * Bits>(from));
+    open = open & shiftSquares<2 * Bits>(open);
+    from = from | (open & shiftSquares<4 * Bits>(from));
+    return stepSquares<Bits, Landing>(from);
+}
+
+// The eight directions, row 0 being north
+#define BATCH_NORTH -8, ~0ULL
+#define BATCH_SOUTH 8, ~0ULL
+#define BATCH_EAST 1, ~BATCH_COL_A
+#define BATCH_WEST -1, ~BATCH_COL_H
+#define BATCH_NORTH_EAST -7, ~BATCH_COL_A
+#define BATCH_NORTH_WEST -9, ~BATCH_COL_H
+#define BATCH_SOUTH_EAST 9, ~BATCH_COL_A
+#define BATCH_SOUTH_WEST 7, ~BATCH_COL_H
+
+template <class L>
+inline L selectLanes(L mask, L ifSet, L ifClear)
+{
+    return (ifSet & mask) | (ifClear & ~mask);
+}
+
+template <class L>
+inline L knightAttacks(L knights)
+{
+    return stepSquares<-15, ~BATCH_COL_A>(knights) | stepSquares<-17, ~BATCH_COL_H>(knights) | stepSquares<17, ~BATCH_COL_A>(knights) |
+           stepSquares<15, ~BATCH_COL_H>(knights) | stepSquares<-6, ~(BATCH_COL_A | BATCH_COL_A << 1)>(knights) |
+           stepSquares<-10, ~(BATCH_COL_H | BATCH_COL_H >> 1)>(knights) | stepSquares<10, ~(BATCH_COL_A | BATCH_COL_A << 1)>(knights) |
+           stepSquares<6, ~(BATCH_COL_H | BATCH_COL_H >> 1)>(knights);
+}
+
+template <class L>
+inline L kingAttacks(L kings)
+{
+    return stepSquares<BATCH_NORTH>(kings) | stepSquares<BATCH_SOUTH>(kings) | stepSquares<BATCH_EAST>(kings) | stepSquares<BATCH_WEST>(kings) |
+           stepSquares<BATCH_NORTH_EAST>(kings) | stepSquares<BATCH_NORTH_WEST>(kings) | stepSquares<BATCH_SOUTH_EAST>(kings) |
+           stepSquares<BATCH_SOUTH_WEST>(kings);
+}
+
+// Squares the pawns attack, white pawns in the lanes of the mask and black pawns in the others
+template <class L>
+inline L pawnAttacks(L pawns, L white)
+{
+    L whiteAttacks = stepSquares<BATCH_NORTH_EAST>(pawns) | stepSquares<BATCH_NORTH_WEST>(pawns);
+    L blackAttacks = stepSquares<BATCH_SOUTH_EAST>(pawns) | stepSquares<BATCH_SOUTH_WEST>(pawns);
+    return selectLanes(white, whiteAttacks, blackAttacks);
+}
+
+template <class L>
+inline L diagonalAttacks(L sliders, L empty)
+{
+    return slideSquares<BATCH_NORTH_EAST>(sliders, empty) | slideSquares<BATCH_NORTH_WEST>(sliders, empty) |
+           slideSquares<BATCH_SOUTH_EAST>(sliders, empty) | slideSquares<BATCH_SOUTH_WEST>(sliders, empty);
+}
+
+template <class L>
+inline L orthogonalAttacks(L sliders, L empty)
+{
+    return slideSquares<BATCH_NORTH>(sliders, empty) | slideSquares<BATCH_SOUTH>(sliders, empty) | slideSquares<BATCH_EAST>(sliders, empty) |
+           slideSquares<BATCH_WEST>(sliders, empty);
+}
+
+// Every square one side attacks. pieces is indexed by Type - 1
+template <class L>
+inline L sideAttacks(const L (&pieces)[6], L white, L empty)
+{
+    return pawnAttacks(pieces[0], white) | knightAttacks(pieces[1]) | diagonalAttacks(pieces[2] | pieces[4], empty) |
+           orthogonalAttacks(pieces[3] | pieces[4], empty) | kingAttacks(pieces[5]);
+}
+
+/*
+ * Looks along one line from the king: a slider of the right kind at the end of it gives check, and one behind a
+ * single piece of ours pins that piece to the line
+ */
+template <int Bits, uint64_t Landing, class L>
+inline void scanFromKing(L king, L empty, L ours, L sliders, L& checkers, L& checkLines, L& pinned)
+{
+    L line = slideSquares<Bits, Landing>(king, empty);
+    L checker = line & sliders;
+    checkers = checkers | checker;
+    checkLines = checkLines | (line & checker.nonZero());
+    L blocker = line & ours;
+    pinned = pinned | (blocker & (slideSquares<Bits, Landing>(blocker, empty) & sliders).nonZero());
+}
+
+// Moves of a set of sliders in one direction. Their lines can't overlap, so one popcount counts them all
+template <int Bits, uint64_t Landing, class L>
+inline L countSlides(L sliders, L empty, L destinations)
+{
+    return (slideSquares<Bits, Landing>(sliders, empty) & destinations).popcount();
+}
+
+// Pawn moves to a set of squares, four for every promotion
+template <class L>
+inline L countPawnMoves(L destinations)
+{
+    return destinations.popcount() + (destinations & L::broadcast(BATCH_PROMOTION_ROWS)).popcount() * L::broadcast(3);
+}
+
+// A table of EVAL_TABLES as bit planes: a square is worth base plus 2^k for every plane k it is in
+struct SlicedTable
+{
+    int base;
+    int planeCount;
+    uint64_t planes[16];
+};
+
+struct SlicedEvalTables
+{
+    SlicedTable tables[2][2][6];
+    bool fits;
+};
+
+constexpr SlicedEvalTables makeSlicedEvalTables(const EvalTables& eval)
+{
+    SlicedEvalTables sliced = {};
+    sliced.fits = true;
+    for (int stage = 0; stage < 2; ++stage) {
+        for (int color = 0; color < 2; ++color) {
+            for (int type = 0; type < 6; ++type) {
+                SlicedTable& table = sliced.tables[stage][color][type];
+                const int* values = eval.values[stage][color][type];
+                table.base = values[0];
+                for (int square = 1; square < 64; ++square) table.base = values[square] < table.base ? values[square] : table.base;
+                for (int square = 0; square < 64; ++square) {
+                    int offset = values[square] - table.base;
+                    if (offset >= 1 << 16) sliced.fits = false;
+                    for (int plane = 0; plane < 16; ++plane) {
+                        if (!(offset >> plane & 1)) continue;
+                        table.planes[plane] |= 1ULL << square;
+                        if (plane >= table.planeCount) table.planeCount = plane + 1;
+                    }
+                }
+            }
+        }
+    }
+    return sliced;
+}
+
+static constexpr SlicedEvalTables SLICED_EVAL_TABLES = makeSlicedEvalTables(EVAL_TABLES);
+static_assert(SLICED_EVAL_TABLES.fits, "piece-square values have to stay within 65536 of each other");
+
+/*
+ * Positions in struct of arrays layout for the batched kernels. Add positions, then run a kernel over all of them;
+ * every kernel writes one result per position in the order they were added.
+ */
+class PositionBatch
+{
+private:
+    // Bitboards indexed by [0 white, 1 black][Type - 1]
+    std::vector<uint64_t> pieces[2][6];
+
+    // All ones where black is to move
+    std::vector<uint64_t> blackToMove;
+    std::vector<uint64_t> castlingRights;
+
+    // The square a pawn can be taken on en passant, 0 if none
+    std::vector<uint64_t> enPassant;
+
+    // One vector of positions as the kernels see it, with the pieces by side to move
+    template <class L>
+    struct Lanes
+    {
+        L us[6];
+        L them[6];
+        L black;
+        L castling;
+        L passed;
+
+        Lanes(const PositionBatch& batch, size_t index)
+        {
+            black = L::load(&batch.blackToMove[index]);
+            castling = L::load(&batch.castlingRights[index]);
+            passed = L::load(&batch.enPassant[index]);
+            for (int type = 0; type < 6; ++type) {
+                L white = L::load(&batch.pieces[0][type][index]);
+                L blackPieces = L::load(&batch.pieces[1][type][index]);
+                us[type] = selectLanes(black, blackPieces, white);
+                them[type] = selectLanes(black, white, blackPieces);
+            }
+        }
+    };
+
+    // Runs a kernel over every full vector of positions, then the rest one at a time
+    template <class L, class Kernel>
+    void forEachVector(Kernel kernel) const
+    {
+        size_t index = 0;
+        for (; index + L::WIDTH <= size(); index += L::WIDTH) kernel(L(), index);
+        for (; index < size(); ++index) kernel(ScalarLanes(), index);
+    }
+
+    template <class L>
+    static L legalMoveCount(const Lanes<L>& p)
+    {
+        const L none = L::broadcast(0);
+        L ours = p.us[0] | p.us[1] | p.us[2] | p.us[3] | p.us[4] | p.us[5];
+        L theirs = p.them[0] | p.them[1] | p.them[2] | p.them[3] | p.them[4] | p.them[5];
+        L occupied = ours | theirs;
+        L empty = ~occupied;
+        L king = p.us[5];
+        L diagonal = p.them[2] | p.them[4];
+        L orthogonal = p.them[3] | p.them[4];
+
+        // The king can't step back along a line it is checked on, so the other side's sliders look through it
+        L danger = sideAttacks(p.them, p.black, empty | king);
+
+        L checkers = (knightAttacks(king) & p.them[1]) | (pawnAttacks(king, ~p.black) & p.them[0]);
+        L stepCheckers = checkers;
+        L checkLines = none;
+        L pinned[4] = { none, none, none, none };
+        scanFromKing<BATCH_NORTH>(king, empty, ours, orthogonal, checkers, checkLines, pinned[0]);
+        scanFromKing<BATCH_SOUTH>(king, empty, ours, orthogonal, checkers, checkLines, pinned[0]);
+        scanFromKing<BATCH_EAST>(king, empty, ours, orthogonal, checkers, checkLines, pinned[1]);
+        scanFromKing<BATCH_WEST>(king, empty, ours, orthogonal, checkers, checkLines, pinned[1]);
+        scanFromKing<BATCH_NORTH_EAST>(king, empty, ours, diagonal, checkers, checkLines, pinned[2]);
+        scanFromKing<BATCH_SOUTH_WEST>(king, empty, ours, diagonal, checkers, checkLines, pinned[2]);
+        scanFromKing<BATCH_NORTH_WEST>(king, empty, ours, diagonal, checkers, checkLines, pinned[3]);
+        scanFromKing<BATCH_SOUTH_EAST>(king, empty, ours, diagonal, checkers, checkLines, pinned[3]);
+
+        // Out of check every move but the king's has to take the checker or block its line. In double check none can
+        L inCheck = checkers.nonZero();
+        L doubleCheck = (checkers & (checkers - L::broadcast(1))).nonZero();
+        L evasions = selectLanes(inCheck, checkLines | checkers, ~none) & ~doubleCheck;
+        L destinations = ~ours & evasions;
+
+        // A pinned piece can still move along the line it is pinned on, which never leaves the line
+        L anyPin = pinned[0] | pinned[1] | pinned[2] | pinned[3];
+        L alongFile = ~anyPin | pinned[0];
+        L alongRow = ~anyPin | pinned[1];
+        L alongRising = ~anyPin | pinned[2];
+        L alongFalling = ~anyPin | pinned[3];
+
+        L count = (kingAttacks(king) & ~ours & ~danger).popcount();
+
+        L knights = p.us[1] & ~anyPin;
+        count = count + (stepSquares<-15, ~BATCH_COL_A>(knights) & destinations).popcount();
+        count = count + (stepSquares<-17, ~BATCH_COL_H>(knights) & destinations).popcount();
+        count = count + (stepSquares<17, ~BATCH_COL_A>(knights) & destinations).popcount();
+        count = count + (stepSquares<15, ~BATCH_COL_H>(knights) & destinations).popcount();
+        count = count + (stepSquares<-6, ~(BATCH_COL_A | BATCH_COL_A << 1)>(knights) & destinations).popcount();
+        count = count + (stepSquares<-10, ~(BATCH_COL_H | BATCH_COL_H >> 1)>(knights) & destinations).popcount();
+        count = count + (stepSquares<10, ~(BATCH_COL_A | BATCH_COL_A << 1)>(knights) & destinations).popcount();
+        count = count + (stepSquares<6, ~(BATCH_COL_H | BATCH_COL_H >> 1)>(knights) & destinations).popcount();
+
+        L bishops = p.us[2] | p.us[4];
+        L rooks = p.us[3] | p.us[4];
+        count = count + countSlides<BATCH_NORTH>(rooks & alongFile, empty, destinations);
+        count = count + countSlides<BATCH_SOUTH>(rooks & alongFile, empty, destinations);
+        count = count + countSlides<BATCH_EAST>(rooks & alongRow, empty, destinations);
+        count = count + countSlides<BATCH_WEST>(rooks & alongRow, empty, destinations);
+        count = count + countSlides<BATCH_NORTH_EAST>(bishops & alongRising, empty, destinations);
+        count = count + countSlides<BATCH_SOUTH_WEST>(bishops & alongRising, empty, destinations);
+        count = count + countSlides<BATCH_NORTH_WEST>(bishops & alongFalling, empty, destinations);
+        count = count + countSlides<BATCH_SOUTH_EAST>(bishops & alongFalling, empty, destinations);
+
+        // Pawns, white ones moving north and black ones south
+        L pawns = p.us[0];
+        L pushers = pawns & alongFile;
+        L single = selectLanes(p.black, stepSquares<BATCH_SOUTH>(pushers), stepSquares<BATCH_NORTH>(pushers)) & empty;
+        L twice = selectLanes(p.black, stepSquares<BATCH_SOUTH>(single & L::broadcast(0xFFULL << 16)),
+                              stepSquares<BATCH_NORTH>(single & L::broadcast(0xFFULL << 40))) &
+                  empty;
+        L captureEast = selectLanes(p.black, stepSquares<BATCH_SOUTH_EAST>(pawns & alongFalling), stepSquares<BATCH_NORTH_EAST>(pawns & alongRising));
+        L captureWest = selectLanes(p.black, stepSquares<BATCH_SOUTH_WEST>(pawns & alongRising), stepSquares<BATCH_NORTH_WEST>(pawns & alongFalling));
+        count = count + countPawnMoves(single & evasions) + (twice & evasions).popcount();
+        count = count + countPawnMoves(captureEast & theirs & evasions) + countPawnMoves(captureWest & theirs & evasions);
+
+        // Castling. The rights are only kept while the king and rook are at home, and the king can't castle out of,
+        // through or into check
+        L rights = p.castling & selectLanes(p.black, L::broadcast(Chessboard::CASTLE_BLACK_KING_SIDE | Chessboard::CASTLE_BLACK_QUEEN_SIDE),
+                                            L::broadcast(Chessboard::CASTLE_WHITE_KING_SIDE | Chessboard::CASTLE_WHITE_QUEEN_SIDE));
+        const uint8_t sides[4] = { Chessboard::CASTLE_WHITE_KING_SIDE, Chessboard::CASTLE_WHITE_QUEEN_SIDE, Chessboard::CASTLE_BLACK_KING_SIDE,
+                                   Chessboard::CASTLE_BLACK_QUEEN_SIDE };
+        for (int side = 0; side < 4; ++side) {
+            uint64_t row = side < 2 ? 7 : 0;
+            uint64_t between = (side % 2 ? 0x0EULL : 0x60ULL) << (row * 8);
+            uint64_t path = (side % 2 ? 0x1CULL : 0x70ULL) << (row * 8);
+            L allowed = (rights & L::broadcast(sides[side])).nonZero() & ~(occupied & L::broadcast(between)).nonZero() &
+                        ~(danger & L::broadcast(path)).nonZero();
+            count = count + (allowed & L::broadcast(1));
+        }
+
+        // En passant, checked in full by looking from the king along every line once both pawns are gone
+        if (p.passed.any()) {
+            L taken = selectLanes(p.black, stepSquares<BATCH_NORTH>(p.passed), stepSquares<BATCH_SOUTH>(p.passed));
+            L candidates[2] = { stepSquares<BATCH_EAST>(taken) & pawns, stepSquares<BATCH_WEST>(taken) & pawns };
+            for (L capturer : candidates) {
+                L after = ~((occupied ^ capturer ^ taken) | p.passed);
+                L attacked = (diagonalAttacks(king, after) & diagonal) | (orthogonalAttacks(king, after) & orthogonal) | (stepCheckers & ~taken);
+                count = count + (capturer.nonZero() & ~attacked.nonZero() & L::broadcast(1));
+            }
+        }
+        return count;
+    }
+
+    // The evaluation of evaluatePosition. The piece-square sums are popcounts of the bit planes of the tables
+    template <class L>
+    L evaluation(size_t index) const
+    {
+        L middlegame = L::broadcast(0);
+        L endgame = L::broadcast(0);
+        L phase = L::broadcast(0);
+        for (int color = 0; color < 2; ++color) {
+            for (int type = 0; type < 6; ++type) {
+                L squares = L::load(&pieces[color][type][index]);
+                L count = squares.popcount();
+                phase = phase + count * L::broadcast(EVAL_PHASE_WEIGHTS[type]);
+                L sums[2];
+                for (int stage = 0; stage < 2; ++stage) {
+                    const SlicedTable& table = SLICED_EVAL_TABLES.tables[stage][color][type];
+                    sums[stage] = count * L::broadcast(static_cast<uint64_t>(static_cast<int64_t>(table.base)));
+                    for (int plane = 0; plane < table.planeCount; ++plane) {
+                        sums[stage] = sums[stage] + ((squares & L::broadcast(table.planes[plane])).popcount() << plane);
+                    }
+                }
+                middlegame = middlegame + sums[0];
+                endgame = endgame + sums[1];
+            }
+        }
+        const L maximum = L::broadcast(EVAL_PHASE_MAX);
+        phase = selectLanes((maximum - phase).negative(), maximum, phase);
+        L blended = middlegame * phase + endgame * (maximum - phase);
+
+        // Divided by EVAL_PHASE_MAX = 24 rounding towards zero like the scalar code: x / 24 is (x / 8) / 3, and
+        // (y * 0x55555556) >> 32 is y / 3 for every y below 2^31
+        L sign = blended.negative();
+        L magnitude = (blended ^ sign) - sign;
+        L score = ((magnitude >> 3) * L::broadcast(0x55555556)) >> 32;
+        score = (score ^ sign) - sign;
+        L toMove = L::load(&blackToMove[index]);
+        return (score ^ toMove) - toMove;
+    }
+
+public:
+    size_t size() const
+    {
+        return blackToMove.size();
+    }
+
+    void clear()
+    {
+        for (int side = 0; side < 2; ++side) {
+            for (int type = 0; type < 6; ++type) pieces[side][type].clear();
+        }
+        blackToMove.clear();
+        castlingRights.clear();
+        enPassant.clear();
+    }
+
+    void reserve(size_t count)
+    {
+        for (int side = 0; side < 2; ++side) {
+            for (int type = 0; type < 6; ++type) pieces[side][type].reserve(count);
+        }
+        blackToMove.reserve(count);
+        castlingRights.reserve(count);
+        enPassant.reserve(count);
+    }
+
+    // Adds a position to the end of the batch
+    void add(const Chessboard& board)
+    {
+        uint64_t bitboards[2][6] = {};
+        for (uint64_t squares = board.getOccupied(); squares; squares &= squares - 1) {
+            int square = __builtin_ctzll(squares);
+            Piece piece = board.getPiece(square / 8, square % 8);
+            bitboards[piece.getColor() == Color::Black][static_cast<int>(piece.getType()) - 1] |= 1ULL << square;
+        }
+        int passedCol = board.getEnPassantCol();
+        uint64_t passed = passedCol == -1 ? 0 : squareBit(board.isBlackToMove() ? 5 : 2, passedCol);
+        append(bitboards, board.isBlackToMove(), board.getCastlingRights(), passed);
+    }
+
+    /**
+     * @brief Adds a packed position to the end of the batch, straight from its nibbles
+     *
+     * @param position The packed position
+     * @return false if the packed position is corrupt, in which case nothing is added
+     */
+    bool add(const PackedPosition& position)
+    {
+        uint64_t bitboards[2][6] = {};
+        uint64_t passed = 0;
+        bool black = position.state & 1;
+        int index = 0;
+        for (uint64_t squares = position.occupancy; squares; squares &= squares - 1, ++index) {
+            if (index == 32) return false;
+            int square = __builtin_ctzll(squares);
+            int code = (position.pieces[index / 2] >> (4 * (index % 2))) & 15;
+            int type = code & 7;
+            if (type == 0) return false;
+            if (type == PACKED_PASSED_PAWN) {
+                type = static_cast<int>(Type::Pawn);
+                passed = 1ULL << (square + (black ? 8 : -8));
+            }
+            bitboards[(code & PACKED_BLACK) != 0][type - 1] |= 1ULL << square;
+        }
+        if (__builtin_popcountll(bitboards[0][5]) != 1 || __builtin_popcountll(bitboards[1][5]) != 1) return false;
+        append(bitboards, black, (position.state >> 1) & 15, passed);
+        return true;
+    }
+
+    // Writes the number of legal moves of every position, the same as Chessboard::generateMoves returns
+    template <class L = BatchLanes>
+    void countLegalMoves(int* counts) const
+    {
+        forEachVector<L>([&](auto lanes, size_t index) {
+            using V = decltype(lanes);
+            uint64_t results[V::WIDTH];
+            legalMoveCount(Lanes<V>(*this, index)).store(results);
+            for (int lane = 0; lane < V::WIDTH; ++lane) counts[index + lane] = static_cast<int>(results[lane]);
+        });
+    }
+
+    // Writes the squares white and black attack in every position
+    template <class L = BatchLanes>
+    void attackMaps(uint64_t* white, uint64_t* black) const
+    {
+        forEachVector<L>([&](auto lanes, size_t index) {
+            using V = decltype(lanes);
+            V side[2][6];
+            for (int color = 0; color < 2; ++color) {
+                for (int type = 0; type < 6; ++type) side[color][type] = V::load(&pieces[color][type][index]);
+            }
+            V occupied = V::broadcast(0);
+            for (int type = 0; type < 6; ++type) occupied = occupied | side[0][type] | side[1][type];
+            sideAttacks(side[0], ~V::broadcast(0), ~occupied).store(&white[index]);
+            sideAttacks(side[1], V::broadcast(0), ~occupied).store(&black[index]);
+        });
+    }
+
+    // Writes the static evaluation of every position, the same as evaluatePosition returns
+    template <class L = BatchLanes>
+    void evaluate(int* scores) const
+    {
+        forEachVector<L>([&](auto lanes, size_t index) {
+            using V = decltype(lanes);
+            uint64_t results[V::WIDTH];
+            evaluation<V>(index).store(results);
+            for (int lane = 0; lane < V::WIDTH; ++lane) scores[index + lane] = static_cast<int>(static_cast<int64_t>(results[lane]));
+        });
+    }
+
+private:
+    void append(const uint64_t (&bitboards)[2][6], bool black, uint8_t rights, uint64_t passed)
+    {
+        for (int side = 0; side < 2; ++side) {
+            for (int type = 0; type < 6; ++type) pieces[side][type].push_back(bitboards[side][type]);
+        }
+        blackToMove.push_back(black ? ~0ULL : 0);
+        castlingRights.push_back(rights);
+        enPassant.push_back(passed);
+    }
+};
+
+#undef BATCH_NORTH
+#undef BATCH_SOUTH
+#undef BATCH_EAST
+#undef BATCH_WEST
+#undef BATCH_NORTH_EAST
+#undef BATCH_NORTH_WEST
+#undef BATCH_SOUTH_EAST
+#undef BATCH_SOUTH_WEST
+#endif
@@ -0,0 +1,298 @@
+#ifndef POSITION_INDEX_H
+#define POSITION_INDEX_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include "chess.h"
+#include "game_record.h"
+#include "mapped_file.h"
+
+/*
+ * Position index file: a 32 byte header followed by 16 byte entries sorted by key, then game, then ply.
+ * Every position of every game has an entry, including the start position (ply 0) and the final position.
+ */
+
+static const char POSITION_INDEX_MAGIC[8] = { 'C', 'H', 'E', 'S', 'S', 'I', 'X', '1' };
+static const uint32_t POSITION_INDEX_VERSION = 1;
+
+struct PositionIndexHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t entryCount;
+    uint64_t gameCount;
+};
+static_assert(sizeof(PositionIndexHeader) == 32, "the index header is part of the format");
+
+struct PositionIndexEntry
+{
+    uint64_t key;
+    uint32_t game;
+    uint16_t ply;
+    uint16_t reserved;
+
+    bool operator<(const PositionIndexEntry& other) const
+    {
+        if (key != other.key) return key < other.key;
+        if (game != other.game) return game < other.game;
+        return ply < other.ply;
+    }
+};
+static_assert(sizeof(PositionIndexEntry) == 16, "index entries are part of the format");
+
+// Totals of an index build
+struct PositionIndexStats
+{
+    long long games;
+    long long skipped;
+    long long entries;
+    int runs;
+};
+
+// Number of runs merged at once, so the build keeps few files open however many runs it spills
+static const size_t POSITION_INDEX_MERGE_FAN_IN = 64;
+
+/**
+ * @brief Merges sorted run files into one sorted stream, reading each run through a small buffered stream
+ *
+ * @param runs Paths of the runs to merge
+ * @param out File to write the merged entries to
+ * @param written Receives the number of entries written
+ * @return false if a run could not be read or an entry could not be written
+ */
+inline bool mergePositionRuns(const std::vector<std::string>& runs, FILE* out, uint64_t& written)
+{
+    written = 0;
+    bool ok = true;
+    std::vector<FILE*> inputs;
+    for (const std::string& path : runs) {
+        FILE* run = fopen(path.c_str(), "rb");
+        if (!run) {
+            ok = false;
+            break;
+        }
+        setvbuf(run, nullptr, _IOFBF, 1 << 16);
+        inputs.push_back(run);
+    }
+
+    typedef std::pair<PositionIndexEntry, size_t> HeapItem;
+    auto later = [](const HeapItem& a, const HeapItem& b) { return b.first < a.first; };
+    std::priority_queue<HeapItem, std::vector<HeapItem>, decltype(later)> heap(later);
+    PositionIndexEntry entry;
+    for (size_t i = 0; ok && i < inputs.size(); ++i) {
+        if (fread(&entry, sizeof(entry), 1, inputs[i]) == 1) heap.push({ entry, i });
+    }
+    while (ok && !heap.empty()) {
+        HeapItem top = heap.top();
+        heap.pop();
+        if (fwrite(&top.first, sizeof(top.first), 1, out) != 1) {
+            ok = false;
+            break;
+        }
+        written++;
+        if (fread(&entry, sizeof(entry), 1, inputs[top.second]) == 1) heap.push({ entry, top.second });
+    }
+
+    // A read error ends a run early just like its end would, so check for it explicitly
+    for (FILE* run : inputs) {
+        if (ferror(run)) ok = false;
+        fclose(run);
+    }
+    return ok;
+}
+
+/**
+ * @brief Builds a position index from a game record file with an external merge sort. Worker threads replay
+ *        batches of games into their own fixed size buffer, and each full buffer is sorted and spilled to a run
+ *        file. The runs are then merged into the index, at most POSITION_INDEX_MERGE_FAN_IN at a time with extra
+ *        passes over longer runs when there are more, so memory and open files stay bounded however big the archive is
+ *
+ * @param recordPath Game record file to index, game ids are the game numbers in this file
+ * @param indexPath Path of the index to write, the runs are written next to it and removed afterwards
+ * @param threads Number of worker threads
+ * @param memoryBytes Memory to use for the sort buffers of all threads together. The merge adds its own stream
+ *        buffers of 64 KB per run merged at once
+ * @param stats Receives the totals of the build
+ * @return true if the index was written
+ * @return false if a file could not be opened, read or written, in which case no index is left behind
+ */
+inline bool buildPositionIndex(const char* recordPath, const char* indexPath, int threads, size_t memoryBytes, PositionIndexStats& stats)
+{
+    stats = PositionIndexStats();
+    GameRecordReader records;
+    if (!records.open(recordPath)) return false;
+    if (threads < 1) threads = 1;
+
+    size_t bufferEntries = std::max<size_t>(memoryBytes / threads / sizeof(PositionIndexEntry), 1);
+    std::atomic<uint64_t> nextGame(0);
+    std::atomic<long long> skipped(0);
+    std::atomic<long long> entries(0);
+    std::atomic<bool> failed(false);
+    std::mutex runsMutex;
+    std::vector<std::string> runs;
+
+    // Sorts a buffer and writes it out as a run
+    auto spill = [&](std::vector<PositionIndexEntry>& buffer) {
+        if (buffer.empty()) return;
+        std::sort(buffer.begin(), buffer.end());
+        std::string path;
+        {
+            std::lock_guard<std::mutex> lock(runsMutex);
+            path = std::string(indexPath) + ".run" + std::to_string(runs.size());
+            runs.push_back(path);
+        }
+        FILE* run = fopen(path.c_str(), "wb");
+        if (!run || fwrite(buffer.data(), sizeof(PositionIndexEntry), buffer.size(), run) != buffer.size()) failed = true;
+        if (run && fclose(run) != 0) failed = true;
+        buffer.clear();
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&]() {
+            std::vector<PositionIndexEntry> buffer;
+            buffer.reserve(bufferEntries);
+            const uint64_t batch = 256;
+            for (;;) {
+                uint64_t first = nextGame.fetch_add(batch);
+                if (first >= records.size()) break;
+                uint64_t last = std::min<uint64_t>(first + batch, records.size());
+                for (uint64_t number = first; number < last; ++number) {
+                    GameRecordView game;
+                    Chessboard board;
+                    if (!records.game(number, game) || (!game.fen.empty() && !board.loadFEN(game.fen))) {
+                        skipped++;
+                        continue;
+                    }
+                    for (int ply = 0; ply <= game.plyCount; ++ply) {
+                        if (buffer.size() == bufferEntries) spill(buffer);
+                        buffer.push_back({ board.getKey(), static_cast<uint32_t>(number), static_cast<uint16_t>(ply), 0 });
+                        entries++;
+                        if (ply < game.plyCount && !board.makeMove(game.move(ply))) break;
+                    }
+                }
+            }
+            spill(buffer);
+        });
+    }
+    for (std::thread& worker : workers) worker.join();
+
+    stats.games = static_cast<long long>(records.size()) - skipped.load();
+    stats.skipped = skipped.load();
+    stats.entries = entries.load();
+    stats.runs = static_cast<int>(runs.size());
+    auto removeRuns = [&]() {
+        for (const std::string& path : runs) remove(path.c_str());
+    };
+    if (failed) {
+        removeRuns();
+        return false;
+    }
+
+    // Merge groups of runs into longer runs until a single merge can write the index
+    size_t runNumber = runs.size();
+    while (runs.size() > POSITION_INDEX_MERGE_FAN_IN) {
+        std::vector<std::string> merged;
+        bool ok = true;
+        for (size_t first = 0; ok && first < runs.size(); first += POSITION_INDEX_MERGE_FAN_IN) {
+            std::vector<std::string> group(runs.begin() + first, runs.begin() + std::min(first + POSITION_INDEX_MERGE_FAN_IN, runs.size()));
+            std::string path = std::string(indexPath) + ".run" + std::to_string(runNumber++);
+            merged.push_back(path);
+            FILE* run = fopen(path.c_str(), "wb");
+            uint64_t written;
+            ok = run && mergePositionRuns(group, run, written);
+            if (run && fclose(run) != 0) ok = false;
+            for (const std::string& input : group) remove(input.c_str());
+        }
+        if (!ok) {
+            runs.insert(runs.end(), merged.begin(), merged.end());
+            removeRuns();
+            return false;
+        }
+        runs.swap(merged);
+    }
+
+    FILE* out = fopen(indexPath, "wb");
+    if (!out) {
+        removeRuns();
+        return false;
+    }
+    setvbuf(out, nullptr, _IOFBF, 1 << 20);
+    PositionIndexHeader header;
+    memcpy(header.magic, POSITION_INDEX_MAGIC, sizeof(header.magic));
+    header.version = POSITION_INDEX_VERSION;
+    header.reserved = 0;
+    header.entryCount = static_cast<uint64_t>(stats.entries);
+    header.gameCount = records.size();
+    uint64_t written = 0;
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 && mergePositionRuns(runs, out, written) && written == header.entryCount;
+    removeRuns();
+    if (fclose(out) != 0) ok = false;
+    if (!ok) remove(indexPath);
+    return ok;
+}
+
+// Read only position index, searched in place through a memory mapping
+class PositionIndex
+{
+private:
+    MappedFile file;
+    const PositionIndexEntry* entries;
+    uint64_t count;
+
+public:
+    PositionIndex() : entries(nullptr), count(0) {}
+
+    /**
+     * @brief Maps an index file and checks its header
+     *
+     * @param path Path of the index
+     * @return true if the file is a valid index
+     * @return false if the file could not be mapped or is not an index
+     */
+    bool open(const char* path)
+    {
+        entries = nullptr;
+        count = 0;
+        if (!file.open(path, false) || file.length() < sizeof(PositionIndexHeader)) return false;
+
+        const PositionIndexHeader* header = reinterpret_cast<const PositionIndexHeader*>(file.begin());
+        if (memcmp(header->magic, POSITION_INDEX_MAGIC, sizeof(header->magic)) != 0 || header->version != POSITION_INDEX_VERSION) return false;
+        if (sizeof(PositionIndexHeader) + header->entryCount * sizeof(PositionIndexEntry) > file.length()) return false;
+
+        entries = reinterpret_cast<const PositionIndexEntry*>(file.begin() + sizeof(PositionIndexHeader));
+        count = header->entryCount;
+        return true;
+    }
+
+    // Returns the number of entries in the index
+    uint64_t size() const
+    {
+        return count;
+    }
+
+    /**
+     * @brief Finds every game that reached a position
+     *
+     * @param key Zobrist key of the position
+     * @param first Receives the first matching entry
+     * @param last Receives one past the last matching entry
+     * @return Number of matching entries, sorted by game and ply
+     */
+    uint64_t find(uint64_t key, const PositionIndexEntry*& first, const PositionIndexEntry*& last) const
+    {
+        first = std::lower_bound(entries, entries + count, key, [](const PositionIndexEntry& entry, uint64_t value) { return entry.key < value; });
+        last = std::upper_bound(first, entries + count, key, [](uint64_t value, const PositionIndexEntry& entry) { return value < entry.key; });
+        return static_cast<uint64_t>(last - first);
+    }
+};
+#endif
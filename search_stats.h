@@ -0,0 +1,170 @@
+#ifndef SEARCH_STATS_H
+#define SEARCH_STATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+ * Counters of what the search spends its nodes and time on. Every search thread keeps its own counters and the
+ * engine adds them up when the search ends, so counting never touches shared memory. They are only compiled in
+ * when CHESS_SEARCH_STATS is defined, e.g. with -DCHESS_SEARCH_STATS, otherwise the SEARCH_STAT and SEARCH_TIMER
+ * macros expand to nothing and the search is exactly the release build.
+ */
+
+// Reads the processor's cycle counter, or a nanosecond clock where there is none
+inline uint64_t readCycles()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct SearchStats
+{
+    static const int MAX_DEPTH = 64;
+
+    // The parts of a node that are timed
+    enum Timer
+    {
+        MoveGeneration,
+        MakeMove,
+        Evaluation,
+        CheckDetection,
+        TIMER_COUNT
+    };
+
+    uint64_t nodes;
+    uint64_t leafNodes;
+    uint64_t hashProbes;
+    uint64_t hashHits;
+    uint64_t hashCutoffs;
+    uint64_t betaCutoffs;
+    uint64_t firstMoveCutoffs;
+    uint64_t cycles;
+    uint64_t timerCycles[TIMER_COUNT];
+    uint64_t timerCalls[TIMER_COUNT];
+
+    // Nodes and cycles of each iteration, indexed by depth
+    uint64_t depthNodes[MAX_DEPTH + 1];
+    uint64_t depthCycles[MAX_DEPTH + 1];
+
+    SearchStats()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        *this = SearchStats(0);
+    }
+
+    // Adds the counters of another thread
+    void add(const SearchStats& other)
+    {
+        nodes += other.nodes;
+        leafNodes += other.leafNodes;
+        hashProbes += other.hashProbes;
+        hashHits += other.hashHits;
+        hashCutoffs += other.hashCutoffs;
+        betaCutoffs += other.betaCutoffs;
+        firstMoveCutoffs += other.firstMoveCutoffs;
+        cycles += other.cycles;
+        for (int i = 0; i < TIMER_COUNT; ++i) {
+            timerCycles[i] += other.timerCycles[i];
+            timerCalls[i] += other.timerCalls[i];
+        }
+        for (int depth = 0; depth <= MAX_DEPTH; ++depth) {
+            depthNodes[depth] += other.depthNodes[depth];
+            depthCycles[depth] += other.depthCycles[depth];
+        }
+    }
+
+    // Returns how many times more nodes an iteration took than the one before it, 0 if either didn't run
+    double branchingFactor(int depth) const
+    {
+        if (depth < 2 || depth > MAX_DEPTH || !depthNodes[depth] || !depthNodes[depth - 1]) return 0;
+        return static_cast<double>(depthNodes[depth]) / depthNodes[depth - 1];
+    }
+
+    // Writes the counters as one JSON object
+    std::string toJson() const
+    {
+        static const char* const timerNames[TIMER_COUNT] = { "move_generation", "make_move", "evaluation", "check_detection" };
+        char buffer[256];
+        std::string json;
+        snprintf(buffer, sizeof(buffer), "{\"nodes\":%llu,\"leaf_nodes\":%llu,\"cycles\":%llu,", ull(nodes), ull(leafNodes), ull(cycles));
+        json += buffer;
+        snprintf(buffer, sizeof(buffer), "\"hash\":{\"probes\":%llu,\"hits\":%llu,\"cutoffs\":%llu},", ull(hashProbes), ull(hashHits), ull(hashCutoffs));
+        json += buffer;
+        snprintf(buffer, sizeof(buffer), "\"cutoffs\":{\"beta\":%llu,\"first_move\":%llu,\"first_move_rate\":%.4f},", ull(betaCutoffs),
+                 ull(firstMoveCutoffs), betaCutoffs ? static_cast<double>(firstMoveCutoffs) / betaCutoffs : 0.0);
+        json += buffer;
+        json += "\"timers\":{";
+        for (int i = 0; i < TIMER_COUNT; ++i) {
+            snprintf(buffer, sizeof(buffer), "%s\"%s\":{\"calls\":%llu,\"cycles\":%llu}", i ? "," : "", timerNames[i], ull(timerCalls[i]),
+                     ull(timerCycles[i]));
+            json += buffer;
+        }
+        json += "},\"depths\":[";
+        bool first = true;
+        for (int depth = 1; depth <= MAX_DEPTH; ++depth) {
+            if (!depthNodes[depth]) continue;
+            snprintf(buffer, sizeof(buffer), "%s{\"depth\":%d,\"nodes\":%llu,\"cycles\":%llu,\"branching_factor\":%.3f}", first ? "" : ",", depth,
+                     ull(depthNodes[depth]), ull(depthCycles[depth]), branchingFactor(depth));
+            json += buffer;
+            first = false;
+        }
+        json += "]}";
+        return json;
+    }
+
+private:
+    // Zero initialization, used by clear
+    explicit SearchStats(int) : nodes(0), leafNodes(0), hashProbes(0), hashHits(0), hashCutoffs(0), betaCutoffs(0), firstMoveCutoffs(0), cycles(0),
+                                timerCycles(), timerCalls(), depthNodes(), depthCycles() {}
+
+    static unsigned long long ull(uint64_t value)
+    {
+        return static_cast<unsigned long long>(value);
+    }
+};
+
+#ifdef CHESS_SEARCH_STATS
+
+// Adds the cycles between its construction and destruction to one of the timers
+class ScopedCycleTimer
+{
+private:
+    SearchStats& stats;
+    SearchStats::Timer timer;
+    uint64_t start;
+
+public:
+    ScopedCycleTimer(SearchStats& searchStats, SearchStats::Timer which) : stats(searchStats), timer(which), start(readCycles()) {}
+
+    ~ScopedCycleTimer()
+    {
+        stats.timerCycles[timer] += readCycles() - start;
+        stats.timerCalls[timer]++;
+    }
+};
+
+#define SEARCH_STAT(statement) statement
+#define SEARCH_TIMER_NAME(line) searchTimer##line
+#define SEARCH_TIMER_AT(stats, timer, line) ScopedCycleTimer SEARCH_TIMER_NAME(line)(stats, SearchStats::timer)
+#define SEARCH_TIMER(stats, timer) SEARCH_TIMER_AT(stats, timer, __LINE__)
+
+#else
+
+#define SEARCH_STAT(statement)
+#define SEARCH_TIMER(stats, timer)
+
+#endif
+#endif
@@ -0,0 +1,229 @@
+#ifndef SELFPLAY_H
+#define SELFPLAY_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "chess.h"
+#include "engine.h"
+#include "epd.h"
+#include "training_data.h"
+
+// What the self-play generator plays
+struct SelfPlayConfig
+{
+    int games = 1000;
+    int threads = 1;
+
+    // Every move is searched with these limits, by a one thread engine per game thread with a hash table of hash MB
+    SearchLimits limits;
+    int hash = 4;
+
+    // Games start from an opening of openingsPath, or the initial position, followed by randomPlies random moves
+    std::string openingsPath;
+    int randomPlies = 8;
+
+    // Game g plays the same moves for the same seed, whichever thread plays it
+    uint64_t seed = 1;
+
+    // Adjudication: drawn after maxPlies, won once the score stays at least resignScore for resignPlies plies, drawn
+    // once it stays within drawScore for drawPlies plies after drawPly
+    int maxPlies = 400;
+    int resignScore = 1500;
+    int resignPlies = 6;
+    int drawScore = 10;
+    int drawPlies = 16;
+    int drawPly = 80;
+
+    // Records each thread collects before appending them to the file
+    size_t bufferRecords = 1 << 15;
+
+    SelfPlayConfig()
+    {
+        limits.depth = 4;
+    }
+};
+
+// How far a self-play run has got
+struct SelfPlayProgress
+{
+    long long games;
+    long long positions;
+    double seconds;
+};
+
+/**
+ * @brief Generates training data by self-play, one game per thread at a time. Positions are recorded with the score
+ *        of the search that moved from them and labeled with the result once the game is over. Only quiet positions
+ *        are kept: the side to move isn't in check, the best move isn't a capture or promotion and the score isn't
+ *        a mate, so a static evaluation can be fitted to them
+ */
+class SelfPlayGenerator
+{
+private:
+    SelfPlayConfig config;
+    std::vector<std::string> openings;
+    TrainingDataWriter writer;
+    std::atomic<int> nextGame;
+    std::atomic<long long> gamesPlayed;
+    std::atomic<long long> positionsWritten;
+
+    // A position waiting for its game to finish
+    struct Pending
+    {
+        Chessboard board;
+        int score;
+    };
+
+    /**
+     * @brief Plays the random moves that open a game
+     *
+     * @param board The opening position, receives the position after the random moves
+     * @param random Source of the moves
+     * @return false if the game ended during the random moves
+     */
+    bool playRandomOpening(Chessboard& board, std::mt19937_64& random) const
+    {
+        Move moves[Chessboard::MAX_MOVES];
+        for (int ply = 0; ply < config.randomPlies; ++ply) {
+            int count = board.generateMoves(moves);
+            if (count == 0) return false;
+            board.makeLegalMove(moves[random() % count]);
+        }
+        return board.gameStatus() == GameStatus::Ongoing;
+    }
+
+    /**
+     * @brief Plays one game
+     *
+     * @param engine The thread's engine
+     * @param number Number of the game, picks the opening and seeds the random moves
+     * @param positions Receives the quiet positions of the game with their scores
+     * @return Result of the game
+     */
+    GameResult playGame(Engine& engine, int number, std::vector<Pending>& positions)
+    {
+        positions.clear();
+        std::mt19937_64 random(config.seed * 0x9E3779B97F4A7C15ULL + static_cast<uint64_t>(number));
+        Chessboard board;
+        for (int attempt = 0;; ++attempt) {
+            if (attempt == 100) return GameResult::Unknown;
+            board.loadFEN(openings[random() % openings.size()]);
+            if (playRandomOpening(board, random)) break;
+        }
+        engine.clearHash();
+
+        std::vector<uint64_t> keys(1, board.getKey());
+        int resignRun = 0;
+        int drawRun = 0;
+        for (int ply = 0;; ++ply) {
+            bool black = board.isBlackToMove();
+            GameResult sideWins = black ? GameResult::WhiteWins : GameResult::BlackWins;
+            GameStatus status = board.gameStatus(keys);
+            if (status != GameStatus::Ongoing) return status == GameStatus::Checkmate ? sideWins : GameResult::Draw;
+            if (ply >= config.maxPlies) return GameResult::Draw;
+
+            int score = 0;
+            Move move = engine.think(board, config.limits, [&](const SearchReport& report) { score = report.score; });
+            if (move.isNull()) return GameResult::Unknown;
+
+            bool quiet = board.getPiece(move.getDestRow(), move.getDestCol()).getType() == Type::None && move.getPromotion() == Type::None &&
+                         !board.isKingInCheck(black) && !isMateScore(score);
+            if (quiet) positions.push_back({ board, score });
+
+            // Counted from white's point of view. A positive run is of scores winning for white, a negative one for black
+            int whiteScore = black ? -score : score;
+            if (whiteScore >= config.resignScore) resignRun = resignRun > 0 ? resignRun + 1 : 1;
+            else if (whiteScore <= -config.resignScore) resignRun = resignRun < 0 ? resignRun - 1 : -1;
+            else resignRun = 0;
+            if (resignRun >= config.resignPlies) return GameResult::WhiteWins;
+            if (resignRun <= -config.resignPlies) return GameResult::BlackWins;
+            drawRun = ply >= config.drawPly && abs(score) <= config.drawScore ? drawRun + 1 : 0;
+            if (drawRun >= config.drawPlies) return GameResult::Draw;
+
+            board.makeLegalMove(move);
+            keys.push_back(board.getKey());
+        }
+    }
+
+    // Runs on each of the game threads
+    void worker()
+    {
+        Engine engine;
+        engine.setHashSize(config.hash);
+        TrainingDataBuffer buffer(writer, config.bufferRecords);
+        std::vector<Pending> positions;
+        TrainingRecord record;
+        for (;;) {
+            int number = nextGame.fetch_add(1);
+            if (number >= config.games) break;
+            GameResult result = playGame(engine, number, positions);
+            if (result != GameResult::Unknown) {
+                for (const Pending& position : positions) {
+                    if (!makeTrainingRecord(position.board, position.score, result, record)) continue;
+                    buffer.add(record);
+                    positionsWritten++;
+                }
+            }
+            gamesPlayed++;
+        }
+    }
+
+public:
+    SelfPlayGenerator(const SelfPlayConfig& selfPlayConfig) : config(selfPlayConfig), nextGame(0), gamesPlayed(0), positionsWritten(0) {}
+
+    /**
+     * @brief Plays the games and writes the training data
+     *
+     * @param path Path of the training data file to write
+     * @param progress If set, called about every ten seconds and once at the end from the calling thread
+     * @return false if the openings could not be read or the file could not be written
+     */
+    bool run(const char* path, const std::function<void(const SelfPlayProgress&)>& progress = nullptr)
+    {
+        if (!config.openingsPath.empty()) {
+            EpdReader reader;
+            if (!reader.open(config.openingsPath.c_str())) return false;
+            Chessboard board;
+            EpdRecord record;
+            while (reader.next(board, record)) {
+                if (record.opcodeCount >= 0) openings.push_back(board.getFEN());
+            }
+        }
+        else openings.push_back("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+        if (openings.empty() || !writer.open(path)) return false;
+
+        auto start = std::chrono::steady_clock::now();
+        std::atomic<int> running(std::max(1, config.threads));
+        std::vector<std::thread> threads;
+        for (int i = 0; i < std::max(1, config.threads); ++i) {
+            threads.emplace_back([this, &running]() {
+                worker();
+                running--;
+            });
+        }
+
+        auto report = [&]() {
+            if (!progress) return;
+            progress({ gamesPlayed.load(), positionsWritten.load(), std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() });
+        };
+        auto lastReport = start;
+        while (running > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if (std::chrono::steady_clock::now() - lastReport >= std::chrono::seconds(10)) {
+                lastReport = std::chrono::steady_clock::now();
+                report();
+            }
+        }
+        for (std::thread& thread : threads) thread.join();
+        report();
+        return writer.close();
+    }
+};
+#endif
@@ -0,0 +1,1117 @@
+#ifndef TABLEBASE_H
+#define TABLEBASE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "chess.h"
+#include "mapped_file.h"
+
+/*
+ * Endgame tablebases for up to five pieces, giving the distance to mate of every position.
+ *
+ * Squares are numbered rank * 8 + file with rank 0 being white's back rank. Tables are always built with the
+ * stronger side as white, e.g. KQK has the queen on white's side, and positions with the colors the other way
+ * round are looked up by flipping the board. Values are one byte per position:
+ *
+ *   0 - 252   distance to mate in plies: odd means the side to move mates, even means it gets mated (0 = mated now)
+ *   TB_DRAW   no side can force mate
+ *   TB_BROKEN no such position (pieces on top of each other, kings touching, side not to move in check)
+ *
+ * Next to the values every table keeps its win/draw/loss results packed 2 bits per position, 32 to a word,
+ * which is all a search needs and a quarter of the size.
+ *
+ * Table files hold the values in compressed blocks of TB_BLOCK_ENTRIES positions:
+ *
+ *   header    48 bytes, see TablebaseHeader
+ *   offsets   blockCount + 1 little endian 64 bit offsets of the blocks, from the end of the offsets
+ *   blocks    see tbCompressBlock
+ *
+ * Broken positions are never probed, so they take the value before them to make the runs longer.
+ */
+
+static const int TB_MAX_PIECES = 5;
+static const char TB_MAGIC[8] = { 'C', 'H', 'E', 'S', 'S', 'T', 'B', '1' };
+static const uint32_t TB_VERSION = 2;
+static const uint32_t TB_BLOCK_ENTRIES = 4096;
+static const int TB_CACHE_SLOTS = 16;
+static const uint8_t TB_MAX_DISTANCE = 252;
+static const uint8_t TB_DRAW = 253;
+static const uint8_t TB_BROKEN = 254;
+static const uint8_t TB_UNKNOWN = 255;
+
+// Packed win/draw/loss results, from the side to move
+static const int TB_WDL_DRAW = 0;
+static const int TB_WDL_WIN = 1;
+static const int TB_WDL_LOSS = 2;
+
+struct TablebaseHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t pieces;
+    uint64_t entries;
+    char name[8];
+    uint32_t blockEntries;
+    uint32_t blockCount;
+    uint64_t reserved;
+};
+static_assert(sizeof(TablebaseHeader) == 48, "the table header is part of the format");
+
+/**
+ * @brief Compresses one block of values. Blocks start with a mode byte: 0 for runs of equal values, 1 for a
+ *        table of the distinct values followed by each value's position in that table, bit packed. Whichever is
+ *        smaller is written
+ *
+ * @param values Values of the block
+ * @param count Number of values
+ * @param out Receives the compressed block at its end
+ */
+inline void tbCompressBlock(const uint8_t* values, uint32_t count, std::vector<unsigned char>& out)
+{
+    std::vector<uint8_t> filled(values, values + count);
+    for (uint32_t i = 0; i < count; ++i) {
+        if (filled[i] == TB_BROKEN) filled[i] = i ? filled[i - 1] : TB_DRAW;
+    }
+
+    std::vector<unsigned char> runs(1, 0);
+    for (uint32_t i = 0; i < count;) {
+        uint32_t run = 1;
+        while (i + run < count && filled[i + run] == filled[i]) ++run;
+        runs.push_back(filled[i]);
+        i += run;
+        for (; run >= 0x80; run >>= 7) runs.push_back(static_cast<unsigned char>(run | 0x80));
+        runs.push_back(static_cast<unsigned char>(run));
+    }
+
+    int symbolOf[256];
+    std::fill(symbolOf, symbolOf + 256, -1);
+    std::vector<unsigned char> packed(2, 0);
+    packed[0] = 1;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (symbolOf[filled[i]] != -1) continue;
+        symbolOf[filled[i]] = static_cast<int>(packed.size()) - 2;
+        packed.push_back(filled[i]);
+    }
+    int symbols = static_cast<int>(packed.size()) - 2;
+    packed[1] = static_cast<unsigned char>(symbols - 1);
+    int bits = 0;
+    while ((1 << bits) < symbols) ++bits;
+    size_t start = packed.size();
+    packed.resize(start + (static_cast<size_t>(count) * bits + 7) / 8, 0);
+    for (uint32_t i = 0; i < count; ++i) {
+        for (int b = 0; b < bits; ++b) {
+            if (symbolOf[filled[i]] & (1 << b)) packed[start + (i * bits + b) / 8] |= 1 << ((i * bits + b) % 8);
+        }
+    }
+
+    const std::vector<unsigned char>& best = runs.size() <= packed.size() ? runs : packed;
+    out.insert(out.end(), best.begin(), best.end());
+}
+
+/**
+ * @brief Expands a block written by tbCompressBlock
+ *
+ * @param data Compressed block
+ * @param count Number of values in the block
+ * @param values Receives the values
+ */
+inline void tbDecompressBlock(const unsigned char* data, uint32_t count, uint8_t* values)
+{
+    if (*data++ == 0) {
+        for (uint32_t i = 0; i < count;) {
+            uint8_t value = *data++;
+            uint32_t run = 0;
+            for (int shift = 0;; shift += 7) {
+                unsigned char byte = *data++;
+                run |= static_cast<uint32_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) break;
+            }
+            run = std::min(run, count - i);
+            memset(values + i, value, run);
+            i += run;
+        }
+        return;
+    }
+
+    int symbols = *data++ + 1;
+    const unsigned char* table = data;
+    const unsigned char* bitsStart = data + symbols;
+    int bits = 0;
+    while ((1 << bits) < symbols) ++bits;
+    if (bits == 0) {
+        memset(values, table[0], count);
+        return;
+    }
+    uint32_t mask = (1u << bits) - 1;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t bit = i * bits;
+        uint32_t window = bitsStart[bit / 8] | ((bit % 8) + bits > 8 ? bitsStart[bit / 8 + 1] << 8 : 0);
+        values[i] = table[(window >> (bit % 8)) & mask];
+    }
+}
+
+// Squares reached by kings, knights and pawns, and the squares between two squares on a line
+struct TbGeometry
+{
+    uint64_t king[64];
+    uint64_t knight[64];
+    uint64_t pawnAttacks[2][64];
+    uint64_t between[64][64];
+    bool aligned[64][64][2];
+
+    TbGeometry()
+    {
+        memset(this, 0, sizeof(*this));
+        for (int from = 0; from < 64; ++from) {
+            int rank = from / 8;
+            int file = from % 8;
+            for (int to = 0; to < 64; ++to) {
+                int rankDiff = to / 8 - rank;
+                int fileDiff = to % 8 - file;
+                int absRank = abs(rankDiff);
+                int absFile = abs(fileDiff);
+                if (from == to) continue;
+                if (absRank <= 1 && absFile <= 1) king[from] |= 1ULL << to;
+                if ((absRank == 1 && absFile == 2) || (absRank == 2 && absFile == 1)) knight[from] |= 1ULL << to;
+
+                // aligned[..][0] is a rook line, aligned[..][1] a bishop line
+                bool straight = rankDiff == 0 || fileDiff == 0;
+                bool diagonal = absRank == absFile;
+                if (!straight && !diagonal) continue;
+                aligned[from][to][0] = straight;
+                aligned[from][to][1] = diagonal;
+                int stepRank = (rankDiff > 0) - (rankDiff < 0);
+                int stepFile = (fileDiff > 0) - (fileDiff < 0);
+                for (int r = rank + stepRank, f = file + stepFile; r * 8 + f != to; r += stepRank, f += stepFile) {
+                    between[from][to] |= 1ULL << (r * 8 + f);
+                }
+            }
+            if (rank < 7 && file > 0) pawnAttacks[1][from] |= 1ULL << (from + 7);
+            if (rank < 7 && file < 7) pawnAttacks[1][from] |= 1ULL << (from + 9);
+            if (rank > 0 && file > 0) pawnAttacks[0][from] |= 1ULL << (from - 9);
+            if (rank > 0 && file < 7) pawnAttacks[0][from] |= 1ULL << (from - 7);
+        }
+    }
+
+    static const TbGeometry& get()
+    {
+        static const TbGeometry geometry;
+        return geometry;
+    }
+};
+
+// A tablebase position as a list of pieces. Index 0 and 1 are always the white and black king
+struct TbBoard
+{
+    int count;
+    Type type[TB_MAX_PIECES];
+    bool white[TB_MAX_PIECES];
+    int square[TB_MAX_PIECES];
+    bool blackToMove;
+
+    uint64_t occupied() const
+    {
+        uint64_t mask = 0;
+        for (int i = 0; i < count; ++i) mask |= 1ULL << square[i];
+        return mask;
+    }
+
+    /**
+     * @brief Checks whether a square is attacked by one side
+     *
+     * @param target Square to look at
+     * @param byWhite Side of the attackers
+     * @param occupied Occupied squares, for sliding pieces
+     * @return true if a piece of that side attacks the square
+     */
+    bool isAttacked(int target, bool byWhite, uint64_t occupied) const
+    {
+        const TbGeometry& geometry = TbGeometry::get();
+        uint64_t bit = 1ULL << target;
+        for (int i = 0; i < count; ++i) {
+            if (white[i] != byWhite) continue;
+            int from = square[i];
+            switch (type[i]) {
+            case Type::King:
+                if (geometry.king[from] & bit) return true;
+                break;
+            case Type::Knight:
+                if (geometry.knight[from] & bit) return true;
+                break;
+            case Type::Pawn:
+                if (geometry.pawnAttacks[byWhite ? 1 : 0][from] & bit) return true;
+                break;
+            case Type::Bishop:
+            case Type::Rook:
+            case Type::Queen:
+                if (from == target) break;
+                if ((type[i] != Type::Bishop && geometry.aligned[from][target][0]) ||
+                    (type[i] != Type::Rook && geometry.aligned[from][target][1])) {
+                    if (!(geometry.between[from][target] & occupied)) return true;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        return false;
+    }
+
+    // Returns whether the king of the given side is attacked
+    bool isInCheck(bool whiteKing) const
+    {
+        return isAttacked(square[whiteKing ? 0 : 1], !whiteKing, occupied());
+    }
+
+    /**
+     * @brief Calls visit(child) with the position after each legal move of the side to move. Promotions produce
+     *        one child per piece and captures remove the captured piece, so children may have other material
+     */
+    template <class Visit>
+    void forEachChild(Visit visit) const
+    {
+        static const int rookSteps[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+        static const int bishopSteps[4][2] = { { 1, 1 }, { 1, -1 }, { -1, 1 }, { -1, -1 } };
+        static const Type promotions[4] = { Type::Queen, Type::Rook, Type::Bishop, Type::Knight };
+        const TbGeometry& geometry = TbGeometry::get();
+        bool us = !blackToMove;
+        uint64_t all = occupied();
+        uint64_t own = 0;
+        for (int i = 0; i < count; ++i) {
+            if (white[i] == us) own |= 1ULL << square[i];
+        }
+
+        // Plays piece i to a square, then keeps the move if it doesn't leave our king attacked
+        auto play = [&](int i, int to, Type promotion) {
+            TbBoard child = *this;
+            child.square[i] = to;
+            if (promotion != Type::None) child.type[i] = promotion;
+            for (int j = 2; j < child.count; ++j) {
+                if (j != i && child.square[j] == to) {
+                    child.type[j] = child.type[child.count - 1];
+                    child.white[j] = child.white[child.count - 1];
+                    child.square[j] = child.square[child.count - 1];
+                    child.count--;
+                    break;
+                }
+            }
+            child.blackToMove = !blackToMove;
+            if (!child.isAttacked(child.square[us ? 0 : 1], !us, child.occupied())) visit(child);
+        };
+
+        for (int i = 0; i < count; ++i) {
+            if (white[i] != us) continue;
+            int from = square[i];
+            uint64_t targets = 0;
+            switch (type[i]) {
+            case Type::King:
+                targets = geometry.king[from] & ~own;
+                break;
+            case Type::Knight:
+                targets = geometry.knight[from] & ~own;
+                break;
+            case Type::Bishop:
+            case Type::Rook:
+            case Type::Queen:
+                for (int d = 0; d < 8; ++d) {
+                    if (d < 4 && type[i] == Type::Bishop) continue;
+                    if (d >= 4 && type[i] == Type::Rook) continue;
+                    const int* step = d < 4 ? rookSteps[d] : bishopSteps[d - 4];
+                    for (int r = from / 8 + step[0], f = from % 8 + step[1]; r >= 0 && r < 8 && f >= 0 && f < 8; r += step[0], f += step[1]) {
+                        uint64_t bit = 1ULL << (r * 8 + f);
+                        if (own & bit) break;
+                        targets |= bit;
+                        if (all & bit) break;
+                    }
+                }
+                break;
+            case Type::Pawn: {
+                int forward = us ? 8 : -8;
+                int startRank = us ? 1 : 6;
+                int push = from + forward;
+                if (!(all & (1ULL << push))) {
+                    targets |= 1ULL << push;
+                    if (from / 8 == startRank && !(all & (1ULL << (push + forward)))) targets |= 1ULL << (push + forward);
+                }
+                targets |= geometry.pawnAttacks[us ? 1 : 0][from] & all & ~own;
+                break;
+            }
+            default:
+                break;
+            }
+
+            for (; targets; targets &= targets - 1) {
+                int to = __builtin_ctzll(targets);
+                if (type[i] == Type::Pawn && (to / 8 == 0 || to / 8 == 7)) {
+                    for (Type promotion : promotions) play(i, to, promotion);
+                }
+                else play(i, to, Type::None);
+            }
+        }
+    }
+};
+
+/**
+ * @brief Packs piece counts into a key, 4 bits per color and type, so material can be compared and looked up
+ *
+ * @param board Position to count
+ * @param swapColors Count white pieces as black and black pieces as white
+ */
+inline uint64_t tbMaterialKey(const TbBoard& board, bool swapColors = false)
+{
+    uint64_t key = 0;
+    for (int i = 0; i < board.count; ++i) {
+        int side = board.white[i] != swapColors ? 0 : 1;
+        key += 1ULL << (4 * (side * 6 + static_cast<int>(board.type[i]) - 1));
+    }
+    return key;
+}
+
+// Returns whether neither side can ever mate: bare kings, or one minor piece against a bare king
+inline bool tbIsDeadDraw(const TbBoard& board)
+{
+    if (board.count == 2) return true;
+    return board.count == 3 && (board.type[2] == Type::Knight || board.type[2] == Type::Bishop);
+}
+
+// Swaps the colors of every piece and mirrors the ranks, which keeps the value of the position
+inline void tbFlipColors(TbBoard& board)
+{
+    for (int i = 0; i < board.count; ++i) {
+        board.white[i] = !board.white[i];
+        board.square[i] ^= 56;
+    }
+    std::swap(board.type[0], board.type[1]);
+    std::swap(board.white[0], board.white[1]);
+    std::swap(board.square[0], board.square[1]);
+    board.blackToMove = !board.blackToMove;
+}
+
+/**
+ * @brief Turns a board into a tablebase position
+ *
+ * @param chessboard Position to convert
+ * @param board Receives the pieces
+ * @return false if the position has too many pieces, castling rights or a legal en passant capture, which tables
+ *         don't cover. An en passant square no pawn can capture on leaves the position as the tables have it
+ */
+inline bool tbBoardFromChessboard(const Chessboard& chessboard, TbBoard& board)
+{
+    if (chessboard.getEnPassantCol() != -1) {
+        Move moves[Chessboard::MAX_MOVES];
+        int count = chessboard.generateMoves(moves);
+        for (int i = 0; i < count; ++i) {
+            const Move& move = moves[i];
+            if (move.getSourceCol() != move.getDestCol() && chessboard.getPiece(move.getSourceRow(), move.getSourceCol()).getType() == Type::Pawn &&
+                chessboard.getPiece(move.getDestRow(), move.getDestCol()).getType() == Type::None) {
+                return false;
+            }
+        }
+    }
+    if (chessboard.canStillCastle(7, 7) || chessboard.canStillCastle(7, 0) || chessboard.canStillCastle(0, 7) || chessboard.canStillCastle(0, 0)) {
+        return false;
+    }
+
+    board.count = 2;
+    board.blackToMove = chessboard.isBlackToMove();
+    for (int row = 0; row < 8; ++row) {
+        for (int col = 0; col < 8; ++col) {
+            Piece piece = chessboard.getPiece(row, col);
+            if (piece.getType() == Type::None) continue;
+            bool white = piece.getColor() == Color::White;
+            int slot = piece.getType() == Type::King ? (white ? 0 : 1) : board.count++;
+            if (slot >= TB_MAX_PIECES) return false;
+            board.type[slot] = piece.getType();
+            board.white[slot] = white;
+            board.square[slot] = (7 - row) * 8 + col;
+        }
+    }
+    return true;
+}
+
+// Returns the name of a material key, e.g. "KRPKR"
+inline std::string tbMaterialName(uint64_t key)
+{
+    static const char letters[] = "PNBRQK";
+    std::string name;
+    for (int side = 0; side < 2; ++side) {
+        for (int type = 5; type >= 0; --type) {
+            int count = (key >> (4 * (side * 6 + type))) & 15;
+            name.append(count, letters[type]);
+        }
+    }
+    return name;
+}
+
+/**
+ * @brief Creates a directory along with its missing parents, like mkdir -p, and checks that files can be
+ *        written to it, so that a long generation doesn't fail only when saving
+ *
+ * @param directory Directory the tables go to
+ * @return true if the directory exists and is writable
+ */
+inline bool tbPrepareDirectory(const std::string& directory)
+{
+    for (size_t end = directory.find('/', 1); ; end = directory.find('/', end + 1)) {
+        std::string prefix = directory.substr(0, end);
+        if (!prefix.empty() && mkdir(prefix.c_str(), 0777) != 0 && errno != EEXIST) return false;
+        if (end == std::string::npos) break;
+    }
+    struct stat info;
+    return stat(directory.c_str(), &info) == 0 && S_ISDIR(info.st_mode) && access(directory.c_str(), W_OK | X_OK) == 0;
+}
+
+// Distance to mate table of one material balance, with the index that maps positions to entries
+class EndgameTable
+{
+private:
+    std::string name;
+    uint64_t materialKey;
+    int count;
+    Type type[TB_MAX_PIECES];
+    bool sideWhite[TB_MAX_PIECES];
+    bool hasPawns;
+    uint64_t entries;
+    std::vector<uint8_t> values;
+    std::vector<uint64_t> wdl;
+
+    // Square of the white king in the reduced part of the board: the a1-d1-d4 triangle, or files a-d with pawns
+    static int kingSlot(int square, bool pawns)
+    {
+        static const int triangle[64] = {
+            0, 1, 2, 3, -1, -1, -1, -1,
+            -1, 4, 5, 6, -1, -1, -1, -1,
+            -1, -1, 7, 8, -1, -1, -1, -1,
+            -1, -1, -1, 9, -1, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, -1, -1,
+            -1, -1, -1, -1, -1, -1, -1, -1
+        };
+        if (pawns) return square % 8 < 4 ? (square / 8) * 4 + square % 8 : -1;
+        return triangle[square];
+    }
+
+    static int slotSquare(int slot, bool pawns)
+    {
+        static const int triangle[10] = { 0, 1, 2, 3, 9, 10, 11, 18, 19, 27 };
+        return pawns ? (slot / 4) * 8 + slot % 4 : triangle[slot];
+    }
+
+public:
+    /**
+     * @brief Sets up an empty table for a material balance
+     *
+     * @param signature Pieces of the stronger side then the weaker side, each starting with its king, e.g. "KBNK"
+     * @return true if the signature is valid
+     */
+    bool setup(const std::string& signature)
+    {
+        if (signature.size() < 2 || signature[0] != 'K') return false;
+        size_t blackKing = signature.find('K', 1);
+        if (blackKing == std::string::npos || signature.size() > TB_MAX_PIECES) return false;
+
+        count = 0;
+        type[count++] = Type::King;
+        sideWhite[0] = true;
+        sideWhite[1] = false;
+        type[count++] = Type::King;
+        hasPawns = false;
+        for (size_t i = 1; i < signature.size(); ++i) {
+            if (i == blackKing) continue;
+            Type pieceType = pieceFromLetter(signature[i]).getType();
+            if (pieceType == Type::None || pieceType == Type::King) return false;
+            sideWhite[count] = i < blackKing;
+            hasPawns = hasPawns || pieceType == Type::Pawn;
+            type[count++] = pieceType;
+        }
+
+        // White pieces before black pieces, strongest first, the order lookups sort pieces into
+        for (int i = 2; i < count; ++i) {
+            for (int j = i + 1; j < count; ++j) {
+                if (sideWhite[j] > sideWhite[i] || (sideWhite[j] == sideWhite[i] && type[j] > type[i])) {
+                    std::swap(sideWhite[i], sideWhite[j]);
+                    std::swap(type[i], type[j]);
+                }
+            }
+        }
+
+        TbBoard board;
+        board.count = count;
+        for (int i = 0; i < count; ++i) {
+            board.type[i] = type[i];
+            board.white[i] = sideWhite[i];
+        }
+        materialKey = tbMaterialKey(board);
+        name = tbMaterialName(materialKey);
+
+        entries = (hasPawns ? 32 : 10) * 64 * 2;
+        for (int i = 2; i < count; ++i) entries *= type[i] == Type::Pawn ? 48 : 64;
+        return true;
+    }
+
+    const std::string& getName() const
+    {
+        return name;
+    }
+
+    uint64_t getMaterialKey() const
+    {
+        return materialKey;
+    }
+
+    uint64_t size() const
+    {
+        return entries;
+    }
+
+    int pieceCount() const
+    {
+        return count;
+    }
+
+    std::vector<uint8_t>& data()
+    {
+        return values;
+    }
+
+    const std::vector<uint8_t>& data() const
+    {
+        return values;
+    }
+
+    const std::vector<uint64_t>& packedResults() const
+    {
+        return wdl;
+    }
+
+    // Returns the win/draw/loss result of an entry
+    int result(uint64_t number) const
+    {
+        return (wdl[number / 32] >> (2 * (number % 32))) & 3;
+    }
+
+    // Packs the results of the values, once they are final
+    void packResults()
+    {
+        wdl.assign((entries + 31) / 32, 0);
+        for (uint64_t i = 0; i < entries; ++i) {
+            uint64_t result = values[i] <= TB_MAX_DISTANCE ? (values[i] % 2 ? TB_WDL_WIN : TB_WDL_LOSS) : TB_WDL_DRAW;
+            wdl[i / 32] |= result << (2 * (i % 32));
+        }
+    }
+
+    // Returns the memory held by the table
+    uint64_t bytes() const
+    {
+        return values.size() + wdl.size() * sizeof(uint64_t);
+    }
+
+    /**
+     * @brief Turns a position with this table's material, white being the stronger side, into its entry number.
+     *        The board is mirrored so that the white king lands in the reduced part of the board
+     *
+     * @param board Position, its pieces in any order
+     * @return Entry number of the position
+     */
+    uint64_t index(const TbBoard& board) const
+    {
+        int squares[TB_MAX_PIECES] = {};
+        int order[TB_MAX_PIECES] = {};
+
+        // Match the board's pieces to the table's piece order
+        bool used[TB_MAX_PIECES] = {};
+        for (int slot = 0; slot < count; ++slot) {
+            for (int i = 0; i < board.count; ++i) {
+                if (!used[i] && board.type[i] == type[slot] && board.white[i] == sideWhite[slot]) {
+                    used[i] = true;
+                    order[slot] = i;
+                    break;
+                }
+            }
+        }
+        for (int slot = 0; slot < count; ++slot) squares[slot] = board.square[order[slot]];
+
+        // Mirror files, then ranks and the diagonal when there are no pawns
+        if (squares[0] % 8 > 3) {
+            for (int i = 0; i < count; ++i) squares[i] ^= 7;
+        }
+        if (!hasPawns) {
+            if (squares[0] / 8 > 3) {
+                for (int i = 0; i < count; ++i) squares[i] ^= 56;
+            }
+            if (squares[0] / 8 > squares[0] % 8) {
+                for (int i = 0; i < count; ++i) squares[i] = (squares[i] % 8) * 8 + squares[i] / 8;
+            }
+        }
+
+        uint64_t result = kingSlot(squares[0], hasPawns);
+        result = result * 64 + squares[1];
+        for (int i = 2; i < count; ++i) {
+            result = type[i] == Type::Pawn ? result * 48 + (squares[i] - 8) : result * 64 + squares[i];
+        }
+        // Side to move is the top of the index, so that neighbouring entries tend to have similar values
+        return board.blackToMove ? result + entries / 2 : result;
+    }
+
+    // Turns an entry number back into a position, the inverse of index
+    void decode(uint64_t number, TbBoard& board) const
+    {
+        board.count = count;
+        board.blackToMove = number >= entries / 2;
+        if (board.blackToMove) number -= entries / 2;
+        for (int i = count - 1; i >= 2; --i) {
+            board.type[i] = type[i];
+            board.white[i] = sideWhite[i];
+            if (type[i] == Type::Pawn) {
+                board.square[i] = static_cast<int>(number % 48) + 8;
+                number /= 48;
+            }
+            else {
+                board.square[i] = static_cast<int>(number % 64);
+                number /= 64;
+            }
+        }
+        board.type[1] = Type::King;
+        board.white[1] = false;
+        board.square[1] = static_cast<int>(number % 64);
+        board.type[0] = Type::King;
+        board.white[0] = true;
+        board.square[0] = slotSquare(static_cast<int>(number / 64), hasPawns);
+    }
+};
+
+// Builds tables, generating the smaller tables that captures and promotions lead into first
+class TablebaseGenerator
+{
+private:
+    int threads;
+    std::map<uint64_t, std::unique_ptr<EndgameTable>> tables;
+
+public:
+    TablebaseGenerator(int threadCount) : threads(std::max(1, threadCount)) {}
+
+    /**
+     * @brief Looks up a finished table, with the colors swapped if needed
+     *
+     * @param board Position to find the table of
+     * @param swapped Receives whether the table has the colors the other way round
+     * @return The table, or null if it hasn't been generated
+     */
+    const EndgameTable* find(const TbBoard& board, bool& swapped) const
+    {
+        auto it = tables.find(tbMaterialKey(board));
+        swapped = false;
+        if (it == tables.end()) {
+            it = tables.find(tbMaterialKey(board, true));
+            swapped = true;
+        }
+        return it == tables.end() ? nullptr : it->second.get();
+    }
+
+    /**
+     * @brief Returns the value of a position from generated tables
+     *
+     * @param board Position to look up
+     * @return Distance to mate in plies, TB_DRAW, or TB_UNKNOWN if the table isn't there
+     */
+    uint8_t probe(const TbBoard& board) const
+    {
+        if (tbIsDeadDraw(board)) return TB_DRAW;
+        bool swapped;
+        const EndgameTable* table = find(board, swapped);
+        if (!table) return TB_UNKNOWN;
+        if (!swapped) return table->data()[table->index(board)];
+
+        TbBoard flipped = board;
+        tbFlipColors(flipped);
+        return table->data()[table->index(flipped)];
+    }
+
+    /**
+     * @brief Compresses every generated table into a directory, one file per table named after its material
+     *
+     * @param directory Directory to write to
+     * @return true if every file was written
+     */
+    bool save(const std::string& directory) const
+    {
+        for (const auto& entry : tables) {
+            const EndgameTable& table = *entry.second;
+            TablebaseHeader header = {};
+            memcpy(header.magic, TB_MAGIC, sizeof(header.magic));
+            header.version = TB_VERSION;
+            header.pieces = static_cast<uint32_t>(table.pieceCount());
+            header.entries = table.size();
+            memcpy(header.name, table.getName().data(), table.getName().size());
+            header.blockEntries = TB_BLOCK_ENTRIES;
+            header.blockCount = static_cast<uint32_t>((table.size() + TB_BLOCK_ENTRIES - 1) / TB_BLOCK_ENTRIES);
+
+            std::vector<uint64_t> offsets;
+            std::vector<unsigned char> blocks;
+            for (uint64_t first = 0; first < table.size(); first += TB_BLOCK_ENTRIES) {
+                offsets.push_back(blocks.size());
+                uint32_t count = static_cast<uint32_t>(std::min<uint64_t>(TB_BLOCK_ENTRIES, table.size() - first));
+                tbCompressBlock(table.data().data() + first, count, blocks);
+            }
+            offsets.push_back(blocks.size());
+
+            std::string path = directory + "/" + table.getName() + ".tb";
+            FILE* out = fopen(path.c_str(), "wb");
+            if (!out) return false;
+            bool ok = fwrite(&header, sizeof(header), 1, out) == 1 && fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), out) == offsets.size() &&
+                      fwrite(blocks.data(), 1, blocks.size(), out) == blocks.size();
+            if (fclose(out) != 0 || !ok) return false;
+            std::cout << path << ": " << (table.size() >> 10) << " KB compressed to " << ((blocks.size() + offsets.size() * 8) >> 10) << " KB" << std::endl;
+        }
+        return true;
+    }
+
+    // Returns every table generated so far
+    std::vector<const EndgameTable*> generated() const
+    {
+        std::vector<const EndgameTable*> list;
+        for (const auto& table : tables) list.push_back(table.second.get());
+        return list;
+    }
+
+    /**
+     * @brief Generates a table and the tables it depends on, printing progress and memory use
+     *
+     * @param signature Material of the table, e.g. "KQK"
+     * @return true if the table was generated
+     * @return false if the signature is invalid
+     */
+    bool generate(const std::string& signature)
+    {
+        std::unique_ptr<EndgameTable> table(new EndgameTable());
+        if (!table->setup(signature)) return false;
+        if (tables.count(table->getMaterialKey())) return true;
+
+        // Tables reached by capturing a piece or promoting a pawn have to exist first
+        TbBoard material;
+        table->decode(0, material);
+        for (int i = 2; i < material.count; ++i) {
+            TbBoard smaller = material;
+            smaller.type[i] = smaller.type[smaller.count - 1];
+            smaller.white[i] = smaller.white[smaller.count - 1];
+            smaller.count--;
+            if (!tbIsDeadDraw(smaller) && !generateMaterial(smaller)) return false;
+            if (material.type[i] == Type::Pawn) {
+                for (Type promotion : { Type::Queen, Type::Rook, Type::Bishop, Type::Knight }) {
+                    TbBoard promoted = material;
+                    promoted.type[i] = promotion;
+                    if (!tbIsDeadDraw(promoted) && !generateMaterial(promoted)) return false;
+                }
+            }
+        }
+
+        build(*table);
+        tables[table->getMaterialKey()] = std::move(table);
+        return true;
+    }
+
+private:
+    // Generates the table of a material balance, whichever side is stronger
+    bool generateMaterial(const TbBoard& board)
+    {
+        bool swapped;
+        if (find(board, swapped)) return true;
+
+        // Prefer the side with more material as white
+        std::string name = tbMaterialName(tbMaterialKey(board));
+        std::string swappedName = tbMaterialName(tbMaterialKey(board, true));
+        int whiteValue = 0;
+        int blackValue = 0;
+        static const int values[7] = { 0, 1, 3, 3, 5, 9, 0 };
+        for (int i = 0; i < board.count; ++i) (board.white[i] ? whiteValue : blackValue) += values[static_cast<int>(board.type[i])];
+        return generate(whiteValue >= blackValue ? name : swappedName);
+    }
+
+    // Runs a pass over every entry of a table on all threads
+    template <class Work>
+    void parallelFor(uint64_t size, Work work)
+    {
+        std::atomic<uint64_t> next(0);
+        const uint64_t chunk = 4096;
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads; ++t) {
+            pool.emplace_back([&]() {
+                for (;;) {
+                    uint64_t first = next.fetch_add(chunk);
+                    if (first >= size) break;
+                    uint64_t last = std::min(first + chunk, size);
+                    for (uint64_t i = first; i < last; ++i) work(i);
+                }
+            });
+        }
+        for (std::thread& thread : pool) thread.join();
+    }
+
+    /**
+     * @brief Fills a table by forward retrograde iteration. Pass n finds the positions that are mated or mate in
+     *        exactly n plies: a win if some move reaches a loss in n - 1, a loss if every move reaches a win in
+     *        at most n - 1. Values written during a pass are always n, so threads never act on each other's results
+     */
+    void build(EndgameTable& table)
+    {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t size = table.size();
+        std::unique_ptr<std::atomic<uint8_t>[]> values(new std::atomic<uint8_t>[size]);
+        std::cout << table.getName() << ": " << size << " positions, " << (size >> 10) << " KB working memory" << std::endl;
+
+        // Value of a child from the child's side to move
+        auto childValue = [&](const TbBoard& child) -> uint8_t {
+            if (child.count == table.pieceCount() && tbMaterialKey(child) == table.getMaterialKey()) {
+                return values[table.index(child)].load(std::memory_order_relaxed);
+            }
+            return probe(child);
+        };
+
+        // Broken positions, mates and stalemates
+        std::atomic<uint64_t> broken(0);
+        std::atomic<int> longestChild(0);
+        parallelFor(size, [&](uint64_t i) {
+            TbBoard board;
+            table.decode(i, board);
+            uint8_t value = TB_UNKNOWN;
+            uint64_t occupied = board.occupied();
+            bool kingsTouch = TbGeometry::get().king[board.square[0]] & (1ULL << board.square[1]);
+            if (__builtin_popcountll(occupied) != board.count || kingsTouch || board.isInCheck(board.blackToMove)) {
+                value = TB_BROKEN;
+                broken++;
+            }
+            else {
+                bool anyMove = false;
+                board.forEachChild([&](const TbBoard& child) {
+                    anyMove = true;
+                    bool sameTable = child.count == board.count && tbMaterialKey(child) == table.getMaterialKey();
+                    if (sameTable) return;
+                    uint8_t result = probe(child);
+                    if (result <= TB_MAX_DISTANCE && result > longestChild.load()) longestChild = result;
+                });
+                if (!anyMove) value = board.isInCheck(!board.blackToMove) ? 0 : TB_DRAW;
+            }
+            values[i].store(value, std::memory_order_relaxed);
+        });
+
+        // Keep going until two passes in a row find nothing, and at least past the longest mate in the smaller tables
+        int quiet = 0;
+        int distance = 1;
+        for (; distance <= TB_MAX_DISTANCE && (quiet < 2 || distance <= longestChild + 2); ++distance) {
+            std::atomic<uint64_t> found(0);
+            bool winning = distance % 2 == 1;
+            parallelFor(size, [&](uint64_t i) {
+                if (values[i].load(std::memory_order_relaxed) != TB_UNKNOWN) return;
+                TbBoard board;
+                table.decode(i, board);
+                bool decided = !winning;
+                board.forEachChild([&](const TbBoard& child) {
+                    uint8_t result = childValue(child);
+                    if (winning) {
+                        if (result == distance - 1) decided = true;
+                    }
+                    else if (!(result <= TB_MAX_DISTANCE && result % 2 == 1 && result < distance)) {
+                        decided = false;
+                    }
+                });
+                if (decided) {
+                    values[i].store(static_cast<uint8_t>(distance), std::memory_order_relaxed);
+                    found++;
+                }
+            });
+            quiet = found ? 0 : quiet + 1;
+            if (found) {
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                std::cout << table.getName() << ": " << (winning ? "mate" : "mated") << " in " << distance << " plies: " << found.load()
+                          << " positions (" << seconds << " s)" << std::endl;
+            }
+        }
+
+        // Whatever is left can't be forced either way
+        std::vector<uint8_t>& data = table.data();
+        data.resize(size);
+        uint64_t wins = 0;
+        uint64_t losses = 0;
+        uint64_t draws = 0;
+        for (uint64_t i = 0; i < size; ++i) {
+            uint8_t value = values[i].load(std::memory_order_relaxed);
+            if (value == TB_UNKNOWN) value = TB_DRAW;
+            data[i] = value;
+            if (value == TB_DRAW) draws++;
+            else if (value <= TB_MAX_DISTANCE) (value % 2 ? wins : losses)++;
+        }
+        values.reset();
+        table.packResults();
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << table.getName() << ": done in " << seconds << " s. Wins: " << wins << " Losses: " << losses << " Draws: " << draws
+                  << " Broken: " << broken.load() << std::endl;
+        std::cout << table.getName() << ": " << (table.bytes() >> 10) << " KB, all tables " << ((totalBytes() + table.bytes()) >> 10) << " KB"
+                  << std::endl;
+    }
+
+    // Returns the memory held by finished tables
+    uint64_t totalBytes() const
+    {
+        uint64_t bytes = 0;
+        for (const auto& table : tables) bytes += table.second->bytes();
+        return bytes;
+    }
+};
+
+// Read only tablebase files, probed in place through their memory mappings by any number of threads
+class Tablebases
+{
+private:
+    struct TableFile
+    {
+        MappedFile file;
+        EndgameTable layout;
+        const uint64_t* offsets;
+        const unsigned char* blocks;
+        uint32_t blockEntries;
+        uint32_t blockCount;
+        uint64_t id;
+    };
+
+    // Recently expanded blocks of one thread, so probes never wait on each other
+    struct DecodeCache
+    {
+        uint64_t table[TB_CACHE_SLOTS];
+        uint32_t block[TB_CACHE_SLOTS];
+        uint8_t values[TB_CACHE_SLOTS][TB_BLOCK_ENTRIES];
+    };
+
+    std::map<uint64_t, std::unique_ptr<TableFile>> tables;
+    int maxPieces;
+
+    static DecodeCache& cache()
+    {
+        thread_local DecodeCache decoded = {};
+        return decoded;
+    }
+
+    // Numbers files uniquely for the life of the program, so a cache slot never outlives its file
+    static uint64_t nextId()
+    {
+        static std::atomic<uint64_t> id(0);
+        return ++id;
+    }
+
+    const uint8_t* blockValues(const TableFile& table, uint32_t block) const
+    {
+        DecodeCache& decoded = cache();
+        int slot = static_cast<int>((table.id * 31 + block) % TB_CACHE_SLOTS);
+        if (decoded.table[slot] != table.id || decoded.block[slot] != block) {
+            uint32_t count = static_cast<uint32_t>(std::min<uint64_t>(table.blockEntries, table.layout.size() - static_cast<uint64_t>(block) * table.blockEntries));
+            tbDecompressBlock(table.blocks + table.offsets[block], count, decoded.values[slot]);
+            decoded.table[slot] = table.id;
+            decoded.block[slot] = block;
+        }
+        return decoded.values[slot];
+    }
+
+public:
+    Tablebases() : maxPieces(0) {}
+
+    /**
+     * @brief Maps every table file of a directory
+     *
+     * @param directory Directory with the .tb files written by the generator
+     * @return Number of tables loaded
+     */
+    int open(const char* directory)
+    {
+        DIR* dir = opendir(directory);
+        if (!dir) return 0;
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.size() < 4 || name.compare(name.size() - 3, 3, ".tb") != 0) continue;
+
+            std::unique_ptr<TableFile> table(new TableFile());
+            std::string path = std::string(directory) + "/" + name;
+            if (!table->file.open(path.c_str(), false) || table->file.length() < sizeof(TablebaseHeader)) continue;
+            const TablebaseHeader* header = reinterpret_cast<const TablebaseHeader*>(table->file.begin());
+            if (memcmp(header->magic, TB_MAGIC, sizeof(header->magic)) != 0 || header->version != TB_VERSION || header->blockEntries != TB_BLOCK_ENTRIES) continue;
+            if (!table->layout.setup(std::string(header->name, strnlen(header->name, sizeof(header->name)))) || table->layout.size() != header->entries) continue;
+            uint64_t blocksStart = sizeof(TablebaseHeader) + (static_cast<uint64_t>(header->blockCount) + 1) * sizeof(uint64_t);
+            if (blocksStart > table->file.length() || header->blockCount != (header->entries + TB_BLOCK_ENTRIES - 1) / TB_BLOCK_ENTRIES) continue;
+
+            table->offsets = reinterpret_cast<const uint64_t*>(table->file.begin() + sizeof(TablebaseHeader));
+            table->blocks = reinterpret_cast<const unsigned char*>(table->file.begin() + blocksStart);
+            if (table->offsets[header->blockCount] > table->file.length() - blocksStart) continue;
+            table->blockEntries = header->blockEntries;
+            table->blockCount = header->blockCount;
+            table->id = nextId();
+            maxPieces = std::max(maxPieces, table->layout.pieceCount());
+            uint64_t key = table->layout.getMaterialKey();
+            tables[key] = std::move(table);
+        }
+        closedir(dir);
+        return static_cast<int>(tables.size());
+    }
+
+    // Returns the most pieces any loaded table has, 0 if none are loaded
+    int getMaxPieces() const
+    {
+        return maxPieces;
+    }
+
+    /**
+     * @brief Looks up a position. Safe to call from any number of threads at once
+     *
+     * @param board Position to look up
+     * @param value Receives the distance to mate in plies or TB_DRAW
+     * @return false if no loaded table covers the position
+     */
+    bool probe(const TbBoard& board, uint8_t& value) const
+    {
+        if (tbIsDeadDraw(board)) {
+            value = TB_DRAW;
+            return true;
+        }
+
+        TbBoard flipped = board;
+        auto it = tables.find(tbMaterialKey(board));
+        if (it == tables.end()) {
+            it = tables.find(tbMaterialKey(board, true));
+            if (it == tables.end()) return false;
+            tbFlipColors(flipped);
+        }
+
+        const TableFile& table = *it->second;
+        uint64_t number = table.layout.index(flipped);
+        value = blockValues(table, static_cast<uint32_t>(number / table.blockEntries))[number % table.blockEntries];
+        return true;
+    }
+
+    /**
+     * @brief Looks up a board
+     *
+     * @param board Position to look up
+     * @param value Receives the distance to mate in plies or TB_DRAW
+     * @return false if the position isn't covered by the loaded tables
+     */
+    bool probe(const Chessboard& board, uint8_t& value) const
+    {
+        TbBoard position;
+        if (maxPieces == 0 || !tbBoardFromChessboard(board, position) || position.count > maxPieces) return false;
+        return probe(position, value);
+    }
+};
+#endif
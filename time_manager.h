@@ -0,0 +1,202 @@
+#ifndef TIME_MANAGER_H
+#define TIME_MANAGER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+
+// What to stop a search at. Zero means no limit, times are in milliseconds
+struct SearchLimits
+{
+    int depth = 0;
+    long long nodes = 0;
+    long long moveTime = 0;
+    long long time[2] = { 0, 0 };
+    long long increment[2] = { 0, 0 };
+    int movesToGo = 0;
+    bool infinite = false;
+    bool ponder = false;
+};
+
+// How the time of one move was planned and spent
+struct MoveTimeStats
+{
+    long long optimum;
+    long long maximum;
+    long long used;
+    int depth;
+    bool forced;
+};
+
+/**
+ * @brief Decides how long to think on a move. The plan is an optimum time, which is stretched while the best move
+ *        keeps changing or the score is falling and shrunk while the search is stable, and a hard maximum that the
+ *        search never passes. The clock can be restarted from another thread when a ponder search becomes real
+ */
+class TimeManager
+{
+private:
+    // Milliseconds kept back for talking to the GUI and starting up
+    static const long long MOVE_OVERHEAD = 30;
+
+    std::atomic<long long> startTicks;
+    long long optimum;
+    long long maximum;
+    double scale;
+    int lastScore;
+    int lastBestMove;
+    bool forced;
+
+    // When the last iteration finished, in clock ticks, and how long it took
+    long long iterationEnd;
+    long long iterationTime;
+
+    // Totals of every move planned so far
+    long long moves;
+    long long totalUsed;
+    long long totalOptimum;
+    long long overruns;
+    MoveTimeStats last;
+
+    static long long now()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+public:
+    TimeManager() : startTicks(now()), optimum(0), maximum(0), scale(1), lastScore(0), lastBestMove(-1), forced(false), iterationEnd(0),
+                    iterationTime(0), moves(0), totalUsed(0),
+                    totalOptimum(0), overruns(0), last() {}
+
+    /**
+     * @brief Plans the time of a move and starts the clock
+     *
+     * @param limits Limits of the search, with the clocks of both sides
+     * @param blackToMove Whose clock to use
+     * @param legalMoves Number of legal moves, with only one there is nothing to think about
+     */
+    void begin(const SearchLimits& limits, bool blackToMove, int legalMoves)
+    {
+        startTicks = now();
+        iterationEnd = startTicks;
+        iterationTime = 0;
+        scale = 1;
+        lastScore = 0;
+        lastBestMove = -1;
+        forced = legalMoves == 1 && !limits.infinite && !limits.ponder;
+        optimum = 0;
+        maximum = 0;
+        if (limits.infinite) return;
+
+        if (limits.moveTime) {
+            optimum = maximum = std::max(1LL, limits.moveTime - MOVE_OVERHEAD);
+        }
+        else if (limits.time[blackToMove ? 1 : 0]) {
+            int side = blackToMove ? 1 : 0;
+            long long remaining = std::max(1LL, limits.time[side] - MOVE_OVERHEAD);
+            int movesLeft = limits.movesToGo ? std::min(limits.movesToGo, 40) : 30;
+
+            // Spend an even share of the clock plus most of the increment, but never more than a fifth of what is left
+            // on one move unless it is the last before the time control
+            optimum = std::min(remaining / movesLeft + limits.increment[side] * 3 / 4, remaining);
+            long long ceiling = movesLeft == 1 ? remaining : remaining / 5;
+            maximum = std::max(optimum, std::min(optimum * 4, ceiling));
+            optimum = std::min(optimum, maximum);
+        }
+    }
+
+    // The search switched from pondering to thinking on our own clock
+    void restart()
+    {
+        startTicks = now();
+    }
+
+    long long elapsed() const
+    {
+        return now() - startTicks.load(std::memory_order_relaxed);
+    }
+
+    // Returns whether the search must stop right now, checked while searching
+    bool hardLimitReached() const
+    {
+        return maximum && elapsed() >= maximum;
+    }
+
+    /**
+     * @brief Called after every finished iteration to decide whether to start another one
+     *
+     * @param bestMove Raw value of the best move of the iteration
+     * @param score Score of the iteration
+     * @return true if the search should stop
+     */
+    bool stopAfterIteration(int bestMove, int score)
+    {
+        // Each iteration takes longer than the one before by about the effective branching factor, so the next one is
+        // expected to grow by as much as this one did. Until two iterations have been timed, assume it doubles
+        long long ticks = now();
+        long long time = ticks - iterationEnd;
+        double growth = iterationTime > 0 ? std::clamp(static_cast<double>(time) / iterationTime, 1.5, 8.0) : 2.0;
+        iterationEnd = ticks;
+        iterationTime = time;
+
+        if (forced) return true;
+        if (!optimum) return false;
+
+        // A new best move or a falling score asks for more time, a steady search gives some back
+        if (lastBestMove != -1) {
+            if (bestMove != lastBestMove) scale = std::min(scale * 1.4, 3.0);
+            else scale = std::max(scale * 0.9, 0.5);
+            if (score < lastScore - 30) scale = std::min(scale * 1.25, 3.0);
+        }
+        lastBestMove = bestMove;
+        lastScore = score;
+
+        // Don't start an iteration that is expected to end past the target
+        long long target = std::min(static_cast<long long>(optimum * scale), maximum);
+        return elapsed() + static_cast<long long>(time * growth) >= target;
+    }
+
+    /**
+     * @brief Records the time spent on a move, once the search is over
+     *
+     * @param depth Depth the search finished
+     */
+    void finish(int depth)
+    {
+        last = { optimum, maximum, elapsed(), depth, forced };
+        moves++;
+        totalUsed += last.used;
+        totalOptimum += optimum;
+        if (maximum > optimum && last.used >= maximum) overruns++;
+    }
+
+    // Returns how the last move's time was planned and spent
+    const MoveTimeStats& lastMove() const
+    {
+        return last;
+    }
+
+    long long movesPlayed() const
+    {
+        return moves;
+    }
+
+    long long averageUsed() const
+    {
+        return moves ? totalUsed / moves : 0;
+    }
+
+    long long averageOptimum() const
+    {
+        return moves ? totalOptimum / moves : 0;
+    }
+
+    // Returns the number of moves that ran into their maximum, which only a badly planned iteration does. A fixed move
+    // time, whose optimum is its maximum, is meant to be used up and isn't counted
+    long long overrunCount() const
+    {
+        return overruns;
+    }
+};
+#endif
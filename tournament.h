@@ -0,0 +1,536 @@
+#ifndef TOURNAMENT_H
+#define TOURNAMENT_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "chess.h"
+#include "engine.h"
+#include "epd.h"
+#include "pgn.h"
+
+// One side of a match: the engine of this program, or a UCI engine running as another process
+class MatchPlayer
+{
+public:
+    virtual ~MatchPlayer() {}
+
+    // Gets ready for a new game, returns false if the engine stopped responding
+    virtual bool newGame() = 0;
+
+    /**
+     * @brief Picks a move
+     *
+     * @param startFen Position the game started from
+     * @param moves Moves played since the start
+     * @param board Position after those moves
+     * @param limits Search limits, with both clocks when playing on time
+     * @param score Receives the engine's score for the side to move, in centipawns
+     * @return The move, or a null move if the engine gave none
+     */
+    virtual Move play(const std::string& startFen, const std::vector<Move>& moves, const Chessboard& board, const SearchLimits& limits, int& score) = 0;
+};
+
+// The engine of this program, searching in the match process
+class InProcessPlayer : public MatchPlayer
+{
+private:
+    Engine engine;
+
+public:
+    InProcessPlayer(int hashMegabytes, int threads, const std::string& tablebasePath)
+    {
+        engine.setHashSize(hashMegabytes);
+        engine.setThreads(threads);
+        if (!tablebasePath.empty()) engine.loadTablebases(tablebasePath.c_str());
+    }
+
+    bool newGame() override
+    {
+        engine.clearHash();
+        return true;
+    }
+
+    Move play(const std::string&, const std::vector<Move>&, const Chessboard& board, const SearchLimits& limits, int& score) override
+    {
+        score = 0;
+        return engine.think(board, limits, [&](const SearchReport& report) { score = report.score; });
+    }
+};
+
+// A UCI engine started from a command line, talked to through pipes
+class UciProcessPlayer : public MatchPlayer
+{
+private:
+    pid_t pid;
+    FILE* input;
+    FILE* output;
+    int lastScore;
+
+    void send(const std::string& line)
+    {
+        fputs((line + "\n").c_str(), input);
+        fflush(input);
+    }
+
+    // Reads lines until one starts with the given word, false if the engine went away
+    bool waitFor(const std::string& word, std::string& line)
+    {
+        char buffer[8192];
+        while (fgets(buffer, sizeof(buffer), output)) {
+            line = buffer;
+            while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.pop_back();
+            if (line.compare(0, word.size(), word) == 0 && (line.size() == word.size() || line[word.size()] == ' ')) return true;
+            if (word == "bestmove") lastInfo(line);
+        }
+        return false;
+    }
+
+    // Keeps the score of the latest "info ... score cp|mate N" line
+    void lastInfo(const std::string& line)
+    {
+        std::istringstream words(line);
+        std::string word;
+        while (words >> word) {
+            if (word != "score") continue;
+            std::string kind;
+            int value;
+            if (!(words >> kind >> value)) return;
+            if (kind == "cp") lastScore = value;
+            else if (kind == "mate") lastScore = value > 0 ? MATE_SCORE - 2 * value : -MATE_SCORE - 2 * value;
+            return;
+        }
+    }
+
+public:
+    UciProcessPlayer() : pid(-1), input(nullptr), output(nullptr), lastScore(0) {}
+
+    ~UciProcessPlayer() override
+    {
+        if (input) {
+            send("quit");
+            fclose(input);
+        }
+        if (output) fclose(output);
+        if (pid > 0) waitpid(pid, nullptr, 0);
+    }
+
+    /**
+     * @brief Starts the engine and sets it up
+     *
+     * @param command Command line of the engine, run through /bin/sh
+     * @param hashMegabytes Value of the Hash option
+     * @param threads Value of the Threads option
+     * @return false if the engine could not be started or doesn't speak UCI
+     */
+    bool start(const std::string& command, int hashMegabytes, int threads)
+    {
+        // Other threads start engines at the same time, so the pipes are close-on-exec: an engine that inherited
+        // another engine's pipe ends would keep them open, and the peer would never see the end of its engine's output.
+        // dup2 clears the flag on the engine's own standard input and output
+        int toEngine[2];
+        int fromEngine[2];
+        if (pipe2(toEngine, O_CLOEXEC) != 0) return false;
+        if (pipe2(fromEngine, O_CLOEXEC) != 0) {
+            close(toEngine[0]);
+            close(toEngine[1]);
+            return false;
+        }
+        pid = fork();
+        if (pid == 0) {
+            dup2(toEngine[0], STDIN_FILENO);
+            dup2(fromEngine[1], STDOUT_FILENO);
+            close(toEngine[0]);
+            close(toEngine[1]);
+            close(fromEngine[0]);
+            close(fromEngine[1]);
+            execl("/bin/sh", "sh", "-c", command.c_str(), static_cast<char*>(nullptr));
+            _exit(127);
+        }
+        close(toEngine[0]);
+        close(fromEngine[1]);
+        input = fdopen(toEngine[1], "w");
+        output = fdopen(fromEngine[0], "r");
+        if (pid < 0 || !input || !output) return false;
+
+        std::string line;
+        send("uci");
+        if (!waitFor("uciok", line)) return false;
+        send("setoption name Hash value " + std::to_string(hashMegabytes));
+        send("setoption name Threads value " + std::to_string(threads));
+        send("isready");
+        return waitFor("readyok", line);
+    }
+
+    bool newGame() override
+    {
+        std::string line;
+        send("ucinewgame");
+        send("isready");
+        return waitFor("readyok", line);
+    }
+
+    Move play(const std::string& startFen, const std::vector<Move>& moves, const Chessboard&, const SearchLimits& limits, int& score) override
+    {
+        std::string position = "position fen " + startFen;
+        if (!moves.empty()) position += " moves";
+        for (Move move : moves) position += " " + move.toString();
+        send(position);
+
+        std::string go = "go";
+        if (limits.depth) go += " depth " + std::to_string(limits.depth);
+        if (limits.nodes) go += " nodes " + std::to_string(limits.nodes);
+        if (limits.moveTime) go += " movetime " + std::to_string(limits.moveTime);
+        if (limits.time[0] || limits.time[1]) {
+            go += " wtime " + std::to_string(limits.time[0]) + " btime " + std::to_string(limits.time[1]) + " winc " + std::to_string(limits.increment[0]) +
+                  " binc " + std::to_string(limits.increment[1]);
+        }
+        send(go);
+
+        lastScore = 0;
+        std::string line;
+        std::string word;
+        Move move;
+        if (!waitFor("bestmove", line)) return Move();
+        std::istringstream words(line.substr(8));
+        if (!(words >> word) || !Move::fromString(word, move)) return Move();
+        score = lastScore;
+        return move;
+    }
+};
+
+// What a match is played with
+struct MatchConfig
+{
+    // "self" for the engine of this program, otherwise the command line of a UCI engine
+    std::string engines[2];
+    std::string names[2];
+    int games = 100;
+    int concurrency = 1;
+    SearchLimits limits;
+    std::string openingsPath;
+    std::string pgnPath;
+    std::string tablebasePath;
+    int hash = 16;
+    int threads = 1;
+
+    // Adjudication: drawn after maxPlies, won once both engines agree on a score of at least resignScore for
+    // resignMoves moves each, drawn once both scores stay within drawScore for drawMoves moves each after drawPly
+    int maxPlies = 400;
+    int resignScore = 1000;
+    int resignMoves = 3;
+    int drawScore = 10;
+    int drawMoves = 8;
+    int drawPly = 80;
+
+    // Sequential probability ratio test between Elo elo0 and elo1, with error rates alpha and beta
+    bool sprt = false;
+    double elo0 = 0;
+    double elo1 = 5;
+    double alpha = 0.05;
+    double beta = 0.05;
+};
+
+// Results of a match from the first engine's side
+struct MatchScore
+{
+    int wins = 0;
+    int draws = 0;
+    int losses = 0;
+
+    int games() const
+    {
+        return wins + draws + losses;
+    }
+
+    double score() const
+    {
+        return games() ? (wins + 0.5 * draws) / games() : 0.5;
+    }
+
+    // Spread of the score of one game
+    double variance() const
+    {
+        double p = score();
+        return games() ? (wins * (1 - p) * (1 - p) + draws * (0.5 - p) * (0.5 - p) + losses * p * p) / games() : 0;
+    }
+
+    static double eloFromScore(double p)
+    {
+        p = std::min(std::max(p, 1e-6), 1 - 1e-6);
+        return 400 * std::log10(p / (1 - p));
+    }
+
+    double elo() const
+    {
+        return eloFromScore(score());
+    }
+
+    // Half the width of the 95% confidence interval of the Elo difference
+    double eloError() const
+    {
+        if (!games()) return 0;
+        double margin = 1.96 * std::sqrt(variance() / games());
+        return (eloFromScore(score() + margin) - eloFromScore(score() - margin)) / 2;
+    }
+
+    /**
+     * @brief Log likelihood ratio of elo1 against elo0, from the normal approximation of the game scores
+     *
+     * @param elo0 Elo difference of the null hypothesis
+     * @param elo1 Elo difference of the alternative hypothesis
+     */
+    double llr(double elo0, double elo1) const
+    {
+        double var = variance();
+        if (!games() || var <= 0) return 0;
+        double s0 = 1 / (1 + std::pow(10, -elo0 / 400));
+        double s1 = 1 / (1 + std::pow(10, -elo1 / 400));
+        return games() * (s1 - s0) * (2 * score() - s0 - s1) / (2 * var);
+    }
+};
+
+// Start positions used when no opening file is given, each played once with each color
+static const char* const DEFAULT_OPENINGS[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 2",
+    "rnbqkbnr/pp1ppppp/8/2p5/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 2",
+    "rnbqkbnr/ppp1pppp/8/3p4/3P4/8/PPP1PPPP/RNBQKBNR w KQkq - 0 2",
+    "rnbqkb1r/pppppppp/5n2/8/3P4/8/PPP1PPPP/RNBQKBNR w KQkq - 1 2",
+    "rnbqkbnr/pppp1ppp/4p3/8/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 2",
+    "rnbqkbnr/pp1ppppp/2p5/8/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 2",
+    "rnbqkbnr/pppppppp/8/8/2P5/8/PP1PPPPP/RNBQKBNR b KQkq - 0 1"
+};
+
+// Plays a match between two engines, several games at a time
+class Tournament
+{
+private:
+    MatchConfig config;
+    std::vector<std::string> openings;
+    std::mutex resultsMutex;
+    MatchScore total;
+    FILE* pgn;
+    std::atomic<int> nextGame;
+    std::atomic<bool> finished;
+
+    std::unique_ptr<MatchPlayer> createPlayer(int engine) const
+    {
+        if (config.engines[engine] == "self") return std::unique_ptr<MatchPlayer>(new InProcessPlayer(config.hash, config.threads, config.tablebasePath));
+        std::unique_ptr<UciProcessPlayer> player(new UciProcessPlayer());
+        if (!player->start(config.engines[engine], config.hash, config.threads)) return nullptr;
+        return std::unique_ptr<MatchPlayer>(player.release());
+    }
+
+    /**
+     * @brief Plays one game
+     *
+     * @param players The two engines, players[0] being the first engine of the match
+     * @param number Number of the game, even games give the first engine white
+     * @param moveText Receives the moves of the game in SAN
+     * @param reason Receives why the game ended
+     * @return Result of the game
+     */
+    GameResult playGame(MatchPlayer* players[2], int number, const std::string& startFen, std::string& moveText, std::string& reason)
+    {
+        Chessboard board;
+        board.loadFEN(startFen);
+        std::vector<Move> moves;
+        std::vector<uint64_t> keys(1, board.getKey());
+        SearchLimits limits = config.limits;
+        bool firstIsWhite = number % 2 == 0;
+        int resignCount[2] = { 0, 0 };
+        int drawCount = 0;
+        moveText.clear();
+
+        for (int i = 0; i < 2; ++i) {
+            if (!players[i]->newGame()) {
+                reason = "engine stopped responding";
+                return GameResult::Unknown;
+            }
+        }
+
+        for (int ply = 0;; ++ply) {
+            bool black = board.isBlackToMove();
+            GameResult sideWins = black ? GameResult::WhiteWins : GameResult::BlackWins;
+
+            // Rules first: mate, stalemate, the fifty move rule, repetition and dead positions
+            GameStatus status = board.gameStatus(keys);
+            if (status != GameStatus::Ongoing) {
+                reason = gameStatusName(status);
+                return status == GameStatus::Checkmate ? sideWins : GameResult::Draw;
+            }
+            if (ply >= config.maxPlies) {
+                reason = "adjudication: game too long";
+                return GameResult::Draw;
+            }
+
+            int engine = (black == firstIsWhite) ? 1 : 0;
+            int score = 0;
+            auto start = std::chrono::steady_clock::now();
+            Move move = players[engine]->play(startFen, moves, board, limits, score);
+            long long used = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+            if (move.isNull() || !board.isLegalMove(move)) {
+                reason = move.isNull() ? "no move" : "illegal move " + move.toString();
+                return sideWins;
+            }
+            if (limits.time[black ? 1 : 0]) {
+                long long& clock = limits.time[black ? 1 : 0];
+                if (used > clock) {
+                    reason = "time forfeit";
+                    return sideWins;
+                }
+                clock += limits.increment[black ? 1 : 0] - used;
+            }
+
+            if (!black) moveText += std::to_string(board.getFullmoveNumber()) + ". ";
+            else if (ply == 0) moveText += std::to_string(board.getFullmoveNumber()) + "... ";
+            moveText += board.toSAN(move) + " ";
+            board.makeMove(move);
+            moves.push_back(move);
+            keys.push_back(board.getKey());
+
+            // Score adjudication, counted from white's point of view so both engines have to agree.
+            // A positive count is a run of scores winning for white, a negative one for black
+            int whiteScore = black ? -score : score;
+            int& run = resignCount[engine];
+            if (whiteScore >= config.resignScore) run = run > 0 ? run + 1 : 1;
+            else if (whiteScore <= -config.resignScore) run = run < 0 ? run - 1 : -1;
+            else run = 0;
+            if (std::min(resignCount[0], resignCount[1]) >= config.resignMoves) {
+                reason = "adjudication: score";
+                return GameResult::WhiteWins;
+            }
+            if (std::max(resignCount[0], resignCount[1]) <= -config.resignMoves) {
+                reason = "adjudication: score";
+                return GameResult::BlackWins;
+            }
+            drawCount = ply >= config.drawPly && abs(score) <= config.drawScore ? drawCount + 1 : 0;
+            if (drawCount >= 2 * config.drawMoves) {
+                reason = "adjudication: draw";
+                return GameResult::Draw;
+            }
+        }
+    }
+
+    // Adds a finished game to the PGN file
+    void writePgn(int number, const std::string& startFen, bool firstIsWhite, GameResult result, const std::string& moveText, const std::string& reason)
+    {
+        if (!pgn) return;
+        static const char* results[] = { "*", "1-0", "0-1", "1/2-1/2" };
+        char date[16];
+        time_t now = time(nullptr);
+        strftime(date, sizeof(date), "%Y.%m.%d", localtime(&now));
+        fprintf(pgn, "[Event \"Match\"]\n[Site \"local\"]\n[Date \"%s\"]\n[Round \"%d\"]\n[White \"%s\"]\n[Black \"%s\"]\n[Result \"%s\"]\n", date,
+                number + 1, config.names[firstIsWhite ? 0 : 1].c_str(), config.names[firstIsWhite ? 1 : 0].c_str(), results[static_cast<int>(result)]);
+        fprintf(pgn, "[FEN \"%s\"]\n[SetUp \"1\"]\n[Termination \"%s\"]\n\n%s{%s} %s\n\n", startFen.c_str(), reason.c_str(), moveText.c_str(),
+                reason.c_str(), results[static_cast<int>(result)]);
+        fflush(pgn);
+    }
+
+    // Runs on each of the concurrent game threads, with engines of its own
+    void worker()
+    {
+        std::unique_ptr<MatchPlayer> owned[2] = { createPlayer(0), createPlayer(1) };
+        if (!owned[0] || !owned[1]) {
+            std::lock_guard<std::mutex> lock(resultsMutex);
+            std::cout << "Could not start " << config.engines[owned[0] ? 1 : 0] << std::endl;
+            finished = true;
+            return;
+        }
+        MatchPlayer* players[2] = { owned[0].get(), owned[1].get() };
+
+        for (;;) {
+            int number = nextGame.fetch_add(1);
+            if (number >= config.games || finished) break;
+            const std::string& startFen = openings[(number / 2) % openings.size()];
+            bool firstIsWhite = number % 2 == 0;
+            std::string moveText;
+            std::string reason;
+            GameResult result = playGame(players, number, startFen, moveText, reason);
+
+            std::lock_guard<std::mutex> lock(resultsMutex);
+            if (result == GameResult::Draw) total.draws++;
+            else if (result != GameResult::Unknown) ((result == GameResult::WhiteWins) == firstIsWhite ? total.wins : total.losses)++;
+            writePgn(number, startFen, firstIsWhite, result, moveText, reason);
+
+            std::cout << "Game " << number + 1 << " (" << reason << ") Score of " << config.names[0] << " vs " << config.names[1] << ": " << total.wins
+                      << " - " << total.losses << " - " << total.draws << " Elo " << total.elo() << " +/- " << total.eloError();
+            if (config.sprt) {
+                double llr = total.llr(config.elo0, config.elo1);
+                double lower = std::log(config.beta / (1 - config.alpha));
+                double upper = std::log((1 - config.beta) / config.alpha);
+                std::cout << " LLR " << llr << " (" << lower << ", " << upper << ")";
+                if (llr <= lower || llr >= upper) {
+                    std::cout << std::endl << "SPRT: " << (llr >= upper ? "H1 accepted" : "H0 accepted");
+                    finished = true;
+                }
+            }
+            std::cout << std::endl;
+        }
+    }
+
+public:
+    Tournament(const MatchConfig& matchConfig) : config(matchConfig), pgn(nullptr), nextGame(0), finished(false)
+    {
+        for (int i = 0; i < 2; ++i) {
+            if (config.names[i].empty()) config.names[i] = config.engines[i] == "self" ? "self" : config.engines[i];
+        }
+        if (config.names[0] == config.names[1]) {
+            config.names[0] += " (1)";
+            config.names[1] += " (2)";
+        }
+    }
+
+    /**
+     * @brief Plays the match
+     *
+     * @param score Receives the results from the first engine's side
+     * @return false if the openings or the PGN file could not be opened
+     */
+    bool run(MatchScore& score)
+    {
+        if (!config.openingsPath.empty()) {
+            EpdReader reader;
+            if (!reader.open(config.openingsPath.c_str())) return false;
+            Chessboard board;
+            EpdRecord record;
+            while (reader.next(board, record)) {
+                if (record.opcodeCount >= 0) openings.push_back(board.getFEN());
+            }
+        }
+        else openings.assign(std::begin(DEFAULT_OPENINGS), std::end(DEFAULT_OPENINGS));
+        if (openings.empty()) return false;
+
+        if (!config.pgnPath.empty()) {
+            pgn = fopen(config.pgnPath.c_str(), "w");
+            if (!pgn) return false;
+        }
+
+        // A UCI engine that dies would otherwise take the match down with it on the next write
+        signal(SIGPIPE, SIG_IGN);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < std::max(1, config.concurrency); ++i) threads.emplace_back([this]() { worker(); });
+        for (std::thread& thread : threads) thread.join();
+        if (pgn) fclose(pgn);
+
+        score = total;
+        return true;
+    }
+};
+#endif
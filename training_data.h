@@ -0,0 +1,247 @@
+#ifndef TRAINING_DATA_H
+#define TRAINING_DATA_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "chess.h"
+#include "mapped_file.h"
+#include "packed_position.h"
+#include "pgn.h"
+
+/*
+ * Training data file, all fields little endian:
+ *
+ *   Header (32 bytes)    magic "CHESSTD1", version, record size, record count
+ *   Records              record count 32 byte records, in no particular order
+ *
+ * A record is the first 28 bytes of a PackedPosition, i.e. everything but its reserved bytes, followed by the
+ * search score in centipawns from the side to move, clamped to +-TRAINING_SCORE_LIMIT, and the result of the game
+ * the position was played in as a GameResult.
+ */
+
+static const char TRAINING_DATA_MAGIC[8] = { 'C', 'H', 'E', 'S', 'S', 'T', 'D', '1' };
+static const uint32_t TRAINING_DATA_VERSION = 1;
+static const int TRAINING_SCORE_LIMIT = 32000;
+
+struct TrainingDataHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t recordCount;
+    uint64_t reserved;
+};
+static_assert(sizeof(TrainingDataHeader) == 32, "the header is part of the format");
+
+struct TrainingRecord
+{
+    uint8_t position[28];
+    int16_t score;
+    uint8_t result;
+    uint8_t reserved;
+};
+static_assert(sizeof(TrainingRecord) == 32, "records are part of the format");
+static_assert(offsetof(PackedPosition, reserved) == sizeof(TrainingRecord::position), "a record holds the packed position up to its reserved bytes");
+
+/**
+ * @brief Fills a training record
+ *
+ * @param board The position
+ * @param score Search score from the side to move
+ * @param result Result of the game
+ * @param record Receives the record
+ * @return false if the position can't be packed
+ */
+inline bool makeTrainingRecord(const Chessboard& board, int score, GameResult result, TrainingRecord& record)
+{
+    PackedPosition packed;
+    if (!packPosition(board, packed)) return false;
+    std::memcpy(record.position, &packed, sizeof(record.position));
+    record.score = static_cast<int16_t>(std::clamp(score, -TRAINING_SCORE_LIMIT, TRAINING_SCORE_LIMIT));
+    record.result = static_cast<uint8_t>(result);
+    record.reserved = 0;
+    return true;
+}
+
+// Returns the packed position of a record
+inline PackedPosition trainingPosition(const TrainingRecord& record)
+{
+    PackedPosition packed = PackedPosition();
+    std::memcpy(&packed, record.position, sizeof(record.position));
+    return packed;
+}
+
+/**
+ * @brief Writes a training data file that many threads append to at once. Each append claims the next free
+ *        records with one atomic add and writes them there with pwrite, so threads never wait for each other
+ */
+class TrainingDataWriter
+{
+private:
+    int fd;
+    std::atomic<uint64_t> records;
+    std::atomic<bool> failed;
+
+public:
+    TrainingDataWriter() : fd(-1), records(0), failed(false) {}
+
+    ~TrainingDataWriter()
+    {
+        close();
+    }
+
+    TrainingDataWriter(const TrainingDataWriter&) = delete;
+    TrainingDataWriter& operator=(const TrainingDataWriter&) = delete;
+
+    /**
+     * @brief Creates a training data file
+     *
+     * @param path Path of the file
+     * @return true if the file was created
+     */
+    bool open(const char* path)
+    {
+        close();
+        fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        records = 0;
+        failed = false;
+        return fd >= 0;
+    }
+
+    /**
+     * @brief Appends records. Safe to call from any number of threads
+     *
+     * @param data The records
+     * @param count Number of records
+     * @return false if they could not be written
+     */
+    bool append(const TrainingRecord* data, size_t count)
+    {
+        uint64_t first = records.fetch_add(count, std::memory_order_relaxed);
+        const char* bytes = reinterpret_cast<const char*>(data);
+        size_t size = count * sizeof(TrainingRecord);
+        off_t offset = static_cast<off_t>(sizeof(TrainingDataHeader) + first * sizeof(TrainingRecord));
+        while (size > 0) {
+            ssize_t written = pwrite(fd, bytes, size, offset);
+            if (written <= 0) {
+                failed = true;
+                return false;
+            }
+            bytes += written;
+            size -= static_cast<size_t>(written);
+            offset += written;
+        }
+        return true;
+    }
+
+    // Returns the number of records appended so far
+    uint64_t count() const
+    {
+        return records.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Writes the header and closes the file. Every append has to have returned
+     *
+     * @return false if a write failed
+     */
+    bool close()
+    {
+        if (fd < 0) return true;
+        TrainingDataHeader header = {};
+        std::memcpy(header.magic, TRAINING_DATA_MAGIC, sizeof(header.magic));
+        header.version = TRAINING_DATA_VERSION;
+        header.recordSize = sizeof(TrainingRecord);
+        header.recordCount = records;
+        bool ok = !failed && pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+        ok = ::close(fd) == 0 && ok;
+        fd = -1;
+        return ok;
+    }
+};
+
+// Collects one thread's records and hands them to the shared writer a large block at a time
+class TrainingDataBuffer
+{
+private:
+    TrainingDataWriter& writer;
+    std::vector<TrainingRecord> records;
+    size_t capacity;
+
+public:
+    TrainingDataBuffer(TrainingDataWriter& output, size_t blockRecords) : writer(output), capacity(std::max<size_t>(blockRecords, 1))
+    {
+        records.reserve(capacity);
+    }
+
+    ~TrainingDataBuffer()
+    {
+        flush();
+    }
+
+    void add(const TrainingRecord& record)
+    {
+        records.push_back(record);
+        if (records.size() >= capacity) flush();
+    }
+
+    bool flush()
+    {
+        bool ok = records.empty() || writer.append(records.data(), records.size());
+        records.clear();
+        return ok;
+    }
+};
+
+// Reads a training data file through a memory mapping
+class TrainingDataReader
+{
+private:
+    MappedFile file;
+    const TrainingRecord* records;
+    uint64_t recordCount;
+
+public:
+    TrainingDataReader() : records(nullptr), recordCount(0) {}
+
+    /**
+     * @brief Maps a training data file
+     *
+     * @param path Path of the file
+     * @return false if the file could not be mapped, isn't training data or is cut short
+     */
+    bool open(const char* path)
+    {
+        records = nullptr;
+        recordCount = 0;
+        if (!file.open(path)) return false;
+        TrainingDataHeader header;
+        if (file.length() < sizeof(header)) return false;
+        std::memcpy(&header, file.begin(), sizeof(header));
+        if (std::memcmp(header.magic, TRAINING_DATA_MAGIC, sizeof(header.magic)) != 0 || header.version != TRAINING_DATA_VERSION ||
+            header.recordSize != sizeof(TrainingRecord) || (file.length() - sizeof(header)) / sizeof(TrainingRecord) < header.recordCount) {
+            file.close();
+            return false;
+        }
+        records = reinterpret_cast<const TrainingRecord*>(file.begin() + sizeof(header));
+        recordCount = header.recordCount;
+        return true;
+    }
+
+    uint64_t count() const
+    {
+        return recordCount;
+    }
+
+    const TrainingRecord& record(uint64_t index) const
+    {
+        return records[index];
+    }
+};
+#endif
@@ -0,0 +1,349 @@
+#ifndef TUNER_H
+#define TUNER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "evaluation.h"
+#include "training_data.h"
+
+// How the evaluation is tuned
+struct TunerConfig
+{
+    int threads = 1;
+    int maxEpochs = 2000;
+
+    // Adam step size, in centipawns
+    double learningRate = 1;
+
+    // The target of a position is lambda * game result + (1 - lambda) * the search score turned into a result
+    double lambda = 1;
+
+    // Weight of the sum of squared piece-square values added to the loss, which keeps squares that few positions
+    // have a piece on from drifting to values that only fit those positions
+    double regularization = 1e-8;
+
+    // Stops once the loss has improved by less than tolerance, relative, over patience epochs
+    double tolerance = 1e-5;
+    int patience = 20;
+};
+
+// Where the tuning has got
+struct TunerProgress
+{
+    int epoch;
+    double loss;
+    double epochSeconds;
+};
+
+/**
+ * @brief Texel style tuner of EvalParams. The positions of a training data file are turned into lists of
+ *        piece-square features once, in one flat array, and every epoch computes the mean squared error between
+ *        the game results and the sigmoid of the evaluation over all of them, with its gradient, on all threads.
+ *        Adam then moves the weights down the gradient until the loss stops improving
+ */
+class EvalTuner
+{
+private:
+    // Weights in the order of EvalParams: per stage, 6 material values and then 6 * 64 piece-square values
+    static const int STAGE_SIZE = 6 + 6 * 64;
+    static const int PARAM_COUNT = 2 * STAGE_SIZE;
+
+    // A feature is Type - 1 times 64 plus the square from white's side, with BLACK_FEATURE set for black pieces
+    static const uint16_t BLACK_FEATURE = 0x8000;
+
+    TunerConfig config;
+    std::vector<uint16_t> features;
+    std::vector<uint32_t> offsets;
+    std::vector<uint8_t> phases;
+    std::vector<float> results;
+    std::vector<float> scores;
+    std::vector<float> targets;
+    std::vector<double> params;
+    double scale;
+
+    // Scratch space of one thread during an epoch
+    struct Partial
+    {
+        double loss;
+        std::vector<double> gradient;
+    };
+
+    static double sigmoid(double x)
+    {
+        return 1 / (1 + std::exp(-x));
+    }
+
+    /**
+     * @brief Runs over a share of the positions
+     *
+     * @param table Value of every feature per stage, material included
+     * @param first First position
+     * @param last One past the last position
+     * @param k Scale of the sigmoid
+     * @param useTargets Whether to compare with the targets or the plain results
+     * @param partial Receives the summed loss and, if gradient isn't empty, the gradient per feature and stage
+     */
+    void accumulate(const std::vector<float>& table, size_t first, size_t last, double k, bool useTargets, Partial& partial) const
+    {
+        const float* middlegame = table.data();
+        const float* endgame = table.data() + 6 * 64;
+        bool withGradient = !partial.gradient.empty();
+        double* gradient = partial.gradient.data();
+        double loss = 0;
+        for (size_t i = first; i < last; ++i) {
+            // Black's values are subtracted, so the sums are kept for each color
+            float sums[2][2] = {};
+            for (uint32_t f = offsets[i]; f < offsets[i + 1]; ++f) {
+                int color = features[f] >> 15;
+                int slot = features[f] & 0x7FFF;
+                sums[color][0] += middlegame[slot];
+                sums[color][1] += endgame[slot];
+            }
+            double phase = phases[i];
+            double score = ((sums[0][0] - sums[1][0]) * phase + (sums[0][1] - sums[1][1]) * (EVAL_PHASE_MAX - phase)) / EVAL_PHASE_MAX;
+            double predicted = sigmoid(k * score);
+            double error = predicted - (useTargets ? targets[i] : results[i]);
+            loss += error * error;
+            if (!withGradient) continue;
+
+            double slope = 2 * error * predicted * (1 - predicted) * k;
+            double slopes[2] = { slope * phase / EVAL_PHASE_MAX, slope * (EVAL_PHASE_MAX - phase) / EVAL_PHASE_MAX };
+            for (uint32_t f = offsets[i]; f < offsets[i + 1]; ++f) {
+                int slot = features[f] & 0x7FFF;
+                double sign = features[f] & BLACK_FEATURE ? -1 : 1;
+                gradient[slot] += sign * slopes[0];
+                gradient[6 * 64 + slot] += sign * slopes[1];
+            }
+        }
+        partial.loss = loss;
+    }
+
+    /**
+     * @brief Computes the mean loss, and its gradient with respect to the weights, over every position
+     *
+     * @param k Scale of the sigmoid
+     * @param useTargets Whether to compare with the targets or the plain results
+     * @param gradient If not null, receives the gradient in the order of the weights
+     */
+    double evaluateLoss(double k, bool useTargets, std::vector<double>* gradient) const
+    {
+        // The value of each feature, material and square together
+        std::vector<float> table(2 * 6 * 64);
+        for (int stage = 0; stage < 2; ++stage) {
+            for (int slot = 0; slot < 6 * 64; ++slot) {
+                table[stage * 6 * 64 + slot] = static_cast<float>(params[stage * STAGE_SIZE + slot / 64] + params[stage * STAGE_SIZE + 6 + slot]);
+            }
+        }
+
+        int threads = std::max(1, config.threads);
+        std::vector<Partial> partials(threads);
+        std::vector<std::thread> workers;
+        size_t count = size();
+        for (int t = 0; t < threads; ++t) {
+            if (gradient) partials[t].gradient.assign(2 * 6 * 64, 0);
+            workers.emplace_back([&, t]() { accumulate(table, count * t / threads, count * (t + 1) / threads, k, useTargets, partials[t]); });
+        }
+        for (std::thread& worker : workers) worker.join();
+
+        double loss = 0;
+        for (const Partial& partial : partials) loss += partial.loss;
+        if (gradient) {
+            gradient->assign(PARAM_COUNT, 0);
+            for (const Partial& partial : partials) {
+                for (int stage = 0; stage < 2; ++stage) {
+                    for (int slot = 0; slot < 6 * 64; ++slot) {
+                        double value = partial.gradient[stage * 6 * 64 + slot] / count;
+                        (*gradient)[stage * STAGE_SIZE + slot / 64] += value;
+                        (*gradient)[stage * STAGE_SIZE + 6 + slot] += value;
+                    }
+                }
+            }
+        }
+        return loss / count;
+    }
+
+public:
+    EvalTuner(const TunerConfig& tunerConfig) : config(tunerConfig), offsets(1, 0), scale(0)
+    {
+        params.resize(PARAM_COUNT);
+        for (int stage = 0; stage < 2; ++stage) {
+            for (int type = 0; type < 6; ++type) {
+                params[stage * STAGE_SIZE + type] = EVAL_PARAMS.material[stage][type];
+                for (int square = 0; square < 64; ++square) params[stage * STAGE_SIZE + 6 + type * 64 + square] = EVAL_PARAMS.pieceSquare[stage][type][square];
+            }
+        }
+    }
+
+    size_t size() const
+    {
+        return phases.size();
+    }
+
+    /**
+     * @brief Adds the positions of a training data file whose game has a result
+     *
+     * @param path Path of the file
+     * @return false if the file could not be read
+     */
+    bool load(const char* path)
+    {
+        TrainingDataReader reader;
+        if (!reader.open(path)) return false;
+        features.reserve(features.size() + reader.count() * 24);
+        for (uint64_t i = 0; i < reader.count(); ++i) {
+            const TrainingRecord& record = reader.record(i);
+            GameResult result = static_cast<GameResult>(record.result);
+            if (result == GameResult::Unknown) continue;
+
+            PackedPosition position = trainingPosition(record);
+            int phase = 0;
+            int index = 0;
+            for (uint64_t squares = position.occupancy; squares && index < 32; squares &= squares - 1, ++index) {
+                int square = __builtin_ctzll(squares);
+                int code = (position.pieces[index / 2] >> (4 * (index % 2))) & 15;
+                int type = (code & 7) == PACKED_PASSED_PAWN ? 0 : (code & 7) - 1;
+                if (type < 0) break;
+                bool black = code & PACKED_BLACK;
+                int whiteSquare = black ? (7 - square / 8) * 8 + square % 8 : square;
+                features.push_back(static_cast<uint16_t>(type * 64 + whiteSquare) | (black ? BLACK_FEATURE : 0));
+                phase += EVAL_PHASE_WEIGHTS[type];
+            }
+            offsets.push_back(static_cast<uint32_t>(features.size()));
+            phases.push_back(static_cast<uint8_t>(std::min(phase, EVAL_PHASE_MAX)));
+            results.push_back(result == GameResult::WhiteWins ? 1.0f : result == GameResult::BlackWins ? 0.0f : 0.5f);
+            scores.push_back(position.state & 1 ? -record.score : record.score);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Finds the scale of the sigmoid that fits the current weights to the results best, by golden section
+     *        search. The weights are then tuned with this scale fixed
+     *
+     * @return The scale, per centipawn
+     */
+    double fitScale()
+    {
+        const double ratio = (std::sqrt(5.0) - 1) / 2;
+        double low = 0.0001;
+        double high = 0.05;
+        for (int i = 0; i < 40; ++i) {
+            double a = high - ratio * (high - low);
+            double b = low + ratio * (high - low);
+            if (evaluateLoss(a, false, nullptr) < evaluateLoss(b, false, nullptr)) high = b;
+            else low = a;
+        }
+        scale = (low + high) / 2;
+        return scale;
+    }
+
+    /**
+     * @brief Tunes the weights with Adam until the loss converges or maxEpochs is reached
+     *
+     * @param progress If set, called after every epoch
+     * @return The final loss
+     */
+    double tune(const std::function<void(const TunerProgress&)>& progress = nullptr)
+    {
+        if (size() == 0) return 0;
+        if (scale == 0) fitScale();
+        targets.resize(size());
+        for (size_t i = 0; i < size(); ++i) targets[i] = static_cast<float>(config.lambda * results[i] + (1 - config.lambda) * sigmoid(scale * scores[i]));
+
+        const double beta1 = 0.9;
+        const double beta2 = 0.999;
+        std::vector<double> gradient;
+        std::vector<double> momentum(PARAM_COUNT, 0);
+        std::vector<double> velocity(PARAM_COUNT, 0);
+        std::vector<double> history;
+        double loss = 0;
+        for (int epoch = 1; epoch <= config.maxEpochs; ++epoch) {
+            auto start = std::chrono::steady_clock::now();
+            loss = evaluateLoss(scale, true, &gradient);
+            for (int i = 0; i < PARAM_COUNT; ++i) {
+                // The king is always on the board, so its material can't be told apart from the rest
+                if (i % STAGE_SIZE == 5) continue;
+                if (i % STAGE_SIZE >= 6) {
+                    loss += config.regularization * params[i] * params[i];
+                    gradient[i] += 2 * config.regularization * params[i];
+                }
+                momentum[i] = beta1 * momentum[i] + (1 - beta1) * gradient[i];
+                velocity[i] = beta2 * velocity[i] + (1 - beta2) * gradient[i] * gradient[i];
+                double corrected = momentum[i] / (1 - std::pow(beta1, epoch));
+                double spread = velocity[i] / (1 - std::pow(beta2, epoch));
+                params[i] -= config.learningRate * corrected / (std::sqrt(spread) + 1e-12);
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (progress) progress({ epoch, loss, seconds });
+
+            history.push_back(loss);
+            if (history.size() > static_cast<size_t>(config.patience) &&
+                history[history.size() - 1 - config.patience] - loss < config.tolerance * history[history.size() - 1 - config.patience]) {
+                break;
+            }
+        }
+        return loss;
+    }
+
+    // Returns the weights rounded to whole centipawns
+    EvalParams result() const
+    {
+        EvalParams rounded = {};
+        for (int stage = 0; stage < 2; ++stage) {
+            for (int type = 0; type < 6; ++type) {
+                rounded.material[stage][type] = static_cast<int>(std::lround(params[stage * STAGE_SIZE + type]));
+                for (int square = 0; square < 64; ++square) {
+                    rounded.pieceSquare[stage][type][square] = static_cast<int>(std::lround(params[stage * STAGE_SIZE + 6 + type * 64 + square]));
+                }
+            }
+        }
+        return rounded;
+    }
+};
+
+/**
+ * @brief Writes weights as the eval_params.h header
+ *
+ * @param params The weights
+ * @param path Path of the header
+ * @return false if the file could not be written
+ */
+inline bool writeEvalParams(const EvalParams& params, const char* path)
+{
+    static const char* const names[6] = { "pawn", "knight", "bishop", "rook", "queen", "king" };
+    FILE* out = fopen(path, "w");
+    if (!out) return false;
+    fprintf(out, "#ifndef EVAL_PARAMS_H\n#define EVAL_PARAMS_H\n\n");
+    fprintf(out, "/*\n * Weights of the static evaluation, written by `./chess tune`. Included by evaluation.h, which defines EvalParams.\n");
+    fprintf(out, " * Piece-square values are indexed by row * 8 + col from white's side, row 0 being rank 8; black pieces use the\n");
+    fprintf(out, " * square mirrored to white's side.\n */\n\n");
+    fprintf(out, "static constexpr EvalParams EVAL_PARAMS = {\n    // Material, middlegame then endgame, pawn to king\n");
+    for (int stage = 0; stage < 2; ++stage) {
+        fprintf(out, "%s", stage ? "      { " : "    { { ");
+        for (int type = 0; type < 6; ++type) fprintf(out, "%d%s", params.material[stage][type], type < 5 ? ", " : "");
+        fprintf(out, "%s", stage ? " } },\n" : " },\n");
+    }
+    fprintf(out, "    // Piece-square values, middlegame then endgame\n    {\n");
+    for (int stage = 0; stage < 2; ++stage) {
+        fprintf(out, "        {\n");
+        for (int type = 0; type < 6; ++type) {
+            fprintf(out, "            // %s\n            {\n", names[type]);
+            for (int row = 0; row < 8; ++row) {
+                fprintf(out, "                ");
+                for (int col = 0; col < 8; ++col) fprintf(out, "%d%s", params.pieceSquare[stage][type][row * 8 + col], col < 7 ? ", " : "");
+                fprintf(out, "%s", row < 7 ? ",\n" : " }");
+            }
+            fprintf(out, "%s\n", type < 5 ? "," : "");
+        }
+        fprintf(out, "        }%s\n", stage ? "" : ",");
+    }
+    fprintf(out, "    }\n};\n#endif\n");
+    return fclose(out) == 0;
+}
+#endif
@@ -0,0 +1,220 @@
+#ifndef UCI_H
+#define UCI_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "chess.h"
+#include "engine.h"
+
+/*
+ * Universal Chess Interface front end, so the engine can be driven by tournament managers and GUIs.
+ * Commands are read on the calling thread while searches run on their own thread, so "stop" and
+ * "ponderhit" take effect at once.
+ */
+
+// Ranges of the spin options, as announced to the GUI
+static const long long UCI_MAX_HASH = 65536;
+static const long long UCI_MAX_THREADS = 256;
+
+class UciSession
+{
+private:
+    Engine& engine;
+    Chessboard board;
+    std::thread searchThread;
+    std::mutex outputMutex;
+
+    // Set while a "go infinite" or "go ponder" search may not send its move until told to
+    std::mutex waitMutex;
+    std::condition_variable waitCondition;
+    bool holdMove = false;
+
+    void send(const std::string& line)
+    {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        std::cout << line << std::endl;
+    }
+
+    // Writes a score as "cp <centipawns>" or "mate <moves>"
+    static std::string formatScore(int score)
+    {
+        if (!isMateScore(score)) return "cp " + std::to_string(score);
+        int moves = score > 0 ? (MATE_SCORE - score + 1) / 2 : -(MATE_SCORE + score) / 2;
+        return "mate " + std::to_string(moves);
+    }
+
+    void releaseMove()
+    {
+        std::lock_guard<std::mutex> lock(waitMutex);
+        holdMove = false;
+        waitCondition.notify_all();
+    }
+
+    // Stops a running search and waits until it has sent its move
+    void finishSearch()
+    {
+        if (!searchThread.joinable()) return;
+        engine.stop();
+        releaseMove();
+        searchThread.join();
+    }
+
+    /**
+     * @brief Sets up the board from "position startpos|fen <fen> [moves <move>...]"
+     *
+     * @param input The rest of the command after "position"
+     */
+    void position(std::istringstream& input)
+    {
+        std::string token;
+        input >> token;
+        Chessboard loaded;
+        if (token == "fen") {
+            std::string fen;
+            while (input >> token && token != "moves") fen += (fen.empty() ? "" : " ") + token;
+            if (!loaded.loadFEN(fen)) {
+                send("info string invalid fen " + fen);
+                return;
+            }
+        }
+        else if (token == "startpos") input >> token;
+        else return;
+
+        while (input >> token) {
+            Move move;
+            if (!Move::fromString(token, move) || !loaded.makeMove(move)) {
+                send("info string illegal move " + token);
+                break;
+            }
+        }
+        board = loaded;
+    }
+
+    // Starts a search from "go [depth N] [nodes N] [movetime N] [wtime N] [btime N] [winc N] [binc N] [movestogo N] [infinite] [ponder]"
+    void go(std::istringstream& input)
+    {
+        SearchLimits limits;
+        std::string token;
+        while (input >> token) {
+            if (token == "infinite") limits.infinite = true;
+            else if (token == "ponder") limits.ponder = true;
+            else if (token == "depth") input >> limits.depth;
+            else if (token == "nodes") input >> limits.nodes;
+            else if (token == "movetime") input >> limits.moveTime;
+            else if (token == "wtime") input >> limits.time[0];
+            else if (token == "btime") input >> limits.time[1];
+            else if (token == "winc") input >> limits.increment[0];
+            else if (token == "binc") input >> limits.increment[1];
+            else if (token == "movestogo") input >> limits.movesToGo;
+        }
+
+        finishSearch();
+        engine.resetStop();
+        holdMove = limits.infinite || limits.ponder;
+        searchThread = std::thread([this, limits]() {
+            Move ponderMove;
+            Move best = engine.think(board, limits, [this](const SearchReport& report) {
+                std::string line = "info depth " + std::to_string(report.depth) + " score " + formatScore(report.score) + " nodes " +
+                                   std::to_string(report.nodes) + " nps " + std::to_string(report.nodes * 1000 / std::max(1LL, report.milliseconds)) +
+                                   " time " + std::to_string(report.milliseconds) + " pv";
+                for (Move move : report.pv) line += " " + move.toString();
+                send(line);
+            }, &ponderMove);
+
+            // The move of an infinite or ponder search may only be sent once the GUI asks for it
+            {
+                std::unique_lock<std::mutex> lock(waitMutex);
+                waitCondition.wait(lock, [this]() { return !holdMove; });
+            }
+            const MoveTimeStats& time = engine.getTimeManager().lastMove();
+            send("info string time used " + std::to_string(time.used) + " optimum " + std::to_string(time.optimum) + " maximum " +
+                 std::to_string(time.maximum) + " depth " + std::to_string(time.depth) + (time.forced ? " forced" : ""));
+            SEARCH_STAT(send("info string stats " + engine.getSearchStats().toJson()));
+            send("bestmove " + (best.isNull() ? std::string("0000") : best.toString()) + (ponderMove.isNull() ? "" : " ponder " + ponderMove.toString()));
+        });
+    }
+
+    // Handles "setoption name <name> value <value>"
+    void setOption(std::istringstream& input)
+    {
+        std::string token;
+        std::string name;
+        std::string value;
+        input >> token;
+        while (input >> token && token != "value") name += (name.empty() ? "" : " ") + token;
+        input >> value;
+
+        // Values that aren't 64 bit integers are ignored, the others are clamped to the announced range
+        std::istringstream parsed(value);
+        long long number;
+        if (!(parsed >> number) || !parsed.eof()) return;
+        if (name == "Hash") engine.setHashSize(static_cast<size_t>(std::clamp(number, 1LL, UCI_MAX_HASH)));
+        else if (name == "Threads") engine.setThreads(static_cast<int>(std::clamp(number, 1LL, UCI_MAX_THREADS)));
+    }
+
+public:
+    UciSession(Engine& uciEngine) : engine(uciEngine) {}
+
+    ~UciSession()
+    {
+        finishSearch();
+    }
+
+    /**
+     * @brief Reads commands until "quit" or the end of input
+     *
+     * @param commands Stream to read the commands from
+     * @return Exit code of the program
+     */
+    int run(std::istream& commands = std::cin)
+    {
+        std::string line;
+        while (std::getline(commands, line)) {
+            std::istringstream input(line);
+            std::string command;
+            input >> command;
+            if (command == "uci") {
+                send("id name Chess-C---game");
+                send("id author danusan-s");
+                send("option name Hash type spin default 16 min 1 max " + std::to_string(UCI_MAX_HASH));
+                send("option name Threads type spin default 1 min 1 max " + std::to_string(UCI_MAX_THREADS));
+                send("option name Ponder type check default false");
+                send("uciok");
+            }
+            else if (command == "isready") send("readyok");
+            else if (command == "setoption") {
+                finishSearch();
+                setOption(input);
+            }
+            else if (command == "ucinewgame") {
+                finishSearch();
+                engine.clearHash();
+            }
+            else if (command == "position") {
+                finishSearch();
+                position(input);
+            }
+            else if (command == "go") go(input);
+            else if (command == "stop") finishSearch();
+            else if (command == "ponderhit") {
+                engine.ponderHit();
+                releaseMove();
+            }
+            else if (command == "quit") break;
+        }
+        finishSearch();
+
+        const TimeManager& time = engine.getTimeManager();
+        if (time.movesPlayed()) {
+            send("info string moves " + std::to_string(time.movesPlayed()) + " average used " + std::to_string(time.averageUsed()) + " average optimum " +
+                 std::to_string(time.averageOptimum()) + " overruns " + std::to_string(time.overrunCount()));
+        }
+        return 0;
+    }
+};
+#endif